@@ -46,6 +46,8 @@ namespace Geomerty {
 		virtual void Init(Graph* graph) = 0;
 		virtual void Execute(ExetContex* ctx) = 0;
 		virtual void Present(Geomerty::Viewer& viewer) = 0;
+		// Called for every step of a control point drag, nodes that can update their mesh in place override it
+		virtual void PresentEdit(Geomerty::Viewer& viewer) { Present(viewer); }
 	};
 
 	using PinType = size_t;
@@ -6,6 +6,7 @@
 #include "nodes/nurbs_arc_node.h"
 #include "algorithm/mesh_triangulate.h"
 #include "nurbs/nurbs_evalute_curve.h"
+#include "nurbs/nurbs_tessellate.h"
 #include "nurbs/nurbs_make.h"
 #include "nurbs/nurbs_io.h"
 namespace Geomerty {
@@ -109,7 +110,7 @@ namespace Geomerty {
 		using Vec3 = Geomerty::nurbs::util::vec3;
 		Geomerty::nurbs::RationalCurve* crv = new Geomerty::nurbs::RationalCurve();
 		if (item_current_idx == 0) {
-			Geomerty::nurbs::util::CreateArc(center, xaxis, yaxis, start_angle, end_angle, xaxis.norm(), yaxis.norm(), *crv);
+			Geomerty::nurbs::util::create_arc(center, xaxis, yaxis, start_angle, end_angle, xaxis.norm(), yaxis.norm(), *crv);
 			//*crv = Geomerty::nurbs::util::rational_ellipse_arc_curve(center, xaxis, yaxis, start_angle, end_angle);
 		}
 		else if (item_current_idx == 1) {
@@ -134,8 +135,8 @@ namespace Geomerty {
 	{
 		auto& registry = Geomerty::ServiceLocator::Get<Geomerty::Graph>().registry;
 		auto crv = registry[Outputs.back().index].Get<Geomerty::nurbs::RationalCurve>();
-		if (crv != nullptr) {
-			auto pos_arr = Geomerty::nurbs::util::sample_curve(*crv, 80);
+		if (crv != nullptr && Geomerty::nurbs::util::curve_is_valid(*crv)) {
+			auto pos_arr = std::get<0>(Geomerty::nurbs::util::tessellate_curve(*crv));
 			Eigen::MatrixXd TV;
 			Eigen::MatrixXi TE;
 			Eigen::MatrixXd TC;
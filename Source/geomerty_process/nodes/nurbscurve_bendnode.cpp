@@ -6,6 +6,7 @@
 #include "nodes/nurbscurve_bendnode.h"
 #include "algorithm/mesh_triangulate.h"
 #include "nurbs/nurbs_evalute_curve.h"
+#include "nurbs/nurbs_tessellate.h"
 #include "nurbs/nurbs_make.h"
 #include "nurbs/nurbs_io.h"
 namespace Geomerty {
@@ -59,8 +60,8 @@ namespace Geomerty {
 	{
 		auto& registry = Geomerty::ServiceLocator::Get<Geomerty::Graph>().registry;
 		auto crv = registry[Outputs.back().index].Get<Geomerty::nurbs::RationalCurve>();
-		if (crv != nullptr) {
-			auto pos_arr = Geomerty::nurbs::util::sample_curve(*crv, 80);
+		if (crv != nullptr && Geomerty::nurbs::util::curve_is_valid(*crv)) {
+			auto pos_arr = std::get<0>(Geomerty::nurbs::util::tessellate_curve(*crv));
 			Eigen::MatrixXd TV;
 			Eigen::MatrixXi TE;
 			Eigen::MatrixXd TC;
@@ -5,6 +5,7 @@
 #include "core/ServiceLocator.h"
 #include "nodes/nurbscurve_splitnode.h"
 #include "nurbs/nurbs_evalute_curve.h"
+#include "nurbs/nurbs_tessellate.h"
 
 namespace Geomerty {
 	void NurbsCurve_SplitNode::InstallUi()
@@ -50,9 +51,9 @@ namespace Geomerty {
 		auto& registry = Geomerty::ServiceLocator::Get<Geomerty::Graph>().registry;
 		auto crvleft = registry[Outputs[0].index].Get<Geomerty::nurbs::RationalCurve>();
 		auto crvright = registry[Outputs[1].index].Get<Geomerty::nurbs::RationalCurve>();
-		if (crvleft != nullptr && crvright != nullptr) {
-			auto posleft_arr = Geomerty::nurbs::util::sample_curve(*crvleft, 80);
-			auto posright_arr = Geomerty::nurbs::util::sample_curve(*crvright, 80);
+		if (crvleft != nullptr && crvright != nullptr && Geomerty::nurbs::util::curve_is_valid(*crvleft) && Geomerty::nurbs::util::curve_is_valid(*crvright)) {
+			auto posleft_arr = std::get<0>(Geomerty::nurbs::util::tessellate_curve(*crvleft));
+			auto posright_arr = std::get<0>(Geomerty::nurbs::util::tessellate_curve(*crvright));
 			Eigen::MatrixXd TV;
 			Eigen::MatrixXi TE;
 			Eigen::MatrixXd TC;
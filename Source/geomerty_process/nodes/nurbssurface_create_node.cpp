@@ -4,8 +4,10 @@
 #include "UI/Panels/PanelsManager.h"
 #include "core/ServiceLocator.h"
 #include "nodes/nurbssurface_create_node.h"
+#include "nodes/nurbssurface_present.h"
 #include "algorithm/mesh_triangulate.h"
 #include "nurbs/nurbs_evalute_surface.h"
+#include "nurbs/nurbs_tessellation_cache.h"
 #include "nurbs/nurbs_make.h"
 #include "nurbs/nurbs_io.h"
 namespace Geomerty {
@@ -38,6 +40,10 @@ namespace Geomerty {
 			}
 			ImGui::EndDragDropTarget();
 		}
+		if (ImGui::SliderFloat("chord_tolerance", &chord_tolerance, 0.001f, 1.0f)) {
+			auto& input_manager = Geomerty::ServiceLocator::Get<UI::Panels::PanelsManager>();
+			Present(input_manager.GetPanelAs<Geomerty::ControllerView>("Scene View").viewer);
+		}
 		if (ImGui::Button("Present")) {
 			auto& input_manager = Geomerty::ServiceLocator::Get<UI::Panels::PanelsManager>();
 			Present(input_manager.GetPanelAs<Geomerty::ControllerView>("Scene View").viewer);
@@ -68,10 +74,8 @@ namespace Geomerty {
 		auto& arr = input_manager.GetPanelAs<Geomerty::ControllerView>("Scene View").arr;
 		input_manager.GetPanelAs<Geomerty::ControllerView>("Scene View").node = this;
 		arr.clear();
-		for (int i = 0; i < crv->m_control_points.size(); i++) {
-			for (auto& it : crv->m_control_points[i]) {
-				arr.emplace_back(&it);
-			}
+		for (auto& it : crv->m_control_points) {
+			arr.emplace_back(&it);
 		}
 	}
 	void NurbsSurface_Node::Present(Geomerty::Viewer& viewer)
@@ -79,52 +83,42 @@ namespace Geomerty {
 		auto& registry = Geomerty::ServiceLocator::Get<Geomerty::Graph>().registry;
 		auto srf = registry[Outputs.back().index].Get<Geomerty::nurbs::RationalSurface>();
 		if (srf != nullptr) {
-			auto&& [pos_arr, index_arr] = Geomerty::nurbs::util::sample_nurbs_surface(*srf, 20);
-			Eigen::MatrixXd TV;
-			Eigen::MatrixXi TF;
-			Eigen::MatrixXd TC;
-			int num_faces = index_arr.size() / 3;
-			TV.resize(pos_arr.size(), 3);
-			TF.resize(num_faces, 3);
-			for (int i = 0; i < pos_arr.size(); i++) {
-				TV.row(i) << pos_arr[i][0], pos_arr[i][1], pos_arr[i][2];
-			}
-			for (int i = 0; i < num_faces; i++) {
-				TF.row(i) << index_arr[3 * i], index_arr[3 * i + 1], index_arr[3 * i + 2];
-			}
-			viewer.data(0).clear();
-			viewer.data(0).set_mesh(TV, TF);
-
-			Eigen::MatrixXd TP;
-			Eigen::MatrixXi TE;
-			int rows = srf->m_control_points.size();
-			int cols = srf->m_control_points[0].size();
-			TP.resize(rows * cols, 3);
-			TE.resize(rows * (cols - 1) + (rows - 1) * cols, 2);
-
-			for (int i = 0; i < rows; i++) {
-				for (int j = 0; j < cols; j++) {
-					TP.row(i * rows + j) << srf->m_control_points[i][j][0], srf->m_control_points[i][j][1], srf->m_control_points[i][j][2];
-				}
-			}
-			int index = 0;
-			for (int i = 0; i < rows; i++) {
-				for (int j = 0; j < cols - 1; j++) {
-					TE.row(index++) << i * rows + j, i* rows + j + 1;
-				}
-			}
-			for (int i = 0; i < rows - 1; i++) {
-				for (int j = 0; j < cols; j++) {
-					TE.row(index++) << (i + 1) * rows + j, i* rows + j;
+			Geomerty::nurbs::util::TessellationTolerance tolerance;
+			tolerance.chord = chord_tolerance;
+			auto cached = Geomerty::nurbs::util::TessellationCache::instance().tessellate(*srf, tolerance);
+			set_surface_mesh(viewer, *cached);
+			set_control_net(viewer, *srf);
+			edit_presented = false;
+		}
+	}
+	void NurbsSurface_Node::PresentEdit(Geomerty::Viewer& viewer)
+	{
+		auto& registry = Geomerty::ServiceLocator::Get<Geomerty::Graph>().registry;
+		auto srf = registry[Outputs.back().index].Get<Geomerty::nurbs::RationalSurface>();
+		if (srf == nullptr) {
+			return;
+		}
+		const auto& grid = edit_grid.grid();
+		if (!edit_presented) {
+			// Four samples per knot span, a dragged point then moves a few hundred vertices at most
+			int spans_u = std::max<int>(srf->m_control_points.rows() - srf->m_degree_u, 1);
+			int spans_v = std::max<int>(srf->m_control_points.cols() - srf->m_degree_v, 1);
+			edit_grid = Geomerty::nurbs::util::SurfaceGridTessellator(std::min(4 * spans_u, 256) + 1, std::min(4 * spans_v, 256) + 1);
+			edit_grid.update(*srf);
+			set_surface_mesh(viewer, grid);
+			edit_presented = true;
+		}
+		else {
+			// Only the vertices over the spans of the moved point are written, the buffers are uploaded once per frame
+			auto& data = viewer.data(0);
+			for (const auto& range : edit_grid.update(*srf)) {
+				for (size_t k = range.first; k < range.last; k++) {
+					data.V.row(k) << grid.positions[k][0], grid.positions[k][1], grid.positions[k][2];
+					data.V_normals.row(k) << grid.normals[k][0], grid.normals[k][1], grid.normals[k][2];
 				}
 			}
-			TC.resize(1, 3);
-			TC.row(0) << 0, 1, 1;
-			viewer.data(0).set_edges(TP, TE, TC);
-			TC.row(0) << 1, 1, 0;
-			viewer.data(0).set_points(TP, TC);
-			viewer.data(0).line_width = 2;
-			viewer.data(0).point_size = 10;
+			data.dirty |= Geomerty::MeshGL::DIRTY_POSITION | Geomerty::MeshGL::DIRTY_NORMAL;
 		}
+		set_control_net(viewer, *srf);
 	}
-}
\ No newline at end of file
+}
@@ -1,9 +1,14 @@
 #pragma once
 #include "core/nodes.h"
+#include "nurbs/nurbs_tessellate.h"
 namespace Geomerty {
 	class NurbsSurface_Node :public Node {
 	private:
 		std::string path;
+		float chord_tolerance = 0.05f;
+		// Grid updated in place while control points are dragged, shown instead of the adaptive mesh during the drag
+		nurbs::util::SurfaceGridTessellator edit_grid;
+		bool edit_presented = false;
 
 
 	public:
@@ -12,6 +17,7 @@ namespace Geomerty {
 		void Init(Graph* graph) override;
 		void Execute(ExetContex* ctx)override;
 		void Present(Geomerty::Viewer& viewer)override;
+		void PresentEdit(Geomerty::Viewer& viewer)override;
 	};
 
 }
@@ -4,6 +4,7 @@ namespace Geomerty {
 	class NurbsSurface_LoadNode :public Node {
 	private:
 		std::string path;
+		float chord_tolerance = 0.05f;
 	public:
 		NurbsSurface_LoadNode(int id, const char* name, ImColor color = ImColor(255, 255, 255)) :Node(id, name, color) {}
 		void InstallUi() override;
@@ -0,0 +1,61 @@
+#include "nodes/nurbssurface_present.h"
+namespace Geomerty {
+	void set_surface_mesh(Geomerty::Viewer& viewer, const nurbs::util::SurfaceTessellation& mesh)
+	{
+		Eigen::MatrixXd TV;
+		Eigen::MatrixXi TF;
+		Eigen::MatrixXd TN;
+		Eigen::MatrixXd TUV;
+		int num_faces = mesh.indices.size() / 3;
+		TV.resize(mesh.positions.size(), 3);
+		TN.resize(mesh.normals.size(), 3);
+		TUV.resize(mesh.uvs.size(), 2);
+		TF.resize(num_faces, 3);
+		for (size_t i = 0; i < mesh.positions.size(); i++) {
+			TV.row(i) << mesh.positions[i][0], mesh.positions[i][1], mesh.positions[i][2];
+			TN.row(i) << mesh.normals[i][0], mesh.normals[i][1], mesh.normals[i][2];
+			TUV.row(i) << mesh.uvs[i][0], mesh.uvs[i][1];
+		}
+		for (int i = 0; i < num_faces; i++) {
+			TF.row(i) << mesh.indices[3 * i], mesh.indices[3 * i + 1], mesh.indices[3 * i + 2];
+		}
+		viewer.data(0).clear();
+		viewer.data(0).set_mesh(TV, TF);
+		viewer.data(0).set_normals(TN);
+		viewer.data(0).set_uv(TUV);
+	}
+	void set_control_net(Geomerty::Viewer& viewer, const nurbs::RationalSurface& srf)
+	{
+		Eigen::MatrixXd TP;
+		Eigen::MatrixXi TE;
+		Eigen::MatrixXd TC;
+		int rows = srf.m_control_points.rows();
+		int cols = srf.m_control_points.cols();
+		TP.resize(rows * cols, 3);
+		TE.resize(rows * (cols - 1) + (rows - 1) * cols, 2);
+
+		for (int i = 0; i < rows; i++) {
+			for (int j = 0; j < cols; j++) {
+				TP.row(i * cols + j) << srf.m_control_points(i, j)[0], srf.m_control_points(i, j)[1], srf.m_control_points(i, j)[2];
+			}
+		}
+		int index = 0;
+		for (int i = 0; i < rows; i++) {
+			for (int j = 0; j < cols - 1; j++) {
+				TE.row(index++) << i * cols + j, i* cols + j + 1;
+			}
+		}
+		for (int i = 0; i < rows - 1; i++) {
+			for (int j = 0; j < cols; j++) {
+				TE.row(index++) << (i + 1) * cols + j, i* cols + j;
+			}
+		}
+		TC.resize(1, 3);
+		TC.row(0) << 0, 1, 1;
+		viewer.data(0).set_edges(TP, TE, TC);
+		TC.row(0) << 1, 1, 0;
+		viewer.data(0).set_points(TP, TC);
+		viewer.data(0).line_width = 2;
+		viewer.data(0).point_size = 10;
+	}
+}
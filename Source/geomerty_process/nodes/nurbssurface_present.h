@@ -0,0 +1,9 @@
+#pragma once
+#include "glviewer/Viewer.h"
+#include "nurbs/nurbs_evalute_surface.h"
+namespace Geomerty {
+	// Replace the mesh of the first viewer data by a surface tessellation, with its normals and uvs
+	void set_surface_mesh(Geomerty::Viewer& viewer, const nurbs::util::SurfaceTessellation& mesh);
+	// Draw the control net of a surface as points and edges on the first viewer data, point (i, j) is row i * cols + j
+	void set_control_net(Geomerty::Viewer& viewer, const nurbs::RationalSurface& srf);
+}
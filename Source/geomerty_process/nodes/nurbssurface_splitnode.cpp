@@ -4,7 +4,9 @@
 #include "UI/Panels/PanelsManager.h"
 #include "core/ServiceLocator.h"
 #include "nodes/nurbssurface_splitnode.h"
+#include "nodes/nurbssurface_present.h"
 #include "nurbs/nurbs_evalute_surface.h"
+#include "nurbs/nurbs_tessellation_cache.h"
 
 namespace Geomerty {
 	void NurbsSurface_SplitNode::InstallUi()
@@ -20,6 +22,10 @@ namespace Geomerty {
 				Present(input_manager.GetPanelAs<Geomerty::ControllerView>("Scene View").viewer);
 			}
 		}
+		if (ImGui::SliderFloat("chord_tolerance", &chord_tolerance, 0.001f, 1.0f)) {
+			auto& input_manager = Geomerty::ServiceLocator::Get<UI::Panels::PanelsManager>();
+			Present(input_manager.GetPanelAs<Geomerty::ControllerView>("Scene View").viewer);
+		}
 	}
 	void NurbsSurface_SplitNode::Init(Graph* graph)
 	{
@@ -52,65 +58,29 @@ namespace Geomerty {
 		auto srfleft = registry[Outputs[0].index].Get<Geomerty::nurbs::RationalSurface>();
 		auto srfright = registry[Outputs[1].index].Get<Geomerty::nurbs::RationalSurface>();
 		if (srfleft != nullptr && srfright != nullptr) {
-			auto&& [pos_arrleft, index_arrleft] = Geomerty::nurbs::util::sample_nurbs_surface(*srfleft, 20);
-			auto&& [pos_arrright, index_arrright] = Geomerty::nurbs::util::sample_nurbs_surface(*srfright, 20);
-			Eigen::MatrixXd TV;
-			Eigen::MatrixXi TF;
-			Eigen::MatrixXd TC;
-			Eigen::MatrixXd TFC;
-			int num_leftfaces = index_arrleft.size() / 3;
-			int num_rightfaces = index_arrright.size() / 3;
-			TV.resize(pos_arrleft.size() + pos_arrright.size(), 3);
-			TF.resize(num_leftfaces + num_rightfaces, 3);
-			TFC.resize(num_leftfaces + num_rightfaces, 3);
-			for (int i = 0; i < pos_arrleft.size(); i++) {
-				TV.row(i) << pos_arrleft[i][0], pos_arrleft[i][1], pos_arrleft[i][2];
-			}
-			for (int i = 0; i < pos_arrright.size(); i++) {
-				TV.row(i + pos_arrleft.size()) << pos_arrright[i][0], pos_arrright[i][1], pos_arrright[i][2];
-			}
-			for (int i = 0; i < num_leftfaces; i++) {
-				TF.row(i) << index_arrleft[3 * i], index_arrleft[3 * i + 1], index_arrleft[3 * i + 2];
-				TFC.row(i) << 1, 1, 0;
-			}
-			for (int i = 0; i < num_rightfaces; i++) {
-				TF.row(i + num_leftfaces) << pos_arrleft.size() + index_arrright[3 * i], pos_arrleft.size() + index_arrright[3 * i + 1], pos_arrleft.size() + index_arrright[3 * i + 2];
-				TFC.row(i + num_leftfaces) << 0, 1, 1;
+			Geomerty::nurbs::util::TessellationTolerance tolerance;
+			tolerance.chord = chord_tolerance;
+			auto& cache = Geomerty::nurbs::util::TessellationCache::instance();
+			auto cachedleft = cache.tessellate(*srfleft, tolerance);
+			auto cachedright = cache.tessellate(*srfright, tolerance);
+			const auto& left = *cachedleft;
+			const auto& right = *cachedright;
+			// Both halves as one mesh, the left one yellow and the right one cyan
+			Geomerty::nurbs::util::SurfaceTessellation mesh = left;
+			mesh.positions.insert(mesh.positions.end(), right.positions.begin(), right.positions.end());
+			mesh.normals.insert(mesh.normals.end(), right.normals.begin(), right.normals.end());
+			mesh.uvs.insert(mesh.uvs.end(), right.uvs.begin(), right.uvs.end());
+			for (size_t index : right.indices) {
+				mesh.indices.push_back(left.positions.size() + index);
 			}
-			viewer.data(0).clear();
-			viewer.data(0).set_mesh(TV, TF);
+			int num_leftfaces = left.indices.size() / 3;
+			int num_rightfaces = right.indices.size() / 3;
+			Eigen::MatrixXd TFC(num_leftfaces + num_rightfaces, 3);
+			TFC.topRows(num_leftfaces).rowwise() = Eigen::RowVector3d(1, 1, 0);
+			TFC.bottomRows(num_rightfaces).rowwise() = Eigen::RowVector3d(0, 1, 1);
+			set_surface_mesh(viewer, mesh);
 			viewer.data(0).set_colors(TFC);
-
-			Eigen::MatrixXd TP;
-			Eigen::MatrixXi TE;
-			int rows = srfleft->m_control_points.size();
-			int cols = srfleft->m_control_points[0].size();
-			TP.resize(rows * cols, 3);
-			TE.resize(rows * (cols - 1) + (rows - 1) * cols, 2);
-
-			for (int i = 0; i < rows; i++) {
-				for (int j = 0; j < cols; j++) {
-					TP.row(i * rows + j) << srfleft->m_control_points[i][j][0], srfleft->m_control_points[i][j][1], srfleft->m_control_points[i][j][2];
-				}
-			}
-			int index = 0;
-			for (int i = 0; i < rows; i++) {
-				for (int j = 0; j < cols - 1; j++) {
-					TE.row(index++) << i * rows + j, i* rows + j + 1;
-				}
-			}
-			for (int i = 0; i < rows - 1; i++) {
-				for (int j = 0; j < cols; j++) {
-					TE.row(index++) << (i + 1) * rows + j, i* rows + j;
-				}
-			}
-			TC.resize(1, 3);
-			TC.row(0) << 0, 1, 1;
-			viewer.data(0).set_edges(TP, TE, TC);
-			TC.row(0) << 1, 1, 0;
-			viewer.data(0).set_points(TP, TC);
-			viewer.data(0).line_width = 2;
-			viewer.data(0).point_size = 10;
+			set_control_net(viewer, *srfleft);
 		}
 	}
 }
\ No newline at end of file
@@ -5,6 +5,7 @@ namespace Geomerty {
 	private:
 		float u = 0.5f;
 		bool split_along_u = true;
+		float chord_tolerance = 0.05f;
 	public:
 		NurbsSurface_SplitNode(int id, const char* name, ImColor color = ImColor(255, 255, 255)) :Node(id, name, color) {
 		}
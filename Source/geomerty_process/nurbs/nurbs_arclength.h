@@ -0,0 +1,292 @@
+#pragma once
+#include <Eigen/Dense>
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <tuple>
+
+#include "nurbs_curve.h"
+#include "nurbs_evalute_curve.h"
+#include "nurbs_util.h"
+
+namespace Geomerty::nurbs::util
+{
+	inline constexpr int N_MAX_ARCLENGTH_DEPTH = 12;
+
+	namespace internal
+	{
+		// 5 point Gauss-Legendre rule on [-1, 1], exact for polynomials up to degree 9
+		inline constexpr std::array<scalar, 5> N_GAUSS_LEGENDRE_NODES = { -0.9061798459386640f, -0.5384693101056831f, 0.0f, 0.5384693101056831f, 0.9061798459386640f };
+		inline constexpr std::array<scalar, 5> N_GAUSS_LEGENDRE_WEIGHTS = { 0.2369268850561891f, 0.4786286704993665f, 0.5688888888888889f, 0.4786286704993665f, 0.2369268850561891f };
+
+		/*
+		 * Slopes dt/ds at both ends of an interval of length h covering dt of parameter, from the
+		 * speeds ds/dt there, limited to keep the cubic Hermite fit monotone (Fritsch & Carlson)
+		 */
+		inline void monotone_slopes(scalar h, scalar dt, scalar v0, scalar v1, scalar& m0, scalar& m1)
+		{
+			if (h <= 0.0f)
+			{
+				m0 = m1 = 0.0f;
+				return;
+			}
+			const scalar secant = dt / h;
+			scalar alpha = v0 > 0.0f ? 1.0f / (v0 * secant) : 3.0f;
+			scalar beta = v1 > 0.0f ? 1.0f / (v1 * secant) : 3.0f;
+			const scalar r = alpha * alpha + beta * beta;
+			if (r > 9.0f)
+			{
+				const scalar tau = 3.0f / std::sqrt(r);
+				alpha *= tau;
+				beta *= tau;
+			}
+			m0 = alpha * secant;
+			m1 = beta * secant;
+		}
+
+		/*
+		 * Cubic Hermite t(s) at x = (s - s0) / h in [0, 1]
+		 */
+		inline scalar hermite(scalar x, scalar h, scalar t0, scalar t1, scalar m0, scalar m1)
+		{
+			const scalar x2 = x * x;
+			const scalar x3 = x2 * x;
+			return (2.0f * x3 - 3.0f * x2 + 1.0f) * t0 + (x3 - 2.0f * x2 + x) * h * m0
+				+ (-2.0f * x3 + 3.0f * x2) * t1 + (x3 - x2) * h * m1;
+		}
+	}// namespace internal
+
+	/**
+	 * Arc length parameterization of a rational curve.
+	 * The speed |C'| is integrated with Gauss-Legendre quadrature on each Bezier segment, which is
+	 * bisected until the quadrature converges and the inverse fit below predicts the middle of the
+	 * piece, the cumulative length is stored at these breakpoints.
+	 * Length is inverted to parameter with a monotone cubic Hermite fit of t(s) on the breakpoint
+	 * interval, found through a uniform bucket table in O(1), followed by one Newton correction.
+	 * The table is read-only after construction and may be shared between threads.
+	 */
+	class ArcLengthTable
+	{
+	public:
+		ArcLengthTable() = default;
+		/**
+		 * @param[in] crv RationalCurve object
+		 * @param[in] tolerance Relative accuracy of the quadrature on each breakpoint interval
+		 */
+		explicit ArcLengthTable(const RationalCurve& crv, scalar tolerance = 1e-5f);
+
+		bool is_valid() const { return !m_intervals.empty(); }
+		scalar length() const { return m_intervals.empty() ? 0.0f : m_intervals.back().s1; }
+		const BezierSegments& segments() const { return m_segments; }
+
+		/**
+		 * Arc length from the start of the curve
+		 * @param[in] u Parameter on the curve, clamped to its domain.
+		 * @return Length of the curve between its start and u.
+		 */
+		scalar length_at(scalar u) const;
+		/**
+		 * Parameter at a given arc length
+		 * @param[in] s Arc length from the start of the curve, clamped to [0, length()].
+		 * @return Parameter u with length_at(u) == s.
+		 */
+		scalar param_at_length(scalar s) const;
+		/**
+		 * Sample the curve at equal arc length
+		 * @param[in] segments Number of equal length pieces
+		 * @return segments + 1 points and their curve parameters, from the start to the end of the curve.
+		 */
+		std::tuple<std::vector<vec3>, std::vector<scalar>> sample_by_arclength(int segments) const;
+
+	private:
+		/*
+		 * Part [t0, t1] of a Bezier segment, its lengths s0, s1 from the curve start and the limited
+		 * slopes dt/ds of the inverse at both ends
+		 */
+		struct Interval
+		{
+			int segment;
+			scalar t0, t1;
+			scalar s0, s1;
+			scalar m0, m1;
+		};
+
+		// Speed |dC/dt| in the local parameter of a Bezier segment
+		scalar speed(int segment, scalar t) const;
+		scalar integrate(int segment, scalar t0, scalar t1) const;
+		void subdivide(int segment, scalar t0, scalar t1, scalar whole, scalar v0, scalar v1, scalar tolerance, int depth);
+		scalar to_param(const Interval& interval, scalar t) const;
+
+		BezierSegments m_segments;
+		std::vector<Interval> m_intervals;
+		std::vector<int> m_buckets;
+		scalar m_bucket_scale = 0.0f;
+	};
+
+	inline ArcLengthTable::ArcLengthTable(const RationalCurve& crv, scalar tolerance)
+		: m_segments(decompose_curve(crv))
+	{
+		for (int s = 0; s < static_cast<int>(m_segments.size()); s++)
+		{
+			subdivide(s, 0.0f, 1.0f, integrate(s, 0.0f, 1.0f), speed(s, 0.0f), speed(s, 1.0f), tolerance, 0);
+		}
+		if (m_intervals.empty())
+		{
+			return;
+		}
+
+		// Cumulative lengths
+		scalar total = 0.0f;
+		for (auto& interval : m_intervals)
+		{
+			interval.s0 = total;
+			total += interval.s1;
+			interval.s1 = total;
+		}
+
+		// Bucket k holds the first interval reaching past k / m_bucket_scale
+		m_buckets.resize(m_intervals.size());
+		m_bucket_scale = total > 0.0f ? static_cast<scalar>(m_buckets.size()) / total : 0.0f;
+		int index = 0;
+		for (int k = 0; k < static_cast<int>(m_buckets.size()); k++)
+		{
+			const scalar s = k / std::max(m_bucket_scale, N_SCALAR_EPSILON);
+			while (index + 1 < static_cast<int>(m_intervals.size()) && m_intervals[index].s1 <= s)
+			{
+				index++;
+			}
+			m_buckets[k] = index;
+		}
+	}
+
+	inline scalar ArcLengthTable::speed(int segment, scalar t) const
+	{
+		std::array<vec3, 2> ders;
+		bezier_derivatives(m_segments.segment(segment), m_segments.degree, t, 1, ders.data());
+		return ders[1].norm();
+	}
+
+	inline scalar ArcLengthTable::integrate(int segment, scalar t0, scalar t1) const
+	{
+		const scalar half = 0.5f * (t1 - t0);
+		const scalar mid = 0.5f * (t1 + t0);
+		scalar sum = 0.0f;
+		for (size_t i = 0; i < internal::N_GAUSS_LEGENDRE_NODES.size(); i++)
+		{
+			sum += internal::N_GAUSS_LEGENDRE_WEIGHTS[i] * speed(segment, mid + half * internal::N_GAUSS_LEGENDRE_NODES[i]);
+		}
+		return sum * half;
+	}
+
+	inline void ArcLengthTable::subdivide(int segment, scalar t0, scalar t1, scalar whole, scalar v0, scalar v1, scalar tolerance, int depth)
+	{
+		const scalar mid = 0.5f * (t0 + t1);
+		const scalar vm = speed(segment, mid);
+		const scalar left = integrate(segment, t0, mid);
+		const scalar right = integrate(segment, mid, t1);
+		const scalar h = left + right;
+		Interval interval{ segment, t0, t1, 0.0f, h, 0.0f, 0.0f };
+		internal::monotone_slopes(h, t1 - t0, v0, v1, interval.m0, interval.m1);
+		// The Newton step squares the error of the fit, so it only needs the root of the tolerance
+		const bool converged = std::abs(h - whole) <= tolerance * h
+			&& (h <= 0.0f || std::abs(internal::hermite(left / h, h, t0, t1, interval.m0, interval.m1) - mid) <= std::sqrt(tolerance) * (t1 - t0));
+		if (converged || depth >= N_MAX_ARCLENGTH_DEPTH)
+		{
+			// s1 holds the length of the interval until the lengths are accumulated
+			m_intervals.push_back(interval);
+			return;
+		}
+		subdivide(segment, t0, mid, left, v0, vm, tolerance, depth + 1);
+		subdivide(segment, mid, t1, right, vm, v1, tolerance, depth + 1);
+	}
+
+	inline scalar ArcLengthTable::to_param(const Interval& interval, scalar t) const
+	{
+		const scalar a = m_segments.breaks[interval.segment];
+		const scalar b = m_segments.breaks[interval.segment + 1];
+		return a + (b - a) * t;
+	}
+
+	inline scalar ArcLengthTable::length_at(scalar u) const
+	{
+		if (m_intervals.empty())
+		{
+			return 0.0f;
+		}
+		const auto& breaks = m_segments.breaks;
+		u = std::clamp(u, breaks.front(), breaks.back());
+		const int segment = std::clamp(static_cast<int>(std::upper_bound(breaks.begin(), breaks.end(), u) - breaks.begin()) - 1, 0, static_cast<int>(m_segments.size()) - 1);
+		const scalar t = (u - breaks[segment]) / (breaks[segment + 1] - breaks[segment]);
+		auto it = std::upper_bound(m_intervals.begin(), m_intervals.end(), std::make_pair(segment, t),
+			[](const std::pair<int, scalar>& key, const Interval& interval) { return key.first < interval.segment || (key.first == interval.segment && key.second < interval.t1); });
+		const Interval& interval = it == m_intervals.end() ? m_intervals.back() : *it;
+		return interval.s0 + integrate(segment, interval.t0, std::min(t, interval.t1));
+	}
+
+	inline scalar ArcLengthTable::param_at_length(scalar s) const
+	{
+		if (m_intervals.empty())
+		{
+			return 0.0f;
+		}
+		s = std::clamp(s, 0.0f, length());
+		const int bucket = std::min(static_cast<int>(s * m_bucket_scale), static_cast<int>(m_buckets.size()) - 1);
+		int index = m_buckets[bucket];
+		while (index + 1 < static_cast<int>(m_intervals.size()) && m_intervals[index].s1 < s)
+		{
+			index++;
+		}
+		const Interval& interval = m_intervals[index];
+		const scalar h = interval.s1 - interval.s0;
+		if (h <= 0.0f)
+		{
+			return to_param(interval, interval.t0);
+		}
+
+		// Monotone cubic Hermite guess of t(s)
+		scalar t = internal::hermite((s - interval.s0) / h, h, interval.t0, interval.t1, interval.m0, interval.m1);
+		t = std::clamp(t, interval.t0, interval.t1);
+
+		// One Newton step on s(t) - s = 0
+		const scalar v = speed(interval.segment, t);
+		if (v > 0.0f)
+		{
+			const scalar error = interval.s0 + integrate(interval.segment, interval.t0, t) - s;
+			t = std::clamp(t - error / v, interval.t0, interval.t1);
+		}
+		return to_param(interval, t);
+	}
+
+	inline std::tuple<std::vector<vec3>, std::vector<scalar>> ArcLengthTable::sample_by_arclength(int segments) const
+	{
+		std::vector<vec3> points;
+		std::vector<scalar> params;
+		if (m_intervals.empty() || segments < 1)
+		{
+			return std::make_tuple(std::move(points), std::move(params));
+		}
+		points.reserve(segments + 1);
+		params.reserve(segments + 1);
+		const auto& breaks = m_segments.breaks;
+		for (int k = 0; k <= segments; k++)
+		{
+			const scalar u = param_at_length(length() * static_cast<scalar>(k) / static_cast<scalar>(segments));
+			const int segment = std::clamp(static_cast<int>(std::upper_bound(breaks.begin(), breaks.end(), u) - breaks.begin()) - 1, 0, static_cast<int>(m_segments.size()) - 1);
+			const scalar t = (u - breaks[segment]) / (breaks[segment + 1] - breaks[segment]);
+			points.push_back(homogenous_to_cartesian(bezier_point(m_segments.segment(segment), m_segments.degree, t)));
+			params.push_back(u);
+		}
+		return std::make_tuple(std::move(points), std::move(params));
+	}
+
+	/**
+	 * Sample a rational curve at equal arc length, see ArcLengthTable
+	 * @param[in] crv RationalCurve object
+	 * @param[in] segments Number of equal length pieces
+	 * @return segments + 1 points and their curve parameters, empty if the curve is invalid.
+	 */
+	inline std::tuple<std::vector<vec3>, std::vector<scalar>> sample_by_arclength(const RationalCurve& crv, int segments)
+	{
+		return ArcLengthTable(crv).sample_by_arclength(segments);
+	}
+}
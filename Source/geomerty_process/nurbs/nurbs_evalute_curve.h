@@ -1,9 +1,15 @@
 #pragma once
 #include <Eigen/Dense>
 #include <Eigen/Sparse>
+#include <algorithm>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <span>
 
 #include "nurbs_curve.h"
 #include "nurbs_util.h"
+#include "glviewer/parallel_for.h"
 
 namespace Geomerty::nurbs::util
 {
@@ -17,6 +23,10 @@ namespace Geomerty::nurbs::util
 	 */
 	inline bool curve_is_valid(const size_t degree, const std::vector<scalar>& knots, const std::vector<vec3>& control_points, const std::vector<scalar>& weights)
 	{
+		if (degree > N_MAX_DEGREE)
+		{
+			return false;
+		}
 		if (!is_valid_relation(degree, knots.size(), control_points.size()))
 		{
 			return false;
@@ -52,8 +62,8 @@ namespace Geomerty::nurbs::util
 
 		// Find span and corresponding non-zero basis functions
 		int span = find_span(degree, knots, u);
-		std::vector<scalar> n = bspline_basis(degree, span, knots, u);
-		assert(!n.empty());
+		BasisArray n;
+		bspline_basis(degree, span, knots, u, n);
 
 		// Compute point
 		for (int j = 0; j < degree + 1; j++)
@@ -63,41 +73,19 @@ namespace Geomerty::nurbs::util
 		return point;
 
 	}
-	inline vec3 curve_point(const RationalCurve& crv, scalar u)
-	{
-		if (!curve_is_valid(crv))
-		{
-			return vec3::Zero();
-		}
-		// Compute homogenous coordinates of control points
-		std::vector<vec4> cw;
-		cw.reserve(crv.m_control_points.size());
-		for (int i = 0; i < crv.m_control_points.size(); i++)
-		{
-			cw.emplace_back(cartesian_to_homogenous(crv.m_control_points[i], crv.m_weights[i]));
-		}
-		// Compute point using homogenous coordinates
-		vec4 point_w = curve_point<vec4>(crv.m_degree, crv.m_knots, cw, u);
-		// Convert back to cartesian coordinates
-		return homogenous_to_cartesian(point_w);
-	}
 	/**
-	 * Evaluate derivatives of a non-rational NURBS curve
+	 * Evaluate derivatives of a non-rational NURBS curve without allocating
 	 * @param[in] degree Degree of the curve
 	 * @param[in] knots Knot vector of the curve.
 	 * @param[in] control_points Control points of the curve.
 	 * @param[in] num_ders Number of times to derivate.
 	 * @param[in] u Parameter to evaluate the derivatives at.
-	 * @return curve_ders Derivatives of the curve at u.
-	 * E.g. curve_ders[n] is the nth derivative at u, where 0 <= n <= num_ders.
+	 * @param[out] curve_ders curve_ders[n] is the nth derivative at u, where 0 <= n <= num_ders.
 	 */
 	template<typename T>
-	inline std::vector<T> curve_derivatives(const size_t degree, const std::vector<scalar>& knots, const std::vector<T>& control_points, int num_ders, scalar u)
+	inline void curve_derivatives(const size_t degree, const std::vector<scalar>& knots, const std::vector<T>& control_points, int num_ders, scalar u,
+		std::span<T> curve_ders)
 	{
-
-		std::vector<T> curve_ders;
-		curve_ders.resize(num_ders + 1);
-
 		// Assign higher order derivatives to zero
 		for (int k = degree + 1; k < num_ders + 1; k++)
 		{
@@ -105,11 +93,13 @@ namespace Geomerty::nurbs::util
 		}
 
 		// Find the span and corresponding non-zero basis functions & derivatives
+		// Derivatives above the degree vanish, so only du basis derivatives are needed
+		int du = num_ders < static_cast<int>(degree) ? num_ders : static_cast<int>(degree);
 		int span = find_span(degree, knots, u);
-		std::vector<std::vector<scalar>> ders = bspline_der_basis(degree, span, knots, u, num_ders);
+		BasisDerTable ders;
+		bspline_der_basis(degree, span, knots, u, du, ders);
 
 		// Compute first num_ders derivatives
-		int du = num_ders < static_cast<int>(degree) ? num_ders : static_cast<int>(degree);
 		for (int k = 0; k < du + 1; k++)
 		{
 			curve_ders[k] = T::Zero();
@@ -118,85 +108,543 @@ namespace Geomerty::nurbs::util
 				curve_ders[k] += ders[k][j] * control_points[span - degree + j];
 			}
 		}
-		return curve_ders;
-
-
 	}
+
 	/**
 	 * Evaluate derivatives of a non-rational NURBS curve
-	 * @param[in] crv Curve object
+	 * @param[in] degree Degree of the curve
+	 * @param[in] knots Knot vector of the curve.
+	 * @param[in] control_points Control points of the curve.
 	 * @param[in] num_ders Number of times to derivate.
 	 * @param[in] u Parameter to evaluate the derivatives at.
 	 * @return curve_ders Derivatives of the curve at u.
 	 * E.g. curve_ders[n] is the nth derivative at u, where 0 <= n <= num_ders.
 	 */
+	template<typename T>
+	inline std::vector<T> curve_derivatives(const size_t degree, const std::vector<scalar>& knots, const std::vector<T>& control_points, int num_ders, scalar u)
+	{
+		std::vector<T> curve_ders(num_ders + 1);
+		curve_derivatives(degree, knots, control_points, num_ders, u, std::span<T>(curve_ders));
+		return curve_ders;
+	}
+
+	inline constexpr scalar N_BOUNDS_RELATIVE_TOLERANCE = 1e-4f;
+	inline constexpr int N_MAX_BOUNDS_DEPTH = 16;
+
+	namespace internal
+	{
+		/*
+		 * Lazily computed bounding box shared by the copies of an evaluator
+		 */
+		struct BoundsCache
+		{
+			std::once_flag once;
+			AABB3 box;
+		};
+	}// namespace internal
+
+	/**
+	 * Precompiled evaluator of a rational B-spline curve.
+	 * The validation result, the classified knot vector and the homogenous control points
+	 * are built once at construction, so any number of queries on the same curve reuse them.
+	 * @tparam Real Scalar type of the evaluation. CurveEvaluator runs in float and batches parameters
+	 * in SIMD lanes for tessellation and display, BasicCurveEvaluator<double> serves the solvers.
+	 */
+	template<typename Real>
+	class BasicCurveEvaluator
+	{
+	public:
+		using Vec3 = vec3_t<Real>;
+		using Vec4 = vec4_t<Real>;
+
+		BasicCurveEvaluator() = default;
+		explicit BasicCurveEvaluator(const RationalCurve& crv);
+		/**
+		 * Same evaluator in another scalar type. The knots and the homogenous control points are
+		 * converted, the curve is not validated again.
+		 */
+		template<typename Other>
+		explicit BasicCurveEvaluator(const BasicCurveEvaluator<Other>& other);
+
+		bool is_valid() const { return m_valid; }
+		size_t degree() const { return m_degree; }
+		const std::vector<Real>& knots() const { return m_basis.knots(); }
+		const std::vector<Vec4>& homogenous_points() const { return m_cw; }
+		Real u_min() const { return m_basis.knots().front(); }
+		Real u_max() const { return m_basis.knots().back(); }
+
+		/**
+		 * Evaluate point on the curve
+		 * @param[in] u Parameter to evaluate the curve at.
+		 * @return Point on the curve at u, zero if the curve is invalid.
+		 */
+		Vec3 point(Real u) const;
+		/**
+		 * Evaluate derivatives of the curve
+		 * @param[in] num_ders Number of times to derivate.
+		 * @param[in] u Parameter to evaluate the derivatives at.
+		 * @return ders[n] is the nth derivative at u, where 0 <= n <= num_ders.
+		 */
+		std::vector<Vec3> derivatives(int num_ders, Real u) const;
+		/**
+		 * Evaluate derivatives of the curve without allocating
+		 * @param[in] num_ders Number of times to derivate.
+		 * @param[in] u Parameter to evaluate the derivatives at.
+		 * @param[out] ders ders[n] is the nth derivative at u, ders.size() > num_ders.
+		 */
+		void derivatives(int num_ders, Real u, std::span<Vec3> ders) const;
+		/**
+		 * Evaluate the unit tangent of the curve
+		 * @param[in] u Parameter to evaluate the tangent at.
+		 */
+		Vec3 tangent(Real u) const;
+		/**
+		 * Evaluate points on the curve for a batch of parameters
+		 * @param[in] params Parameters to evaluate the curve at.
+		 * @return points[i] is the point at params[i].
+		 */
+		std::vector<Vec3> evaluate(const std::vector<Real>& params) const;
+		/**
+		 * Conservative bounding box of the curve, within N_BOUNDS_RELATIVE_TOLERANCE of the exact one.
+		 * Computed on the first call and shared by all copies of the evaluator.
+		 * @return Bounding box, empty if the curve is invalid.
+		 */
+		const AABB3& bounds() const;
+		/**
+		 * Evaluate points on the curve for a batch of parameters without allocating.
+		 * Ascending parameters walk the knot spans incrementally instead of searching
+		 * each one, and N_EVALUATE_LANES parameters share the basis recurrence.
+		 * @param[in] params Parameters to evaluate the curve at, preferably ascending.
+		 * @param[out] out out[i] is the point at params[i], out.size() >= params.size().
+		 */
+		void evaluate_many(std::span<const Real> params, std::span<Vec3> out) const;
+		/**
+		 * Evaluate derivatives of the curve for a batch of parameters
+		 * @param[in] params Parameters to evaluate the derivatives at, preferably ascending.
+		 * @param[in] num_ders Number of times to derivate.
+		 * @param[out] out out[i * (num_ders + 1) + n] is the nth derivative at params[i].
+		 */
+		void evaluate_many_derivatives(std::span<const Real> params, int num_ders, std::span<Vec3> out) const;
+
+	private:
+		template<typename Other> friend class BasicCurveEvaluator;
+		void span_derivatives(int span, int num_ders, Real u, Vec3* curve_ders) const;
+
+		bool m_valid = false;
+		size_t m_degree = 0;
+		BasicKnotBasis<Real> m_basis;
+		std::vector<Vec4> m_cw;
+		std::shared_ptr<internal::BoundsCache> m_bounds;
+	};
+	using CurveEvaluator = BasicCurveEvaluator<scalar>;
 
-	inline std::vector<vec3> curve_derivatives(const RationalCurve& crv, int num_ders, scalar u)
+	template<typename Real>
+	inline BasicCurveEvaluator<Real>::BasicCurveEvaluator(const RationalCurve& crv)
+		: m_valid(curve_is_valid(crv)), m_degree(crv.m_degree)
 	{
-		if (!curve_is_valid(crv))
+		if (!m_valid)
 		{
-			return std::vector<vec3>{};
+			return;
 		}
-		std::vector<vec3> curve_ders;
-		curve_ders.reserve(num_ders + 1);
-
+		m_basis = BasicKnotBasis<Real>(crv.m_degree, std::vector<Real>(crv.m_knots.begin(), crv.m_knots.end()));
+		m_bounds = std::make_shared<internal::BoundsCache>();
 		// Compute homogenous coordinates of control points
-		std::vector<vec4> cw;
-		cw.reserve(crv.m_control_points.size());
-		for (int i = 0; i < crv.m_control_points.size(); i++)
+		m_cw.resize(crv.m_control_points.size());
+		for (size_t i = 0; i < crv.m_control_points.size(); i++)
 		{
-			cartesian_to_homogenous(crv.m_control_points[i], crv.m_weights[i]);
-			cw.emplace_back(cartesian_to_homogenous(crv.m_control_points[i], crv.m_weights[i]));
+			const Real w = static_cast<Real>(crv.m_weights[i]);
+			m_cw[i] << crv.m_control_points[i].template cast<Real>() * w, w;
 		}
+	}
 
-		// Derivatives of Cw
-		std::vector<vec4> cw_ders = curve_derivatives<vec4>(crv.m_degree, crv.m_knots, cw, num_ders, u);
+	template<typename Real>
+	template<typename Other>
+	inline BasicCurveEvaluator<Real>::BasicCurveEvaluator(const BasicCurveEvaluator<Other>& other)
+		: m_valid(other.m_valid), m_degree(other.m_degree), m_basis(other.m_basis)
+	{
+		if (!m_valid)
+		{
+			return;
+		}
+		m_bounds = std::make_shared<internal::BoundsCache>();
+		m_cw.resize(other.m_cw.size());
+		for (size_t i = 0; i < m_cw.size(); i++)
+		{
+			m_cw[i] = other.m_cw[i].template cast<Real>();
+		}
+	}
 
-		// Split Cwders into coordinates and weights
-		std::vector<vec3> a_ders;
-		std::vector<scalar> w_ders;
-		a_ders.reserve(cw_ders.size());
-		w_ders.reserve(w_ders.size());
-		for (const auto& val : cw_ders)
+	template<typename Real>
+	inline vec3_t<Real> BasicCurveEvaluator<Real>::point(Real u) const
+	{
+		if (!m_valid)
+		{
+			return Vec3::Zero();
+		}
+		int span = m_basis.span(u);
+		BasisArrayT<Real> n;
+		m_basis.basis(span, u, n);
+		// Compute point using homogenous coordinates and convert back to cartesian coordinates
+		Vec4 point = Vec4::Zero();
+		for (int j = 0; j < static_cast<int>(m_degree) + 1; j++)
 		{
+			point += n[j] * m_cw[span - m_degree + j];
+		}
+		return homogenous_to_cartesian(point);
+	}
 
-			a_ders.emplace_back(val.head<3>());
-			w_ders.emplace_back(val.w());
+	template<typename Real>
+	inline void BasicCurveEvaluator<Real>::span_derivatives(int span, int num_ders, Real u, Vec3* curve_ders) const
+	{
+		// Derivatives of Cw, those above the degree vanish
+		int du = std::min(num_ders, static_cast<int>(m_degree));
+		BasisDerTableT<Real> ders;
+		m_basis.der_basis(span, u, du, ders);
+		std::array<Vec4, N_MAX_DEGREE + 1> cw_ders;
+		for (int k = 0; k < du + 1; k++)
+		{
+			cw_ders[k] = Vec4::Zero();
+			for (int j = 0; j < static_cast<int>(m_degree) + 1; j++)
+			{
+				cw_ders[k] += ders[k][j] * m_cw[span - m_degree + j];
+			}
 		}
 
 		// Compute rational derivatives
 		for (int k = 0; k < num_ders + 1; k++)
 		{
-			vec3 v = a_ders[k];
-			for (int i = 1; i < k + 1; i++)
+			Vec3 v = k <= du ? Vec3(cw_ders[k].template head<3>()) : Vec3::Zero();
+			for (int i = 1; i < std::min(k, du) + 1; i++)
 			{
-				v -= binomial(k, i) * w_ders[i] * curve_ders[k - i];
+				v -= static_cast<Real>(binomial(k, i)) * cw_ders[i].w() * curve_ders[k - i];
 			}
-			curve_ders.emplace_back(v / w_ders[0]);
+			curve_ders[k] = v / cw_ders[0].w();
+		}
+	}
+
+	template<typename Real>
+	inline std::vector<vec3_t<Real>> BasicCurveEvaluator<Real>::derivatives(int num_ders, Real u) const
+	{
+		if (!m_valid)
+		{
+			return std::vector<Vec3>{};
 		}
+		std::vector<Vec3> curve_ders(num_ders + 1);
+		span_derivatives(m_basis.span(u), num_ders, u, curve_ders.data());
 		return curve_ders;
 	}
 
+	template<typename Real>
+	inline void BasicCurveEvaluator<Real>::derivatives(int num_ders, Real u, std::span<Vec3> ders) const
+	{
+		if (!m_valid)
+		{
+			std::fill_n(ders.begin(), num_ders + 1, Vec3::Zero());
+			return;
+		}
+		span_derivatives(m_basis.span(u), num_ders, u, ders.data());
+	}
+
+	template<typename Real>
+	inline vec3_t<Real> BasicCurveEvaluator<Real>::tangent(Real u) const
+	{
+		if (!m_valid)
+		{
+			return Vec3::Zero();
+		}
+		std::array<Vec3, 2> ders;
+		span_derivatives(m_basis.span(u), 1, u, ders.data());
+		Vec3 du = ders[1];
+		Real du_len = du.norm();
+		if (!(std::abs(du_len) < N_SCALAR_EPSILON))
+		{
+			du /= du_len;
+		}
+		return du;
+	}
+
+	template<typename Real>
+	inline std::vector<vec3_t<Real>> BasicCurveEvaluator<Real>::evaluate(const std::vector<Real>& params) const
+	{
+		std::vector<Vec3> points(params.size());
+		evaluate_many(params, points);
+		return points;
+	}
+
+	template<typename Real>
+	inline void BasicCurveEvaluator<Real>::evaluate_many(std::span<const Real> params, std::span<Vec3> out) const
+	{
+		assert(out.size() >= params.size());
+		if (!m_valid || m_degree < 1 || m_degree > N_MAX_DEGREE)
+		{
+			std::fill_n(out.begin(), params.size(), Vec3::Zero());
+			return;
+		}
+		if (params.empty())
+		{
+			return;
+		}
+
+		using Lanes = LaneArray<N_EVALUATE_LANES, Real>;
+		const int p = static_cast<int>(m_degree);
+		const int last_span = static_cast<int>(m_cw.size()) - 1;
+		const bool ascending = std::is_sorted(params.begin(), params.end());
+		const std::vector<Real>& knots = m_basis.knots();
+		int span = m_basis.span(params.front());
+
+		std::array<int, N_EVALUATE_LANES> spans;
+		std::array<Lanes, N_MAX_DEGREE + 1> N;
+		Lanes u;
+		for (size_t first = 0; first < params.size(); first += N_EVALUATE_LANES)
+		{
+			const size_t count = std::min<size_t>(N_EVALUATE_LANES, params.size() - first);
+			for (int l = 0; l < N_EVALUATE_LANES; l++)
+			{
+				// The last batch is padded by repeating its final parameter
+				u[l] = params[first + std::min<size_t>(l, count - 1)];
+				if (ascending)
+				{
+					while (span < last_span && u[l] >= knots[span + 1])
+					{
+						span++;
+					}
+					spans[l] = span;
+				}
+				else
+				{
+					spans[l] = m_basis.span(u[l]);
+				}
+			}
+			m_basis.template basis_lanes<N_EVALUATE_LANES>(spans, u, N);
+
+			// Accumulate homogenous coordinates lane by lane
+			Lanes x = Lanes::Zero(), y = Lanes::Zero(), z = Lanes::Zero(), w = Lanes::Zero();
+			Lanes cx, cy, cz, cw;
+			for (int j = 0; j < p + 1; j++)
+			{
+				for (int l = 0; l < N_EVALUATE_LANES; l++)
+				{
+					const Vec4& pw = m_cw[spans[l] - p + j];
+					cx[l] = pw.x();
+					cy[l] = pw.y();
+					cz[l] = pw.z();
+					cw[l] = pw.w();
+				}
+				x += N[j] * cx;
+				y += N[j] * cy;
+				z += N[j] * cz;
+				w += N[j] * cw;
+			}
+			x /= w;
+			y /= w;
+			z /= w;
+			for (size_t l = 0; l < count; l++)
+			{
+				out[first + l] = Vec3(x[l], y[l], z[l]);
+			}
+		}
+	}
+
+	template<typename Real>
+	inline void BasicCurveEvaluator<Real>::evaluate_many_derivatives(std::span<const Real> params, int num_ders, std::span<Vec3> out) const
+	{
+		const size_t stride = num_ders + 1;
+		assert(out.size() >= params.size() * stride);
+		if (!m_valid)
+		{
+			std::fill_n(out.begin(), params.size() * stride, Vec3::Zero());
+			return;
+		}
+		if (params.empty())
+		{
+			return;
+		}
+
+		const int last_span = static_cast<int>(m_cw.size()) - 1;
+		const bool ascending = std::is_sorted(params.begin(), params.end());
+		const std::vector<Real>& knots = m_basis.knots();
+		int span = m_basis.span(params.front());
+		for (size_t i = 0; i < params.size(); i++)
+		{
+			if (ascending)
+			{
+				while (span < last_span && params[i] >= knots[span + 1])
+				{
+					span++;
+				}
+			}
+			else
+			{
+				span = m_basis.span(params[i]);
+			}
+			span_derivatives(span, num_ders, params[i], &out[i * stride]);
+		}
+	}
+
+	/**
+	 * Evaluate point on a rational NURBS curve
+	 * @param[in] crv RationalCurve object
+	 * @param[in] u Parameter to evaluate the curve at.
+	 * @return point result point on the curve at parameter u.
+	 */
+	inline vec3 curve_point(const RationalCurve& crv, scalar u) { return CurveEvaluator(crv).point(u); }
+
+	/**
+	 * Evaluate derivatives of a rational NURBS curve
+	 * @param[in] crv Curve object
+	 * @param[in] num_ders Number of times to derivate.
+	 * @param[in] u Parameter to evaluate the derivatives at.
+	 * @return curve_ders Derivatives of the curve at u.
+	 * E.g. curve_ders[n] is the nth derivative at u, where 0 <= n <= num_ders.
+	 */
+	inline std::vector<vec3> curve_derivatives(const RationalCurve& crv, int num_ders, scalar u) { return CurveEvaluator(crv).derivatives(num_ders, u); }
+
 	/**
 	 * Evaluate the tangent of a rational B-spline curve
 	 * @param[in] crv RationalCurve object
 	 * @return Unit tangent of the curve at u.
 	 */
-	inline vec3 curve_tangent(const RationalCurve& crv, scalar u)
+	inline vec3 curve_tangent(const RationalCurve& crv, scalar u) { return CurveEvaluator(crv).tangent(u); }
+
+	/**
+	 * Evaluate points on a rational NURBS curve for a batch of parameters
+	 * @param[in] crv RationalCurve object
+	 * @param[in] params Parameters to evaluate the curve at, preferably ascending.
+	 * @param[out] out out[i] is the point at params[i], out.size() >= params.size().
+	 */
+	inline void evaluate_many(const RationalCurve& crv, std::span<const scalar> params, std::span<vec3> out) { CurveEvaluator(crv).evaluate_many(params, out); }
+	inline void evaluate_many(const CurveEvaluator& evaluator, std::span<const scalar> params, std::span<vec3> out) { evaluator.evaluate_many(params, out); }
+
+	/**
+	 * Evaluate derivatives of a rational NURBS curve for a batch of parameters
+	 * @param[in] crv RationalCurve object
+	 * @param[in] params Parameters to evaluate the derivatives at, preferably ascending.
+	 * @param[in] num_ders Number of times to derivate.
+	 * @param[out] out out[i * (num_ders + 1) + n] is the nth derivative at params[i].
+	 */
+	inline void evaluate_many_derivatives(const RationalCurve& crv, std::span<const scalar> params, int num_ders, std::span<vec3> out)
 	{
-		if (!curve_is_valid(crv))
+		CurveEvaluator(crv).evaluate_many_derivatives(params, num_ders, out);
+	}
+	inline void evaluate_many_derivatives(const CurveEvaluator& evaluator, std::span<const scalar> params, int num_ders, std::span<vec3> out)
+	{
+		evaluator.evaluate_many_derivatives(params, num_ders, out);
+	}
+	namespace internal
+	{
+		/*
+		 * Coefficients of inserting u r times (Piegl & Tiller A5.1), span is the knot span of u and s
+		 * its multiplicity. Insertion j blends the affected points i and i + 1 with alpha[i][j].
+		 */
+		using InsertAlphas = std::array<std::array<scalar, N_MAX_DEGREE + 1>, N_MAX_DEGREE + 1>;
+		inline void knot_insert_alphas(size_t deg, const std::vector<scalar>& knots, scalar u, int span, size_t s, size_t r, InsertAlphas& alpha)
+		{
+			const int p = static_cast<int>(deg);
+			for (int j = 1; j <= static_cast<int>(r); j++)
+			{
+				int L = span - p + j;
+				for (int i = 0; i < p - j - static_cast<int>(s) + 1; i++)
+				{
+					alpha[i][j] = (u - knots[L + i]) / (knots[i + span + 1] - knots[L + i]);
+				}
+			}
+		}
+
+		/*
+		 * Knot vector after inserting u r times after knots[span]
+		 */
+		inline void knot_insert_knots(const std::vector<scalar>& knots, scalar u, int span, size_t r, scalar* new_knots)
 		{
-			return vec3::Zero();
+			std::copy(knots.begin(), knots.begin() + span + 1, new_knots);
+			std::fill_n(new_knots + span + 1, r, u);
+			std::copy(knots.begin() + span + 1, knots.end(), new_knots + span + 1 + r);
 		}
-		std::vector<vec3> ders = curve_derivatives(crv, 1, u);
-		vec3 du = ders[1];
-		scalar du_len = du.norm();
-		if (!close(du_len, 0.0f))
+
+		/*
+		 * Insert the knot into one control polygon of count points, point i is read from cp[i * stride]
+		 * and written to new_cp[i * new_stride]
+		 */
+		template<typename T>
+		inline void knot_insert_polygon(size_t deg, int span, size_t s, size_t r, const InsertAlphas& alpha, const T* cp, size_t count, size_t stride,
+			T* new_cp, size_t new_stride)
 		{
-			du /= du_len;
+			const int p = static_cast<int>(deg);
+			const int k = span;
+			const int ns = static_cast<int>(s);
+			const int nr = static_cast<int>(r);
+			// Copy unaffected control points
+			for (int i = 0; i < k - p + 1; i++)
+			{
+				new_cp[i * new_stride] = cp[i * stride];
+			}
+			for (int i = k - ns; i < static_cast<int>(count); i++)
+			{
+				new_cp[(i + nr) * new_stride] = cp[i * stride];
+			}
+			// Copy affected control points
+			std::array<T, N_MAX_DEGREE + 1> tmp;
+			for (int i = 0; i < p - ns + 1; i++)
+			{
+				tmp[i] = cp[(k - p + i) * stride];
+			}
+			// Modify affected control points
+			for (int j = 1; j < nr + 1; j++)
+			{
+				int L = k - p + j;
+				for (int i = 0; i < p - j - ns + 1; i++)
+				{
+					scalar a = alpha[i][j];
+					tmp[i] = (1 - a) * tmp[i] + a * tmp[i + 1];
+				}
+				new_cp[L * new_stride] = tmp[0];
+				new_cp[(k + nr - j - ns) * new_stride] = tmp[p - j - ns];
+			}
+			int L = k - p + nr;
+			for (int i = L + 1; i < k - ns; i++)
+			{
+				new_cp[i * new_stride] = tmp[i - L];
+			}
 		}
-		return du;
+	}// namespace internal
+
+	/**
+	 * Number of times knot insertion actually inserts u, a knot never gets more copies than the degree
+	 * @param[in] deg Degree of the curve
+	 * @param[in] knots Knot vector of the curve
+	 * @param[in] u Parameter to insert knot(s) at
+	 * @param[in] r Number of times requested
+	 */
+	inline size_t knot_insert_count(size_t deg, const std::vector<scalar>& knots, scalar u, size_t r)
+	{
+		const size_t s = knot_multiplicity(knots, u);
+		return s >= deg ? 0 : std::min(r, deg - s);
+	}
+
+	/**
+	 * Insert knots in the curve without allocating
+	 * @param[in] deg Degree of the curve
+	 * @param[in] knots Knot vector of the curve
+	 * @param[in] cp Control points of the curve
+	 * @param[in] u Parameter to insert knot(s) at
+	 * @param[in] r Number of times to insert knot
+	 * @param[out] new_knots Updated knot vector, knots.size() + knot_insert_count(deg, knots, u, r) entries.
+	 * @param[out] new_cp Updated control points, cp.size() + knot_insert_count(deg, knots, u, r) entries.
+	 * @return Number of knots inserted
+	 */
+	template<typename T>
+	inline size_t curve_knot_insert(size_t deg, const std::vector<scalar>& knots, std::span<const T> cp, scalar u, size_t r, std::span<scalar> new_knots,
+		std::span<T> new_cp)
+	{
+		const int span = find_span(deg, knots, u);
+		const size_t s = knot_multiplicity(knots, u);
+		r = knot_insert_count(deg, knots, u, r);
+		internal::InsertAlphas alpha;
+		internal::knot_insert_alphas(deg, knots, u, span, s, r, alpha);
+		internal::knot_insert_knots(knots, u, span, r, new_knots.data());
+		internal::knot_insert_polygon(deg, span, s, r, alpha, cp.data(), cp.size(), 1, new_cp.data(), 1);
+		return r;
 	}
+
 	/**
 	 * Insert knots in the curve
 	 * @param[in] deg Degree of the curve
@@ -211,372 +659,1489 @@ namespace Geomerty::nurbs::util
 	inline void curve_knot_insert(size_t deg, const std::vector<scalar>& knots, const std::vector<T>& cp, scalar u, size_t r, std::vector<scalar>& new_knots,
 		std::vector<T>& new_cp)
 	{
-		int k = find_span(deg, knots, u);
-		size_t s = knot_multiplicity(knots, u);
-		if (s > deg)
-		{
-			return;
-		}
-		if (s == deg)
+		if (knot_multiplicity(knots, u) > deg)
 		{
-			new_knots = knots;
-			new_cp = cp;
 			return;
 		}
-		if ((r + s) > deg)
+		r = knot_insert_count(deg, knots, u, r);
+		new_knots.resize(knots.size() + r);
+		new_cp.resize(cp.size() + r);
+		curve_knot_insert(deg, knots, std::span<const T>(cp), u, r, std::span<scalar>(new_knots), std::span<T>(new_cp));
+	}
+
+	/**
+	 * Insert knots in the rational curve
+	 * @param[in] crv RationalCurve object
+	 * @param[in] u Parameter to insert knot at
+	 * @param[in] repeat Number of times to insert
+	 * @return New RationalCurve object with #repeat knots inserted at u
+	 */
+	inline RationalCurve curve_knot_insert(const RationalCurve& crv, scalar u, size_t repeat = 1)
+	{
+		if (!curve_is_valid(crv))
 		{
-			r = deg - s;
+			return RationalCurve();
 		}
+		RationalCurve new_crv;
+		new_crv.m_degree = crv.m_degree;
 
-		// Insert new knots between k and (k + 1)
-		new_knots.resize(knots.size() + r);
-		for (int i = 0; i < k + 1; i++)
+		// Convert to homogenous coordinates
+		std::vector<vec4> cw;
+		cw.resize(crv.m_control_points.size());
+		for (int i = 0; i < crv.m_control_points.size(); i++)
 		{
-			new_knots[i] = knots[i];
+			cw[i] = cartesian_to_homogenous(crv.m_control_points[i], crv.m_weights[i]);
 		}
-		for (int i = 1; i < r + 1; i++)
+
+		// Perform knot insertion and get new knots and control points
+		std::vector<vec4> new_cw;
+		std::vector<scalar> new_knots;
+		curve_knot_insert<vec4>(crv.m_degree, crv.m_knots, cw, u, repeat, new_crv.m_knots, new_cw);
+
+		// Convert back to cartesian coordinates
+		new_crv.m_control_points.resize(new_cw.size());
+		new_crv.m_weights.resize(new_cw.size());
+		for (int i = 0; i < new_cw.size(); i++)
 		{
-			new_knots[k + i] = u;
+
+			new_crv.m_control_points[i] = homogenous_to_cartesian(new_cw[i]);
+			new_crv.m_weights[i] = new_cw[i][3];
 		}
-		for (int i = k + 1; i < knots.size(); i++)
-		{
-			new_knots[i + r] = knots[i];
+		return new_crv;
+	}
+	namespace internal
+	{
+		/*
+		 * Knot refinement (Piegl & Tiller A5.4) of several control polygons sharing one knot vector.
+		 * Control point i of polygon c is cp[i * columns + c], new_cp receives the refined polygons
+		 * in the same layout with X.size() more rows.
+		 */
+		template<typename T>
+		inline void knot_refine_columns(size_t degree, const std::vector<scalar>& knots, const std::vector<T>& cp, size_t columns, const std::vector<scalar>& X,
+			std::vector<scalar>& new_knots, std::vector<T>& new_cp)
+		{
+			if (X.empty())
+			{
+				new_knots = knots;
+				new_cp = cp;
+				return;
+			}
+			const int p = static_cast<int>(degree);
+			const int n = static_cast<int>(cp.size() / columns) - 1;
+			const int r = static_cast<int>(X.size()) - 1;
+			new_knots.resize(knots.size() + X.size());
+			new_cp.resize(cp.size() + X.size() * columns);
+			auto P = [&](int i) { return cp.data() + static_cast<size_t>(i) * columns; };
+			auto Q = [&](int i) { return new_cp.data() + static_cast<size_t>(i) * columns; };
+
+			// Copy the unaffected control points and knots
+			const int a = find_span(degree, knots, X.front());
+			const int b = find_span(degree, knots, X.back()) + 1;
+			std::copy(P(0), P(a - p + 1), Q(0));
+			std::copy(P(b - 1), P(n + 1), Q(b + r));
+			std::copy(knots.begin(), knots.begin() + a + 1, new_knots.begin());
+			std::copy(knots.begin() + b + p, knots.end(), new_knots.begin() + b + p + r + 1);
+
+			// Insert the new knots from the last one down
+			int i = b + p - 1;
+			int k = b + p + r;
+			for (int j = r; j >= 0; j--)
+			{
+				while (X[j] <= knots[i] && i > a)
+				{
+					std::copy(P(i - p - 1), P(i - p), Q(k - p - 1));
+					new_knots[k] = knots[i];
+					k--;
+					i--;
+				}
+				std::copy(Q(k - p), Q(k - p + 1), Q(k - p - 1));
+				for (int l = 1; l <= p; l++)
+				{
+					const int ind = k - p + l;
+					scalar alpha = new_knots[k + l] - X[j];
+					if (alpha == 0.0f)
+					{
+						std::copy(Q(ind), Q(ind + 1), Q(ind - 1));
+						continue;
+					}
+					alpha /= new_knots[k + l] - knots[i - p + l];
+					for (size_t c = 0; c < columns; c++)
+					{
+						Q(ind - 1)[c] = alpha * Q(ind - 1)[c] + (1.0f - alpha) * Q(ind)[c];
+					}
+				}
+				new_knots[k] = X[j];
+				k--;
+			}
+		}
+	}// namespace internal
+
+	/**
+	 * Insert a list of knots in the curve in one pass (knot refinement)
+	 * @param[in] deg Degree of the curve
+	 * @param[in] knots Knot vector of the curve
+	 * @param[in] cp Control points of the curve
+	 * @param[in] X Knots to insert, ascending and inside the domain of the curve.
+	 * @param[out] new_knots Updated knot vector
+	 * @param[out] new_cp Updated control points
+	 */
+	template<typename T>
+	inline void curve_knot_refine(size_t deg, const std::vector<scalar>& knots, const std::vector<T>& cp, const std::vector<scalar>& X, std::vector<scalar>& new_knots,
+		std::vector<T>& new_cp)
+	{
+		internal::knot_refine_columns(deg, knots, cp, 1, X, new_knots, new_cp);
+	}
+
+	/**
+	 * Insert a list of knots in the rational curve in one pass
+	 * @param[in] crv RationalCurve object
+	 * @param[in] X Knots to insert, ascending and inside the domain of the curve.
+	 * @return New RationalCurve object with the knots of X inserted
+	 */
+	inline RationalCurve curve_knot_refine(const RationalCurve& crv, const std::vector<scalar>& X)
+	{
+		if (!curve_is_valid(crv))
+		{
+			return RationalCurve();
+		}
+		RationalCurve new_crv;
+		new_crv.m_degree = crv.m_degree;
+
+		// Convert to homogenous coordinates
+		std::vector<vec4> cw(crv.m_control_points.size());
+		for (size_t i = 0; i < crv.m_control_points.size(); i++)
+		{
+			cw[i] = cartesian_to_homogenous(crv.m_control_points[i], crv.m_weights[i]);
+		}
+
+		std::vector<vec4> new_cw;
+		curve_knot_refine<vec4>(crv.m_degree, crv.m_knots, cw, X, new_crv.m_knots, new_cw);
+
+		// Convert back to cartesian coordinates
+		new_crv.m_control_points.resize(new_cw.size());
+		new_crv.m_weights.resize(new_cw.size());
+		for (size_t i = 0; i < new_cw.size(); i++)
+		{
+			new_crv.m_control_points[i] = homogenous_to_cartesian(new_cw[i]);
+			new_crv.m_weights[i] = new_cw[i].w();
+		}
+		return new_crv;
+	}
+
+	namespace internal
+	{
+		/*
+		 * Try to remove knots[r] once (Piegl & Tiller A5.8) from the homogenous control polygon
+		 * cw[i * stride], s being the multiplicity of knots[r] and r its last index.
+		 * When removed is given, it receives the new control points first .. last = r - degree .. r - s.
+		 * return Distance between the two solutions of the removal, which bounds the deviation it causes.
+		 */
+		inline scalar knot_removal_bound(size_t degree, const std::vector<scalar>& knots, const vec4* cw, size_t stride, int r, int s, vec4* removed = nullptr)
+		{
+			const int p = static_cast<int>(degree);
+			const int first = r - p;
+			const int last = r - s;
+			const int off = first - 1;
+			const scalar u = knots[r];
+			auto P = [&](int i) -> const vec4& { return cw[static_cast<size_t>(i) * stride]; };
+
+			std::array<vec4, N_MAX_DEGREE + 3> temp;
+			temp[0] = P(off);
+			temp[last + 1 - off] = P(last + 1);
+			int i = first;
+			int j = last;
+			int ii = 1;
+			int jj = last - off;
+			while (j - i > 0)
+			{
+				const scalar alfi = (u - knots[i]) / (knots[i + p + 1] - knots[i]);
+				const scalar alfj = (u - knots[j]) / (knots[j + p + 1] - knots[j]);
+				temp[ii] = (P(i) - (1.0f - alfi) * temp[ii - 1]) / alfi;
+				temp[jj] = (P(j) - alfj * temp[jj + 1]) / (1.0f - alfj);
+				i++;
+				ii++;
+				j--;
+				jj--;
+			}
+			scalar bound;
+			if (j - i < 0)
+			{
+				bound = (temp[ii - 1] - temp[jj + 1]).norm();
+			}
+			else
+			{
+				const scalar alfi = (u - knots[i]) / (knots[i + p + 1] - knots[i]);
+				bound = (P(i) - (alfi * temp[ii + 1] + (1.0f - alfi) * temp[ii - 1])).norm();
+			}
+			if (removed)
+			{
+				for (int k = first; k <= last; k++)
+				{
+					removed[k - first] = P(k);
+				}
+				for (i = first, j = last; j - i > 0; i++, j--)
+				{
+					removed[i - first] = temp[i - off];
+					removed[j - first] = temp[j - off];
+				}
+			}
+			return bound;
+		}
+
+		/*
+		 * Greedy knot removal from homogenous B-splines sharing one knot vector, control point i of
+		 * spline c is cw[i * columns + c]. The knot with the smallest removal bound goes first.
+		 * errors[k * cells + x] accumulates the deviation bound over knot span k and cell x of the
+		 * other direction, cells_of(c) returns the range of cells spline c contributes to.
+		 * A knot is removed only while every span it affects stays within the tolerance.
+		 * return Number of removed knots
+		 */
+		template<typename Cells>
+		inline size_t remove_knots_columns(size_t degree, std::vector<scalar>& knots, std::vector<vec4>& cw, size_t columns, std::vector<scalar>& errors,
+			size_t cells, Cells&& cells_of, scalar tolerance)
+		{
+			const int p = static_cast<int>(degree);
+			const scalar infinity = std::numeric_limits<scalar>::infinity();
+			auto multiplicity = [&](int r)
+			{
+				int s = 1;
+				while (r - s >= 0 && knots[r - s] == knots[r])
+				{
+					s++;
+				}
+				return s;
+			};
+			// Removal bound of knots[r] over all splines, infinity if it is not a removable knot
+			auto evaluate = [&](int r)
+			{
+				const int m = static_cast<int>(knots.size()) - 1;
+				if (r <= p || r >= m - p || knots[r + 1] == knots[r] || !(knots[r] > knots[p] && knots[r] < knots[m - p]))
+				{
+					return infinity;
+				}
+				const int s = multiplicity(r);
+				if (s > p + 1 || static_cast<int>(cw.size() / columns) <= p + 1)
+				{
+					return infinity;
+				}
+				scalar bound = 0.0f;
+				for (size_t c = 0; c < columns && bound <= tolerance; c++)
+				{
+					bound = std::max(bound, knot_removal_bound(degree, knots, cw.data() + c, columns, r, s));
+				}
+				return bound <= tolerance ? bound : infinity;
+			};
+
+			std::vector<scalar> bounds(knots.size());
+			for (size_t r = 0; r < knots.size(); r++)
+			{
+				bounds[r] = evaluate(static_cast<int>(r));
+			}
+			std::vector<scalar> column_bounds(columns);
+			std::vector<scalar> cell_bounds(cells);
+			std::vector<vec4> removed((p + 1) * columns);
+			size_t count = 0;
+			while (true)
+			{
+				const int r = static_cast<int>(std::min_element(bounds.begin(), bounds.end()) - bounds.begin());
+				if (!(bounds[r] < infinity))
+				{
+					break;
+				}
+				const int s = multiplicity(r);
+				const int first = r - p;
+				const int last = r - s;
+				const int size = last - first + 1;
+
+				// The removal changes the curve on spans first .. last + degree only
+				for (size_t c = 0; c < columns; c++)
+				{
+					column_bounds[c] = knot_removal_bound(degree, knots, cw.data() + c, columns, r, s, removed.data() + c * size);
+				}
+				std::fill(cell_bounds.begin(), cell_bounds.end(), 0.0f);
+				for (size_t c = 0; c < columns; c++)
+				{
+					const auto [begin, end] = cells_of(c);
+					for (size_t x = begin; x < end; x++)
+					{
+						cell_bounds[x] = std::max(cell_bounds[x], column_bounds[c]);
+					}
+				}
+				bool within = true;
+				for (int k = first; k <= last + p && within; k++)
+				{
+					for (size_t x = 0; x < cells && within; x++)
+					{
+						within = errors[k * cells + x] + cell_bounds[x] <= tolerance;
+					}
+				}
+				if (!within)
+				{
+					bounds[r] = infinity;
+					continue;
+				}
+				for (int k = first; k <= last + p; k++)
+				{
+					for (size_t x = 0; x < cells; x++)
+					{
+						errors[k * cells + x] += cell_bounds[x];
+					}
+				}
+
+				// Write the new control points and drop the middle one
+				for (int i = first; i <= last; i++)
+				{
+					for (size_t c = 0; c < columns; c++)
+					{
+						cw[i * columns + c] = removed[c * size + i - first];
+					}
+				}
+				const size_t fout = (2 * r - s - p) / 2;
+				cw.erase(cw.begin() + fout * columns, cw.begin() + (fout + 1) * columns);
+				knots.erase(knots.begin() + r);
+				// Spans r - 1 and r merge into one
+				for (size_t x = 0; x < cells; x++)
+				{
+					errors[(r - 1) * cells + x] = std::max(errors[(r - 1) * cells + x], errors[r * cells + x]);
+				}
+				errors.erase(errors.begin() + r * cells, errors.begin() + (r + 1) * cells);
+				bounds.erase(bounds.begin() + r);
+				count++;
+
+				// Only knots whose removal involves the changed control points or knots are affected
+				const int begin = std::max(r - 2 * p - 2, 0);
+				const int end = std::min(r + 2 * p + 2, static_cast<int>(knots.size()) - 1);
+				for (int k = begin; k <= end; k++)
+				{
+					bounds[k] = evaluate(k);
+				}
+			}
+			return count;
+		}
+
+		/*
+		 * Tolerance on homogenous control points that keeps the deviation of the rational geometry
+		 * within the given distance (Piegl & Tiller eq. 5.30), the distance itself for a polynomial one.
+		 */
+		inline scalar homogenous_tolerance(scalar tolerance, scalar min_weight, scalar max_weight, scalar max_norm)
+		{
+			if (min_weight == max_weight)
+			{
+				return tolerance * min_weight;
+			}
+			return tolerance * min_weight / (1.0f + max_norm);
+		}
+	}// namespace internal
+
+	/**
+	 * Remove as many knots of the curve as possible while it stays within a distance of the original
+	 * @param[in] crv RationalCurve object
+	 * @param[in] tolerance Maximum distance between the original and the reduced curve
+	 * @return Reduced RationalCurve object and an upper bound of its distance to the original,
+	 * the original curve and 0 if the curve is invalid.
+	 */
+	inline std::tuple<RationalCurve, scalar> remove_knots(const RationalCurve& crv, scalar tolerance)
+	{
+		if (!curve_is_valid(crv) || crv.m_degree < 1 || crv.m_degree > N_MAX_DEGREE || !(tolerance > 0.0f))
+		{
+			return std::make_tuple(crv, 0.0f);
+		}
+		std::vector<vec4> cw(crv.m_control_points.size());
+		scalar max_norm = 0.0f;
+		for (size_t i = 0; i < cw.size(); i++)
+		{
+			cw[i] = cartesian_to_homogenous(crv.m_control_points[i], crv.m_weights[i]);
+			max_norm = std::max(max_norm, crv.m_control_points[i].norm());
+		}
+		const auto [min_weight, max_weight] = std::minmax_element(crv.m_weights.begin(), crv.m_weights.end());
+		const scalar factor = internal::homogenous_tolerance(1.0f, *min_weight, *max_weight, max_norm);
+
+		RationalCurve result;
+		result.m_degree = crv.m_degree;
+		result.m_knots = crv.m_knots;
+		std::vector<scalar> errors(crv.m_knots.size() - 1, 0.0f);
+		internal::remove_knots_columns(crv.m_degree, result.m_knots, cw, 1, errors, 1,
+			[](size_t) { return std::make_pair(size_t(0), size_t(1)); }, tolerance * factor);
+
+		result.m_control_points.resize(cw.size());
+		result.m_weights.resize(cw.size());
+		for (size_t i = 0; i < cw.size(); i++)
+		{
+			result.m_control_points[i] = homogenous_to_cartesian(cw[i]);
+			result.m_weights[i] = cw[i].w();
+		}
+		const scalar error = *std::max_element(errors.begin(), errors.end()) / factor;
+		return std::make_tuple(std::move(result), error);
+	}
+
+	/**
+	 * Number of control points of the two parts of a curve split at u
+	 * @param[in] degree Degree of curve
+	 * @param[in] knots Knot vector
+	 * @param[in] u Parameter to split curve
+	 * @return Number of control points of the left and of the right part, both 0 if u is not inside the domain.
+	 */
+	inline std::tuple<size_t, size_t> curve_split_sizes(const size_t degree, const std::vector<scalar>& knots, scalar u)
+	{
+		const size_t s = knot_multiplicity(knots, u);
+		if (u <= knots[degree] || u >= knots[knots.size() - degree - 1] || s > degree)
+		{
+			return std::make_tuple(size_t(0), size_t(0));
+		}
+		const size_t count = knots.size() - degree - 1;
+		const size_t ks = find_span(degree, knots, u) - degree + 1;
+		return std::make_tuple(ks + degree - s, count - ks + 1);
+	}
+
+	/**
+	 * Split the curve into two without allocating
+	 * @param[in] degree Degree of curve
+	 * @param[in] knots Knot vector
+	 * @param[in] control_points Control points of the curve
+	 * @param[in] u Parameter to split curve
+	 * @param[out] left_knots Knots of the left part of the curve
+	 * @param[out] left_control_points Control points of the left part of the curve
+	 * @param[out] right_knots Knots of the right part of the curve
+	 * @param[out] right_control_points Control points of the right part of the curve
+	 * @param[in,out] workspace Scratch memory
+	 * The parts have the sizes given by curve_split_sizes, their knots degree + 1 more.
+	 * @return false if u is not inside the domain, the outputs are untouched then.
+	 */
+	template<typename T>
+	inline bool curve_split(const size_t degree, const std::vector<scalar>& knots, std::span<const T> control_points, scalar u, std::span<scalar> left_knots,
+		std::span<T> left_control_points, std::span<scalar> right_knots, std::span<T> right_control_points, NurbsWorkspace& workspace)
+	{
+		const auto [left_count, right_count] = curve_split_sizes(degree, knots, u);
+		if (left_count == 0)
+		{
+			return false;
+		}
+		// Insert u until its multiplicity equals the degree
+		const int span = find_span(degree, knots, u);
+		const size_t s = knot_multiplicity(knots, u);
+		const size_t r = degree - s;
+		internal::InsertAlphas alpha;
+		internal::knot_insert_alphas(degree, knots, u, span, s, r, alpha);
+		std::span<T> tmp_cp = workspace.scratch<T>(0, control_points.size() + r);
+		internal::knot_insert_polygon(degree, span, s, r, alpha, control_points.data(), control_points.size(), 1, tmp_cp.data(), 1);
+
+		// Both parts are clamped at u
+		std::copy(knots.begin(), knots.begin() + span + 1, left_knots.begin());
+		std::fill_n(left_knots.begin() + span + 1, r + 1, u);
+		std::fill_n(right_knots.begin(), degree + 1, u);
+		std::copy(knots.begin() + span + 1, knots.end(), right_knots.begin() + degree + 1);
+		std::copy_n(tmp_cp.begin(), left_count, left_control_points.begin());
+		std::copy_n(tmp_cp.begin() + left_count - 1, right_count, right_control_points.begin());
+		return true;
+	}
+
+	/**
+	 * Split the curve into two
+	 * @param[in] degree Degree of curve
+	 * @param[in] knots Knot vector
+	 * @param[in] control_points std::vector of control points
+	 * @param[in] u Parameter to split curve
+	 * @param[out] left_knots Knots of the left part of the curve
+	 * @param[out] left_control_points Control points of the left part of the curve
+	 * @param[out] right_knots Knots of the right part of the curve
+	 * @param[out] right_control_points Control points of the right part of the curve
+	 */
+	template<typename T>
+	inline void curve_split(const size_t degree, const std::vector<scalar>& knots, const std::vector<T>& control_points, scalar u, std::vector<scalar>& left_knots,
+		std::vector<T>& left_control_points, std::vector<scalar>& right_knots, std::vector<T>& right_control_points)
+	{
+		const auto [left_count, right_count] = curve_split_sizes(degree, knots, u);
+		if (left_count == 0)
+		{
+			return;
+		}
+		left_knots.resize(left_count + degree + 1);
+		left_control_points.resize(left_count);
+		right_knots.resize(right_count + degree + 1);
+		right_control_points.resize(right_count);
+		NurbsWorkspace workspace;
+		curve_split(degree, knots, std::span<const T>(control_points), u, std::span<scalar>(left_knots), std::span<T>(left_control_points),
+			std::span<scalar>(right_knots), std::span<T>(right_control_points), workspace);
+	}
+
+	/**
+	 * Split a rational curve into two
+	 * @param[in] crv RationalCurve object
+	 * @param[in] u Parameter to split at
+	 * @return std::tuple with first half and second half of the curve
+	 */
+	inline std::tuple<RationalCurve, RationalCurve> curve_split(const RationalCurve& crv, scalar u)
+	{
+		if (!curve_is_valid(crv))
+		{
+			return {};
+		}
+		RationalCurve left, right;
+		left.m_degree = crv.m_degree;
+		right.m_degree = crv.m_degree;
+
+		std::vector<vec4> Cw, left_Cw, right_Cw;
+		Cw.resize(crv.m_control_points.size());
+		for (int i = 0; i < crv.m_control_points.size(); i++)
+		{
+			Cw[i] = cartesian_to_homogenous(crv.m_control_points[i], crv.m_weights[i]);
+		}
+
+		curve_split(crv.m_degree, crv.m_knots, Cw, u, left.m_knots, left_Cw, right.m_knots, right_Cw);
+
+		left.m_control_points.reserve(left_Cw.size());
+		left.m_weights.reserve(left_Cw.size());
+		right.m_control_points.reserve(right_Cw.size());
+		right.m_weights.reserve(right_Cw.size());
+		for (int i = 0; i < left_Cw.size(); i++)
+		{
+			left.m_control_points.emplace_back(homogenous_to_cartesian(left_Cw[i]));
+			left.m_weights.emplace_back(left_Cw[i].w());
+		}
+		for (int i = 0; i < right_Cw.size(); i++)
+		{
+			right.m_control_points.emplace_back(util::homogenous_to_cartesian(right_Cw[i]));
+			right.m_weights.emplace_back(right_Cw[i].w());
+		}
+		return std::tuple<RationalCurve, RationalCurve>(std::move(left), std::move(right));
+	}
+
+	/**
+	 * Bezier segments of a curve packed in one contiguous array.
+	 * Segment s owns the homogenous control points [s * (degree + 1), (s + 1) * (degree + 1))
+	 * and covers the parameter range [breaks[s], breaks[s + 1]].
+	 */
+	struct BezierSegments
+	{
+		size_t degree = 0;
+		std::vector<vec4> points;
+		std::vector<scalar> breaks;
+
+		size_t size() const { return breaks.empty() ? 0 : breaks.size() - 1; }
+		vec4* segment(size_t s) { return points.data() + s * (degree + 1); }
+		const vec4* segment(size_t s) const { return points.data() + s * (degree + 1); }
+	};
+
+	/**
+	 * Evaluate a rational Bezier segment with de Casteljau
+	 * @param[in] cw Homogenous control points of the segment, degree + 1 of them.
+	 * @param[in] degree Degree of the segment
+	 * @param[in] t Local parameter in [0, 1]
+	 * @return Homogenous point at t.
+	 */
+	template<typename Real>
+	inline vec4_t<Real> bezier_point(const vec4_t<Real>* cw, size_t degree, std::type_identity_t<Real> t)
+	{
+		std::array<vec4_t<Real>, N_MAX_DEGREE + 1> tmp;
+		std::copy_n(cw, degree + 1, tmp.begin());
+		for (int k = 1; k <= static_cast<int>(degree); k++)
+		{
+			for (int i = 0; i <= static_cast<int>(degree) - k; i++)
+			{
+				tmp[i] = (Real(1) - t) * tmp[i] + t * tmp[i + 1];
+			}
+		}
+		return tmp[0];
+	}
+
+	/**
+	 * Split a rational Bezier segment with de Casteljau
+	 * @param[in] cw Homogenous control points of the segment, degree + 1 of them.
+	 * @param[in] degree Degree of the segment
+	 * @param[in] t Local parameter to split at
+	 * @param[out] left Control points of the part [0, t], degree + 1 of them.
+	 * @param[out] right Control points of the part [t, 1], degree + 1 of them, may alias cw.
+	 */
+	template<typename Real>
+	inline void bezier_split(const vec4_t<Real>* cw, size_t degree, std::type_identity_t<Real> t, vec4_t<Real>* left, vec4_t<Real>* right)
+	{
+		std::array<vec4_t<Real>, N_MAX_DEGREE + 1> tmp;
+		const int p = static_cast<int>(degree);
+		std::copy_n(cw, p + 1, tmp.begin());
+		left[0] = tmp[0];
+		right[p] = tmp[p];
+		for (int k = 1; k <= p; k++)
+		{
+			for (int i = 0; i <= p - k; i++)
+			{
+				tmp[i] = (Real(1) - t) * tmp[i] + t * tmp[i + 1];
+			}
+			left[k] = tmp[0];
+			right[p - k] = tmp[p - k];
+		}
+	}
+
+	/**
+	 * Evaluate derivatives of the homogenous curve Cw of a rational Bezier segment
+	 * @param[in] cw Homogenous control points of the segment, degree + 1 of them.
+	 * @param[in] degree Degree of the segment
+	 * @param[in] t Local parameter in [0, 1]
+	 * @param[in] num_ders Number of times to derivate.
+	 * @param[out] cw_ders cw_ders[n] is the nth derivative of Cw at t, where 0 <= n <= min(num_ders, degree).
+	 * @return min(num_ders, degree), the higher derivatives vanish.
+	 */
+	template<typename Real>
+	inline int bezier_homogenous_derivatives(const vec4_t<Real>* cw, size_t degree, std::type_identity_t<Real> t, int num_ders, vec4_t<Real>* cw_ders)
+	{
+		// Derivatives of Cw from its hodographs
+		std::array<vec4_t<Real>, N_MAX_DEGREE + 1> hodograph;
+		std::copy_n(cw, degree + 1, hodograph.begin());
+		const int du = std::min(num_ders, static_cast<int>(degree));
+		Real factor = 1;
+		for (int k = 0; k <= du; k++)
+		{
+			const int p = static_cast<int>(degree) - k;
+			cw_ders[k] = factor * bezier_point(hodograph.data(), p, t);
+			for (int i = 0; i < p; i++)
+			{
+				hodograph[i] = hodograph[i + 1] - hodograph[i];
+			}
+			factor *= static_cast<Real>(p);
+		}
+		return du;
+	}
+
+	/**
+	 * Evaluate derivatives of a rational Bezier segment with respect to its local parameter
+	 * @param[in] cw Homogenous control points of the segment, degree + 1 of them.
+	 * @param[in] degree Degree of the segment
+	 * @param[in] t Local parameter in [0, 1]
+	 * @param[in] num_ders Number of times to derivate.
+	 * @param[out] ders ders[n] is the nth derivative at t, where 0 <= n <= num_ders.
+	 */
+	template<typename Real>
+	inline void bezier_derivatives(const vec4_t<Real>* cw, size_t degree, std::type_identity_t<Real> t, int num_ders, vec3_t<Real>* ders)
+	{
+		std::array<vec4_t<Real>, N_MAX_DEGREE + 1> cw_ders;
+		const int du = bezier_homogenous_derivatives(cw, degree, t, num_ders, cw_ders.data());
+
+		// Compute rational derivatives
+		for (int k = 0; k <= num_ders; k++)
+		{
+			vec3_t<Real> v = k <= du ? vec3_t<Real>(cw_ders[k].template head<3>()) : vec3_t<Real>::Zero();
+			for (int i = 1; i < std::min(k, du) + 1; i++)
+			{
+				v -= binomial(k, i) * cw_ders[i].w() * ders[k - i];
+			}
+			ders[k] = v / cw_ders[0].w();
+		}
+	}
+
+	/**
+	 * Convert a Bezier segment to another scalar type, e.g. to refine in double a segment stored in float
+	 * @param[in] cw Homogenous control points of the segment, degree + 1 of them.
+	 * @param[in] degree Degree of the segment
+	 * @return Converted control points, the first degree + 1 are set.
+	 */
+	template<typename Real, typename Other>
+	inline std::array<vec4_t<Real>, N_MAX_DEGREE + 1> bezier_cast(const vec4_t<Other>* cw, size_t degree)
+	{
+		std::array<vec4_t<Real>, N_MAX_DEGREE + 1> result;
+		for (size_t k = 0; k <= degree; k++)
+		{
+			result[k] = cw[k].template cast<Real>();
+		}
+		return result;
+	}
+
+	namespace internal
+	{
+		/*
+		 * Clamp both ends of homogenous B-splines sharing one knot vector, control point i of
+		 * spline c is cw[i * columns + c]. The first and the last degree + 1 knots then equal the
+		 * ends of the domain, the splines themselves are unchanged.
+		 */
+		inline void clamp_columns(size_t degree, std::vector<scalar>& knots, std::vector<vec4>& cw, size_t columns)
+		{
+			const size_t p = degree;
+			const scalar a = knots[p];
+			const scalar b = knots[knots.size() - p - 1];
+			const bool clamp_start = knots.front() != a;
+			const bool clamp_end = knots.back() != b;
+			if (!clamp_start && !clamp_end)
+			{
+				return;
+			}
+			std::vector<scalar> X;
+			if (clamp_start)
+			{
+				X.insert(X.end(), p - std::min(knot_multiplicity(knots, a), p), a);
+			}
+			if (clamp_end)
+			{
+				X.insert(X.end(), p - std::min(knot_multiplicity(knots, b), p), b);
+			}
+			std::vector<scalar> new_knots;
+			std::vector<vec4> new_cw;
+			knot_refine_columns(degree, knots, cw, columns, X, new_knots, new_cw);
+
+			// Knots outside [a, b] and the control points they support lie outside the domain
+			size_t first = 0;
+			if (clamp_start)
+			{
+				first = std::lower_bound(new_knots.begin(), new_knots.end(), a) - new_knots.begin() - 1;
+				new_knots[first] = a;
+			}
+			size_t last = new_knots.size() - 1;
+			if (clamp_end)
+			{
+				last = std::upper_bound(new_knots.begin(), new_knots.end(), b) - new_knots.begin();
+				new_knots[last] = b;
+			}
+			knots.assign(new_knots.begin() + first, new_knots.begin() + last + 1);
+			const size_t rows = knots.size() - p - 1;
+			cw.assign(new_cw.begin() + first * columns, new_cw.begin() + (first + rows) * columns);
+		}
+
+		/*
+		 * Number of Bezier segments of a clamped B-spline, i.e. of non-empty knot spans in its domain
+		 */
+		inline size_t bezier_segment_count(size_t degree, const std::vector<scalar>& knots)
+		{
+			size_t count = 0;
+			for (size_t i = degree; i + degree + 1 < knots.size(); i++)
+			{
+				count += knots[i + 1] != knots[i] ? 1 : 0;
+			}
+			return count;
+		}
+
+		/*
+		 * Bezier decomposition (Piegl & Tiller A5.6) of clamped homogenous B-splines sharing one
+		 * knot vector, control point i of spline c is cw[i * columns + c].
+		 * Only two segments are kept in flight, each finished one is handed to emit(s, segment)
+		 * where point k of spline c is segment[k * columns + c].
+		 */
+		template <typename Emit>
+		inline void decompose_columns(size_t degree, const std::vector<scalar>& knots, const std::vector<vec4>& cw, size_t columns,
+			std::vector<scalar>& breaks, Emit&& emit)
+		{
+			const int p = static_cast<int>(degree);
+			const int m = static_cast<int>(knots.size()) - 1;
+			breaks.clear();
+			breaks.reserve(bezier_segment_count(degree, knots) + 1);
+			std::vector<vec4> buffer(2 * (p + 1) * columns);
+			auto P = [&](int i) { return cw.data() + static_cast<size_t>(i) * columns; };
+			auto Q = [&](size_t s, int k) { return buffer.data() + ((s & 1) * (p + 1) + k) * columns; };
+
+			std::array<scalar, N_MAX_DEGREE + 1> alphas;
+			int a = p;
+			int b = p + 1;
+			size_t nb = 0;
+			std::copy(P(0), P(p + 1), Q(0, 0));
+			breaks.push_back(knots[a]);
+			while (b < m)
+			{
+				int i = b;
+				while (b < m && knots[b + 1] == knots[b])
+				{
+					b++;
+				}
+				int mult = b - i + 1;
+				if (mult < p)
+				{
+					// Insert knots[b] until its multiplicity is p
+					scalar numer = knots[b] - knots[a];
+					for (int j = p; j > mult; j--)
+					{
+						alphas[j - mult - 1] = numer / (knots[a + j] - knots[a]);
+					}
+					int r = p - mult;
+					for (int j = 1; j <= r; j++)
+					{
+						int save = r - j;
+						int s = mult + j;
+						for (int k = p; k >= s; k--)
+						{
+							const scalar alpha = alphas[k - s];
+							vec4* current = Q(nb, k);
+							const vec4* previous = Q(nb, k - 1);
+							for (size_t c = 0; c < columns; c++)
+							{
+								current[c] = alpha * current[c] + (1.0f - alpha) * previous[c];
+							}
+						}
+						if (b < m)
+						{
+							// Control point of the next segment
+							std::copy(Q(nb, p), Q(nb, p) + columns, Q(nb + 1, save));
+						}
+					}
+				}
+				emit(nb, static_cast<const vec4*>(Q(nb, 0)));
+				nb++;
+				breaks.push_back(knots[b]);
+				if (b < m)
+				{
+					// A multiplicity of degree + 1 is a discontinuity, the next segment starts afresh
+					for (int k = std::max(p - mult, 0); k <= p; k++)
+					{
+						std::copy(P(b - p + k), P(b - p + k + 1), Q(nb, k));
+					}
+					a = b;
+					b = b + 1;
+				}
+			}
+		}
+
+		/*
+		 * Bezier decomposition of clamped homogenous B-splines into one packed array,
+		 * point k of segment s of spline c is written to points[(s * (degree + 1) + k) * columns + c].
+		 */
+		inline void decompose_columns(size_t degree, const std::vector<scalar>& knots, const std::vector<vec4>& cw, size_t columns,
+			std::vector<vec4>& points, std::vector<scalar>& breaks)
+		{
+			const size_t count = (degree + 1) * columns;
+			points.resize(bezier_segment_count(degree, knots) * count);
+			decompose_columns(degree, knots, cw, columns, breaks,
+				[&](size_t s, const vec4* segment) { std::copy(segment, segment + count, points.begin() + s * count); });
+		}
+	}// namespace internal
+
+	/**
+	 * Decompose a curve into its Bezier segments (Piegl & Tiller A5.6)
+	 * @param[in] degree Degree of the curve
+	 * @param[in] knots Knot vector of the curve, clamped or not
+	 * @param[in] cw Homogenous control points of the curve
+	 * @return Bezier segments in parameter order
+	 */
+	inline BezierSegments decompose_curve(size_t degree, std::vector<scalar> knots, std::vector<vec4> cw)
+	{
+		BezierSegments segments;
+		segments.degree = degree;
+		if (degree < 1 || degree > N_MAX_DEGREE || !is_valid_relation(degree, knots.size(), cw.size()))
+		{
+			return segments;
+		}
+		// Unclamped ends are clamped first so that the end segments are Bezier too
+		internal::clamp_columns(degree, knots, cw, 1);
+		internal::decompose_columns(degree, knots, cw, 1, segments.points, segments.breaks);
+		return segments;
+	}
+
+	/**
+	 * Decompose a rational curve into its Bezier segments
+	 * @param[in] evaluator CurveEvaluator of the curve
+	 * @return Bezier segments in parameter order, empty if the curve is invalid.
+	 */
+	inline BezierSegments decompose_curve(const CurveEvaluator& evaluator)
+	{
+		if (!evaluator.is_valid())
+		{
+			return BezierSegments{};
+		}
+		return decompose_curve(evaluator.degree(), evaluator.knots(), evaluator.homogenous_points());
+	}
+	inline BezierSegments decompose_curve(const RationalCurve& crv) { return decompose_curve(CurveEvaluator(crv)); }
+
+	namespace internal
+	{
+		/*
+		 * Box of the control hull of a rational Bezier piece
+		 * return false if a weight is not positive, the hull then does not bound the piece.
+		 */
+		inline bool bezier_hull_box(const vec4* cw, size_t count, AABB3& box)
+		{
+			box.setEmpty();
+			for (size_t i = 0; i < count; i++)
+			{
+				if (!(cw[i].w() > 0.0f))
+				{
+					return false;
+				}
+				box.extend(homogenous_to_cartesian(cw[i]));
+			}
+			return true;
 		}
-		// Copy unaffected control points
-		new_cp.resize(cp.size() + r);
-		for (int i = 0; i < k - deg + 1; i++)
+
+		/*
+		 * Box of the control points of a curve or a flat surface net, used to scale the bounds tolerance
+		 */
+		inline AABB3 control_box(std::span<const vec4> cw)
 		{
-			new_cp[i] = cp[i];
+			AABB3 box;
+			for (const auto& p : cw)
+			{
+				if (p.w() != 0.0f)
+				{
+					box.extend(homogenous_to_cartesian(p));
+				}
+			}
+			return box;
 		}
-		for (int i = k - s; i < cp.size(); i++)
+	}// namespace internal
+
+	/**
+	 * Bounding box of Bezier segments refined on their control hulls.
+	 * The end points of every piece lie on the curve and span an inner box, a piece whose hull
+	 * box sticks out of the inner box by more than the tolerance is bisected. The result contains
+	 * the curve and exceeds its exact box by at most the tolerance on each side.
+	 * Pieces with non-positive weights are bisected to N_MAX_BOUNDS_DEPTH and their hull is
+	 * taken as is, the box is not guaranteed to be conservative for them.
+	 * @param[in] segments Bezier segments of the curve
+	 * @param[in] tolerance Absolute tolerance of the box
+	 * @return Bounding box, empty if there are no segments.
+	 */
+	inline AABB3 bezier_bounds(const BezierSegments& segments, scalar tolerance)
+	{
+		AABB3 inner, outer;
+		const size_t count = segments.degree + 1;
+		for (size_t s = 0; s < segments.size(); s++)
 		{
-			new_cp[i + r] = cp[i];
+			inner.extend(homogenous_to_cartesian(segments.segment(s)[0]));
+			inner.extend(homogenous_to_cartesian(segments.segment(s)[segments.degree]));
 		}
-		// Copy affected control points
-		std::vector<T> tmp;
-		tmp.resize(deg - s + 1);
-		for (int i = 0; i < deg - s + 1; i++)
+
+		struct Piece
 		{
-			tmp[i] = cp[k - deg + i];
-		}
-		// Modify affected control points
-		for (int j = 1; j < r + 1; j++)
+			std::array<vec4, N_MAX_DEGREE + 1> cw;
+			int depth;
+		};
+		std::vector<Piece> stack;
+		for (size_t s = 0; s < segments.size(); s++)
 		{
-			int L = k - deg + j;
-			for (int i = 0; i < deg - j - s + 1; i++)
+			Piece piece;
+			std::copy_n(segments.segment(s), count, piece.cw.begin());
+			piece.depth = 0;
+			stack.push_back(piece);
+			while (!stack.empty())
 			{
-				scalar a = (u - knots[L + i]) / (knots[i + k + 1] - knots[L + i]);
-				tmp[i] = (1 - a) * tmp[i] + a * tmp[i + 1];
+				Piece top = stack.back();
+				stack.pop_back();
+				AABB3 hull;
+				bool positive = internal::bezier_hull_box(top.cw.data(), count, hull);
+				AABB3 accept(inner.min() - vec3::Constant(tolerance), inner.max() + vec3::Constant(tolerance));
+				if ((positive && accept.contains(hull)) || top.depth >= N_MAX_BOUNDS_DEPTH)
+				{
+					if (positive)
+					{
+						outer.extend(hull);
+					}
+					else
+					{
+						outer.extend(homogenous_to_cartesian(top.cw[0]));
+						outer.extend(homogenous_to_cartesian(top.cw[segments.degree]));
+					}
+					continue;
+				}
+				Piece left, right;
+				bezier_split(top.cw.data(), segments.degree, 0.5f, left.cw.data(), right.cw.data());
+				left.depth = right.depth = top.depth + 1;
+				inner.extend(homogenous_to_cartesian(right.cw[0]));
+				stack.push_back(right);
+				stack.push_back(left);
 			}
-			new_cp[L] = tmp[0];
-			new_cp[k + r - j - s] = tmp[deg - j - s];
 		}
-		int L = k - deg + r;
-		for (int i = L + 1; i < k - s; i++)
+		return outer;
+	}
+
+	template<typename Real>
+	inline const AABB3& BasicCurveEvaluator<Real>::bounds() const
+	{
+		static const AABB3 empty;
+		if (!m_valid)
 		{
-			new_cp[i] = tmp[i - L];
+			return empty;
 		}
+		std::call_once(m_bounds->once,
+			[this]()
+			{
+				if constexpr (std::is_same_v<Real, scalar>)
+				{
+					const scalar tolerance = N_BOUNDS_RELATIVE_TOLERANCE * internal::control_box(m_cw).diagonal().norm();
+					m_bounds->box = bezier_bounds(decompose_curve(*this), tolerance);
+				}
+				else
+				{
+					m_bounds->box = CurveEvaluator(*this).bounds();
+				}
+			});
+		return m_bounds->box;
 	}
+	inline constexpr size_t N_APPROXIMATION_CHUNK = 16384;
 
 	/**
-	 * Insert knots in the rational curve
-	 * @param[in] crv RationalCurve object
-	 * @param[in] u Parameter to insert knot at
-	 * @param[in] repeat Number of times to insert
-	 * @return New RationalCurve object with #repeat knots inserted at u
+	 * Optional inputs of least_square_approximation
 	 */
-	inline RationalCurve curve_knot_insert(const RationalCurve& crv, scalar u, size_t repeat = 1)
+	struct ApproximationOptions
 	{
-		if (!curve_is_valid(crv))
-		{
-			return RationalCurve();
-		}
-		RationalCurve new_crv;
-		new_crv.m_degree = crv.m_degree;
+		// Parameters of the points, non-decreasing; chord length parameterization if empty
+		std::span<const scalar> params;
+		// Weight of each point in the fit, every point weighs 1 if empty
+		std::span<const scalar> weights;
+		// First derivatives with respect to the parameter the curve must have at its start and its end
+		std::optional<vec3> start_derivative;
+		std::optional<vec3> end_derivative;
+	};
 
-		// Convert to homogenous coordinates
-		std::vector<vec4> cw;
-		cw.resize(crv.m_control_points.size());
-		for (int i = 0; i < crv.m_control_points.size(); i++)
-		{
-			cw[i] = cartesian_to_homogenous(crv.m_control_points[i], crv.m_weights[i]);
+	namespace internal
+	{
+		/*
+		 * Knots of a least squares fit of count control points so that every span holds parameters (Piegl & Tiller 9.68, 9.69)
+		 */
+		inline std::vector<scalar> approximation_knots(size_t degree, const std::vector<scalar>& params, int count)
+		{
+			const int p = static_cast<int>(degree);
+			const int m = static_cast<int>(params.size());
+			std::vector<scalar> knots(count + p + 1);
+			std::fill_n(knots.begin(), p + 1, params.front());
+			std::fill_n(knots.end() - (p + 1), p + 1, params.back());
+			const double d = static_cast<double>(m) / static_cast<double>(count - p);
+			for (int j = 1; j < count - p; j++)
+			{
+				int i = static_cast<int>(j * d);
+				scalar a = static_cast<scalar>(j * d - i);
+				knots[p + j] = (1.0f - a) * params[i - 1] + a * params[i];
+			}
+			return knots;
 		}
 
-		// Perform knot insertion and get new knots and control points
-		std::vector<vec4> new_cw;
-		std::vector<scalar> new_knots;
-		curve_knot_insert<vec4>(crv.m_degree, crv.m_knots, cw, u, repeat, new_crv.m_knots, new_cw);
-
-		// Convert back to cartesian coordinates
-		new_crv.m_control_points.resize(new_cw.size());
-		new_crv.m_weights.resize(new_cw.size());
-		for (int i = 0; i < new_cw.size(); i++)
+		/*
+		 * Normal equations N^T W N P = N^T W R of the points of one chunk, the rows and columns
+		 * [first, first + rhs.size()) of the free control points they touch, in banded form.
+		 */
+		struct NormalEquations
 		{
+			int first = 0;
+			std::vector<double> band;
+			std::vector<Eigen::Vector3d> rhs;
+		};
+	}// namespace internal
 
-			new_crv.m_control_points[i] = homogenous_to_cartesian(new_cw[i]);
-			new_crv.m_weights[i] = new_cw[i][3];
-		}
-		return new_crv;
-	}
 	/**
-	 * Split the curve into two
-	 * @param[in] degree Degree of curve
-	 * @param[in] knots Knot vector
-	 * @param[in] control_points std::vector of control points
-	 * @param[in] u Parameter to split curve
-	 * @param[out] left_knots Knots of the left part of the curve
-	 * @param[out] left_control_points Control points of the left part of the curve
-	 * @param[out] right_knots Knots of the right part of the curve
-	 * @param[out] right_control_points Control points of the right part of the curve
+	 * Approximate points with a non-rational B-spline curve in the least squares sense (Piegl & Tiller 9.4.1).
+	 * The ends interpolate the first and the last point. The normal equations are assembled in
+	 * banded form in parallel over chunks of points and solved with a banded Cholesky, so memory
+	 * is O(points + control_points_count * degree).
+	 * @param[in] degree Degree of the curve
+	 * @param[in] through_points The points to approximate
+	 * @param[in] control_points_count Number of control points of the curve
+	 * @param[out] crv The approximating curve, unchanged on failure.
+	 * @param[in] options Parameters, per-point weights and end derivatives, see ApproximationOptions.
+	 * @return false if the inputs are inconsistent or the normal equations are singular.
 	 */
-	template<typename T>
-	inline void curve_split(const size_t degree, const std::vector<scalar>& knots, const std::vector<T>& control_points, scalar u, std::vector<scalar>& left_knots,
-		std::vector<T>& left_control_points, std::vector<scalar>& right_knots, std::vector<T>& right_control_points)
+	inline bool least_square_approximation(const size_t degree, const std::vector<vec3>& through_points, int control_points_count, RationalCurve& crv, const ApproximationOptions& options = {})
 	{
-		if (u <= knots[degree] || u >= knots[knots.size() - degree - 1])
+		const int p = static_cast<int>(degree);
+		const int n = control_points_count;
+		const int m = static_cast<int>(through_points.size());
+		const int fixed_count = 2 + (options.start_derivative ? 1 : 0) + (options.end_derivative ? 1 : 0);
+		if (p < 1 || n < p + 1 || n < fixed_count || m < n || (!options.params.empty() && options.params.size() != static_cast<size_t>(m)) || (!options.weights.empty() && options.weights.size() != static_cast<size_t>(m)))
 		{
-			return;
+			return false;
 		}
-		std::vector<scalar> tmp_knots;
-		std::vector<T> tmp_cp;
-
-		int span = find_span(degree, knots, u);
-		int r = degree - knot_multiplicity(knots, u);
-
-		curve_knot_insert(degree, knots, control_points, u, r, tmp_knots, tmp_cp);
-
-		left_knots.clear();
-		right_knots.clear();
-		left_control_points.clear();
-		right_control_points.clear();
-
-		int span_l = find_span(degree, tmp_knots, u) + 1;
-		for (int i = 0; i < span_l; i++)
+		std::vector<scalar> uk;
+		if (options.params.empty())
 		{
-			left_knots.emplace_back(tmp_knots[i]);
+			uk = get_chord_parameterization(through_points);
 		}
-		left_knots.emplace_back(u);
-
-		for (int i = 0; i < degree + 1; i++)
+		else
 		{
-			right_knots.emplace_back(u);
+			uk.assign(options.params.begin(), options.params.end());
 		}
-		for (int i = span_l; i < tmp_knots.size(); i++)
+
+		std::vector<scalar> knot_vector = internal::approximation_knots(degree, uk, n);
+
+		// The ends and the control points fixed by the end derivatives are known
+		std::vector<vec3> control_points(n);
+		control_points[0] = through_points.front();
+		control_points[n - 1] = through_points.back();
+		int first_free = 1;
+		int last_free = n - 2;
+		if (options.start_derivative)
 		{
-			right_knots.emplace_back(tmp_knots[i]);
+			control_points[1] = control_points[0] + (knot_vector[p + 1] - knot_vector[1]) / p * *options.start_derivative;
+			first_free++;
 		}
-
-		int ks = span - degree + 1;
-		for (int i = 0; i < ks + r; i++)
+		if (options.end_derivative)
 		{
-			left_control_points.emplace_back(tmp_cp[i]);
+			control_points[n - 2] = control_points[n - 1] - (knot_vector[n + p - 1] - knot_vector[n - 1]) / p * *options.end_derivative;
+			last_free--;
 		}
-		for (int i = ks + r - 1; i < tmp_cp.size(); i++)
+		const int free_count = last_free - first_free + 1;
+
+		if (free_count > 0)
 		{
-			right_control_points.emplace_back(tmp_cp[i]);
+			// Assemble the normal equations of each chunk of points, their columns are contiguous as uk is sorted
+			const size_t chunks = (m + N_APPROXIMATION_CHUNK - 1) / N_APPROXIMATION_CHUNK;
+			std::vector<internal::NormalEquations> partial(chunks);
+			parallel_for(chunks, [&](size_t chunk)
+				{
+					const int begin = static_cast<int>(chunk * N_APPROXIMATION_CHUNK);
+					const int end = std::min(m, begin + static_cast<int>(N_APPROXIMATION_CHUNK));
+					internal::NormalEquations& eq = partial[chunk];
+					eq.first = std::max(first_free, find_span(degree, knot_vector, uk[begin]) - p);
+					const int last = std::min(last_free, find_span(degree, knot_vector, uk[end - 1]));
+					if (last < eq.first)
+					{
+						return;
+					}
+					eq.band.assign(static_cast<size_t>(last - eq.first + 1) * (p + 1), 0.0);
+					eq.rhs.assign(last - eq.first + 1, Eigen::Vector3d::Zero());
+					BasisArray basis;
+					for (int k = begin; k < end; k++)
+					{
+						const int span = find_span(degree, knot_vector, uk[k]);
+						bspline_basis(degree, span, knot_vector, uk[k], basis);
+						const double w = options.weights.empty() ? 1.0 : options.weights[k];
+						Eigen::Vector3d r = through_points[k].cast<double>();
+						for (int j = 0; j <= p; j++)
+						{
+							const int col = span - p + j;
+							if (col < first_free || col > last_free)
+							{
+								r -= basis[j] * control_points[col].cast<double>();
+							}
+						}
+						for (int a = 0; a <= p; a++)
+						{
+							const int row = span - p + a;
+							if (row < first_free || row > last_free)
+							{
+								continue;
+							}
+							const double wa = w * basis[a];
+							eq.rhs[row - eq.first] += wa * r;
+							double* band_row = eq.band.data() + static_cast<size_t>(row - eq.first) * (p + 1);
+							for (int b = 0; b <= a; b++)
+							{
+								const int col = span - p + b;
+								if (col >= first_free)
+								{
+									band_row[col - row + p] += wa * basis[b];
+								}
+							}
+						}
+					}
+				}, 2);
+
+			// Sum the chunks in order, the result does not depend on the number of threads
+			BandedCholesky NtN(free_count, p);
+			std::vector<Eigen::Vector3d> X(free_count, Eigen::Vector3d::Zero());
+			for (const auto& eq : partial)
+			{
+				for (int r = 0; r < static_cast<int>(eq.rhs.size()); r++)
+				{
+					const int row = eq.first + r;
+					X[row - first_free] += eq.rhs[r];
+					for (int c = std::max(first_free, row - p); c <= row; c++)
+					{
+						NtN(row - first_free, c - first_free) += eq.band[static_cast<size_t>(r) * (p + 1) + (c - row + p)];
+					}
+				}
+			}
+			if (!NtN.factorize())
+			{
+				return false;
+			}
+			NtN.solve(X);
+			for (int i = 0; i < free_count; i++)
+			{
+				control_points[first_free + i] = X[i].cast<scalar>();
+			}
 		}
+
+		crv.m_degree = degree;
+		crv.m_knots.swap(knot_vector);
+		crv.m_control_points.swap(control_points);
+		crv.m_weights.assign(n, 1.0f);
+		return true;
 	}
 
+	inline constexpr size_t N_INTERPOLATION_BLOCK = 64;
+
 	/**
-	 * Split a rational curve into two
-	 * @param[in] crv RationalCurve object
-	 * @param[in] u Parameter to split at
-	 * @return std::tuple with first half and second half of the curve
+	 * Factorised collocation matrix of global interpolation (Piegl & Tiller A9.1).
+	 * The matrix only depends on the degree and the parameters, so it is built and factorised
+	 * once and then solves any number of point sets sharing them, e.g. all rows of a surface grid.
 	 */
-	inline std::tuple<RationalCurve, RationalCurve> curve_split(const RationalCurve& crv, scalar u)
+	class CurveInterpolator
 	{
-		if (!curve_is_valid(crv))
-		{
-			return {};
-		}
-		RationalCurve left, right;
-		left.m_degree = crv.m_degree;
-		right.m_degree = crv.m_degree;
+	public:
+		CurveInterpolator() = default;
+		/**
+		 * @param[in] degree Degree of the interpolating curves
+		 * @param[in] params Parameters of the through points, ascending.
+		 */
+		CurveInterpolator(size_t degree, const std::vector<scalar>& params);
+
+		bool is_valid() const { return m_valid; }
+		size_t degree() const { return m_degree; }
+		size_t size() const { return m_params.size(); }
+		const std::vector<scalar>& params() const { return m_params; }
+		const std::vector<scalar>& knots() const { return m_knots; }
+
+		/**
+		 * Replace through points by the control points interpolating them
+		 * @param[in,out] points size() through points on input, the control points on output.
+		 */
+		template<typename T>
+		void solve(T* points) const { solve_block(points, 1, 1); }
+		/**
+		 * Interpolate several sets of through points at once, blocks of columns are solved in parallel
+		 * @param[in,out] points Through point i of set c at points[i * columns + c] on input,
+		 * control point i of set c at the same place on output.
+		 * @param[in] columns Number of point sets
+		 */
+		template<typename T>
+		void solve_many(T* points, size_t columns) const;
+
+	private:
+		template<typename T>
+		void solve_block(T* points, size_t columns, size_t stride) const;
+
+		bool m_valid = false;
+		size_t m_degree = 0;
+		std::vector<scalar> m_params;
+		std::vector<scalar> m_knots;
+		// Factorised in double, the points are converted on the way in and out
+		BasicBandedLU<double> m_matrix;
+	};
 
-		std::vector<vec4> Cw, left_Cw, right_Cw;
-		Cw.resize(crv.m_control_points.size());
-		for (int i = 0; i < crv.m_control_points.size(); i++)
+	inline CurveInterpolator::CurveInterpolator(size_t degree, const std::vector<scalar>& params)
+		: m_degree(degree), m_params(params)
+	{
+		const int size = static_cast<int>(params.size());
+		const int n = size - 1;
+		if (degree < 1 || size < static_cast<int>(degree) + 1)
 		{
-			Cw[i] = cartesian_to_homogenous(crv.m_control_points[i], crv.m_weights[i]);
+			return;
 		}
+		// AverageKnotVector
+		m_knots = average_knot_vector(degree, params);
 
-		curve_split(crv.m_degree, crv.m_knots, Cw, u, left.m_knots, left_Cw, right.m_knots, right_Cw);
-
-		left.m_control_points.reserve(left_Cw.size());
-		left.m_weights.reserve(left_Cw.size());
-		right.m_control_points.reserve(right_Cw.size());
-		right.m_weights.reserve(right_Cw.size());
-		for (int i = 0; i < left_Cw.size(); i++)
+		// Row i holds the degree + 1 basis functions non-zero at params[i]
+		std::vector<int> spans(size);
+		int lower = 0, upper = 0;
+		for (int i = 1; i < n; i++)
 		{
-			left.m_control_points.emplace_back(homogenous_to_cartesian(left_Cw[i]));
-			left.m_weights.emplace_back(left_Cw[i].w());
+			spans[i] = find_span(degree, m_knots, params[i]);
+			lower = std::max(lower, i - (spans[i] - static_cast<int>(degree)));
+			upper = std::max(upper, spans[i] - i);
 		}
-		for (int i = 0; i < right_Cw.size(); i++)
+		m_matrix = BasicBandedLU<double>(size, lower, upper);
+		const std::vector<double> knots(m_knots.begin(), m_knots.end());
+		BasisArrayT<double> basis;
+		for (int i = 1; i < n; i++)
 		{
-			right.m_control_points.emplace_back(util::homogenous_to_cartesian(right_Cw[i]));
-			right.m_weights.emplace_back(right_Cw[i].w());
+			bspline_basis(degree, spans[i], knots, params[i], basis);
+			for (int j = 0; j < degree + 1; j++)
+			{
+				m_matrix(i, spans[i] - degree + j) = basis[j];
+			}
 		}
-		return std::tuple<RationalCurve, RationalCurve>(std::move(left), std::move(right));
+		m_matrix(0, 0) = 1.0;
+		m_matrix(n, n) = 1.0;
+		m_valid = m_matrix.factorize();
 	}
-	/*
-	 * Fit a NurbsSurface by through_points
-	 */
-	inline bool least_square_approximation(const size_t degree, const std::vector<vec3>& through_points, int control_points_count, RationalCurve& crv)
+
+	template<typename T>
+	inline void CurveInterpolator::solve_many(T* points, size_t columns) const
 	{
-		int n = control_points_count;
-		int m = through_points.size();
-		std::vector<scalar> uk = get_chord_parameterization(through_points);
-		std::vector<scalar> knot_vector(n + degree + 1, 1.0f);
+		const size_t blocks = (columns + N_INTERPOLATION_BLOCK - 1) / N_INTERPOLATION_BLOCK;
+		parallel_for(blocks, [&](size_t block)
+			{
+				const size_t first = block * N_INTERPOLATION_BLOCK;
+				solve_block(points + first, std::min(N_INTERPOLATION_BLOCK, columns - first), columns);
+			}, 2);
+	}
 
-		scalar d = (scalar)m / (scalar)n;
-		for (int j = 0; j < degree + 1; j++)
-		{
-			knot_vector[j] = 0.0f;
-		}
-		for (int j = 1; j < n - degree; j++)
+	template<typename T>
+	inline void CurveInterpolator::solve_block(T* points, size_t columns, size_t stride) const
+	{
+		using Wide = rebind_scalar_t<T, double>;
+		const size_t rows = m_params.size();
+		std::vector<Wide> block(rows * columns);
+		for (size_t i = 0; i < rows; i++)
 		{
-			knot_vector[degree + j] = 0.0f;
-			for (int k = j; k < j + degree; k++)
+			for (size_t c = 0; c < columns; c++)
 			{
-				int i1 = k * d;
-				scalar a = k * d - i1;
-				int i2 = ((k - 1) * d);
-				knot_vector[degree + j] += a * uk[i2] + (1 - a) * uk[i1];
+				block[i * columns + c] = convert_scalar<Wide>(points[i * stride + c]);
 			}
-			knot_vector[degree + j] /= degree;
 		}
-
-		std::vector<vec3> control_points(n);
-		std::vector<scalar> weights(n, 1.0f);
-		std::vector<vec3> R(n);
-		std::vector<vec3> rk(m);
-		std::vector<scalar> funs(degree + 1);
-		std::vector<std::vector<scalar>> N(m, std::vector<scalar>(n));
-		R[0] = through_points[0];
-		R[n - 1] = through_points[m - 1];
-		N[0][0] = 1.0;
-		N[m - 1][n - 1] = 1.0;
-
-		for (int i = 0; i < m; i++)
-		{
-			int spanIndex = find_span(degree, knot_vector, uk[i]);
-			std::vector<scalar> basis = bspline_basis(degree, spanIndex, knot_vector, uk[i]);
-			for (int j = 0; j < degree + 1; j++)
+		m_matrix.solve(block.data(), columns, columns);
+		for (size_t i = 0; i < rows; i++)
+		{
+			for (size_t c = 0; c < columns; c++)
 			{
-				N[i][spanIndex - degree + j] = basis[j];
+				points[i * stride + c] = convert_scalar<T>(block[i * columns + c]);
 			}
-			rk[i] = through_points[i] - N[i][0] * through_points[0] - N[i][n - 1] * through_points[m - 1];
 		}
+	}
+
+	/**
+	 * Factorised normal equations of the least squares approximation of least_square_approximation,
+	 * without weights or end derivatives. They only depend on the degree, the parameters and the number
+	 * of control points, so they are built and factorised once and then fit any number of point sets
+	 * sharing them, e.g. all rows of a surface grid.
+	 */
+	class CurveApproximator
+	{
+	public:
+		CurveApproximator() = default;
+		/**
+		 * @param[in] degree Degree of the approximating curves
+		 * @param[in] params Parameters of the points, ascending.
+		 * @param[in] control_points_count Number of control points of the approximating curves
+		 */
+		CurveApproximator(size_t degree, const std::vector<scalar>& params, int control_points_count);
+
+		bool is_valid() const { return m_valid; }
+		size_t degree() const { return m_degree; }
+		size_t size() const { return m_params.size(); }
+		size_t control_points_count() const { return m_count; }
+		const std::vector<scalar>& params() const { return m_params; }
+		const std::vector<scalar>& knots() const { return m_knots; }
+
+		/**
+		 * Approximate several sets of points at once, blocks of columns are solved in parallel
+		 * @param[in] points Point k of set c at points[k * columns + c], size() points per set.
+		 * @param[in] columns Number of point sets
+		 * @param[out] control_points Control point i of set c at control_points[i * columns + c].
+		 */
+		template<typename T>
+		void solve_many(const T* points, size_t columns, T* control_points) const;
+
+	private:
+		template<typename T>
+		void solve_block(const T* points, T* control_points, size_t columns, size_t stride) const;
+
+		bool m_valid = false;
+		size_t m_degree = 0;
+		size_t m_count = 0;
+		std::vector<scalar> m_params;
+		std::vector<scalar> m_knots;
+		// Span and degree + 1 basis functions of every parameter
+		std::vector<int> m_spans;
+		std::vector<double> m_basis;
+		// N^T N of the free control points, all but the first and the last
+		BandedCholesky m_normal;
+	};
 
-		for (int i = 0; i < n; i++)
+	inline CurveApproximator::CurveApproximator(size_t degree, const std::vector<scalar>& params, int control_points_count)
+		: m_degree(degree), m_params(params)
+	{
+		const int p = static_cast<int>(degree);
+		const int n = control_points_count;
+		const int m = static_cast<int>(params.size());
+		if (p < 1 || n < p + 1 || n < 2 || m < n)
 		{
-			R[i] = vec3::Zero();
-			for (int j = 0; j < m; j++)
-			{
-				R[i] += N[j][i] * rk[j];
-			}
-			// this may don't work
-			if (close(R[i], vec3::Zero()))
-			{
-				// return false;
-			}
+			return;
 		}
+		m_count = n;
+		m_knots = internal::approximation_knots(degree, params, n);
 
-		if (n - 2 > 0)
+		m_spans.resize(m);
+		m_basis.resize(static_cast<size_t>(m) * (p + 1));
+		const std::vector<double> knots(m_knots.begin(), m_knots.end());
+		BasisArrayT<double> basis;
+		m_normal = BandedCholesky(n - 2, p);
+		for (int k = 0; k < m; k++)
 		{
-			Eigen::Matrix<scalar, -1, -1> B = Eigen::Matrix<scalar, -1, -1>::Zero(n - 2, 3);
-			Eigen::Matrix<scalar, -1, -1> Ns = Eigen::Matrix<scalar, -1, -1>::Zero(m - 2, n - 2);
-			for (int i = 0; i < n - 2; i++)
+			m_spans[k] = find_span(degree, m_knots, params[k]);
+			bspline_basis(degree, m_spans[k], knots, params[k], basis);
+			std::copy_n(basis.begin(), p + 1, m_basis.begin() + static_cast<size_t>(k) * (p + 1));
+			for (int a = 0; a <= p; a++)
 			{
-				for (int j = 0; j < 3; j++)
+				const int row = m_spans[k] - p + a;
+				if (row < 1 || row > n - 2)
 				{
-					B(i, j) = R[i + 1][j];
+					continue;
 				}
-			}
-			for (int i = 1; i < m - 1; i++)
-			{
-				for (int j = 1; i < n - 1; j++)
+				for (int b = 0; b <= a; b++)
 				{
-					Ns(i - 1, j - 1) = N[i][j];
+					const int col = m_spans[k] - p + b;
+					if (col >= 1)
+					{
+						m_normal(row - 1, col - 1) += basis[a] * basis[b];
+					}
 				}
 			}
+		}
+		m_valid = n == 2 || m_normal.factorize();
+	}
 
-			auto NsT = Ns.transpose();
-			auto NsTNs = NsT * Ns;
-			Eigen::Matrix<scalar, Eigen::Dynamic, Eigen::Dynamic> X = NsTNs.lu().solve(B);
+	template<typename T>
+	inline void CurveApproximator::solve_many(const T* points, size_t columns, T* control_points) const
+	{
+		const size_t blocks = (columns + N_INTERPOLATION_BLOCK - 1) / N_INTERPOLATION_BLOCK;
+		parallel_for(blocks, [&](size_t block)
+			{
+				const size_t first = block * N_INTERPOLATION_BLOCK;
+				solve_block(points + first, control_points + first, std::min(N_INTERPOLATION_BLOCK, columns - first), columns);
+			}, 2);
+	}
 
-			for (int i = 0; i < n - 2; i++)
+	template<typename T>
+	inline void CurveApproximator::solve_block(const T* points, T* control_points, size_t columns, size_t stride) const
+	{
+		using Wide = rebind_scalar_t<T, double>;
+		const int p = static_cast<int>(m_degree);
+		const int n = static_cast<int>(m_count);
+		const size_t m = m_params.size();
+		std::vector<Wide> rhs(n - 2);
+		for (size_t c = 0; c < columns; c++)
+		{
+			// The ends interpolate the first and the last point, the free control points fit the residuals
+			const Wide front = convert_scalar<Wide>(points[c]);
+			const Wide back = convert_scalar<Wide>(points[(m - 1) * stride + c]);
+			std::fill(rhs.begin(), rhs.end(), Wide::Zero());
+			for (size_t k = 0; k < m; k++)
+			{
+				const double* basis = m_basis.data() + k * (p + 1);
+				Wide r = convert_scalar<Wide>(points[k * stride + c]);
+				for (int j = 0; j <= p; j++)
+				{
+					const int col = m_spans[k] - p + j;
+					if (col == 0)
+					{
+						r -= basis[j] * front;
+					}
+					else if (col == n - 1)
+					{
+						r -= basis[j] * back;
+					}
+				}
+				for (int a = 0; a <= p; a++)
+				{
+					const int row = m_spans[k] - p + a;
+					if (row >= 1 && row <= n - 2)
+					{
+						rhs[row - 1] += basis[a] * r;
+					}
+				}
+			}
+			m_normal.solve(rhs.data());
+			control_points[c] = points[c];
+			for (int i = 1; i < n - 1; i++)
 			{
-				control_points[i + 1] = X.row(i);
+				control_points[i * stride + c] = convert_scalar<T>(rhs[i - 1]);
 			}
+			control_points[(n - 1) * stride + c] = points[(m - 1) * stride + c];
 		}
-		control_points[0] = vec3(through_points[0].x(), through_points[0].y(), through_points[0].z());
-		control_points[n - 1] = vec3(through_points[m - 1].x(), through_points[m - 1].y(), through_points[m - 1].z());
-
-		crv.m_degree = degree;
-		crv.m_knots.swap(knot_vector);
-		crv.m_control_points.swap(control_points);
-		crv.m_weights.swap(weights);
-		return true;
 	}
 
 	/*
 	 * Evaluate a ration B-spline curve by throughPoints
 	 * @param[in] degree Degree of the ration B-spline curve
 	 * @param[in] throughpoints The points that the ration B-spline curve will fit
-	 * @param[out] crv the ration B-spline curve will fit
+	 * @param[out] crv the ration B-spline curve will fit, unchanged if the interpolation system is singular.
+	 * @param[in] params Parameters of the through points, chord length parameterization if empty.
 	 */
 	inline void global_interpolation(const size_t degree, const std::vector<vec3>& throughpoints, RationalCurve& crv, const std::vector<scalar>& params = {})
 	{
-
-		int size = throughpoints.size();
-		int n = size - 1;
 		// The chord length parameterization maybe others better
-		std::vector<scalar> uk(size);
-		if (params.size() == 0)
-			uk = get_chord_parameterization(throughpoints);
-		else
-		{
-			uk = params;
-		}
-
-		// AverageKnotVector
-		std::vector<scalar> knot_vector = average_knot_vector(degree, uk);
-
-		// Solve Linear System
-		Eigen::Matrix<scalar, -1, -1> A = Eigen::Matrix<scalar, -1, -1>::Zero(size, size);
-		for (int i = 1; i < n; i++)
-		{
-
-			int span_index = find_span(degree, knot_vector, uk[i]);
-			std::vector<scalar> basis = bspline_basis(degree, span_index, knot_vector, uk[i]);
-			for (int j = 0; j < degree + 1; j++)
-			{
-				A(i, span_index - degree + j) = basis[j];
-			}
-		}
-		A(0, 0) = 1.0;
-		A(n, n) = 1.0;
-		Eigen::Matrix<scalar, -1, -1> right = Eigen::Matrix<scalar, -1, -1>::Zero(size, 3);
-		for (int i = 0; i < size; i++)
-		{
-			for (int j = 0; j < 3; j++)
-			{
-				right(i, j) = throughpoints[i][j];
-			}
-		}
-		Eigen::Matrix<scalar, Eigen::Dynamic, Eigen::Dynamic> result = A.lu().solve(right);
-		std::vector<vec3> control_points(size);
-		std::vector<scalar> weight(size);
-		for (int i = 0; i < result.rows(); i++)
+		CurveInterpolator interpolator(degree, params.size() == 0 ? get_chord_parameterization(throughpoints) : params);
+		if (!interpolator.is_valid() || interpolator.size() != throughpoints.size())
 		{
-			control_points[i] = result.row(i);
-			weight[i] = 1.0f;
+			return;
 		}
+		std::vector<vec3> control_points = throughpoints;
+		interpolator.solve(control_points.data());
 		crv.m_degree = degree;
-		crv.m_knots.swap(knot_vector);
+		crv.m_knots = interpolator.knots();
 		crv.m_control_points.swap(control_points);
-		crv.m_weights.swap(weight);
+		crv.m_weights.assign(throughpoints.size(), 1.0f);
 	}
 
 
@@ -814,65 +2379,34 @@ namespace Geomerty::nurbs::util
 	/*
 	 * sample a NURBS curve to a std::vector
 	 */
-	inline std::vector<vec3> sample_curve(const RationalCurve& crv, int segments)
+	inline std::vector<vec3> sample_curve(const CurveEvaluator& evaluator, int segments)
 	{
-		scalar u_min = std::numeric_limits<float>::max();
-		scalar u_max = -std::numeric_limits<float>::max();
-		for (auto u_temp : crv.m_knots)
+		if (!evaluator.is_valid())
 		{
-			u_min = std::min(u_min, u_temp);
-			u_max = std::max(u_max, u_temp);
+			return std::vector<vec3>(segments + 1, vec3::Zero());
 		}
-		std::vector<vec3> point_arr(segments + 1);
-
+		scalar u_min = evaluator.u_min();
+		scalar u_max = evaluator.u_max();
+		std::vector<scalar> params(segments + 1);
 		for (int i = 0; i < segments + 1; i++)
 		{
 			scalar u = static_cast<scalar>(i) / static_cast<scalar>(segments);
-			scalar norm_u = u_min + (u_max - u_min) * u;
-			point_arr[i] = curve_point(crv, norm_u);
+			params[i] = u_min + (u_max - u_min) * u;
 		}
-		return point_arr;
+		return evaluator.evaluate(params);
 	}
-	/*
-	 * Evaluate bounding box on a nonrational NURBS curve
-	 * @param[in] crv NURBS curve
-	 * @param segments param for sample NURBS curve
-	 * return the bounding box with given segments
+	inline std::vector<vec3> sample_curve(const RationalCurve& crv, int segments) { return sample_curve(CurveEvaluator(crv), segments); }
+	/**
+	 * Evaluate bounding box of a NURBS curve from its Bezier control hulls, see bezier_bounds
+	 * @param[in] evaluator CurveEvaluator of the curve, the box is cached on it.
+	 * @return Bounding box, empty if the curve is invalid.
 	 */
-	inline AABB3 curve_box(const RationalCurve& crv, int segments)
-	{
-		const auto point_arr = sample_curve(crv, segments);
-		AABB3 box;
-		for (auto pos : point_arr)
-		{
-			box.extend(pos);
-		}
-		return box;
-	}
+	inline AABB3 curve_box(const CurveEvaluator& evaluator) { return evaluator.bounds(); }
+	inline AABB3 curve_box(const RationalCurve& crv) { return curve_box(CurveEvaluator(crv)); }
 	/*
-	 * Evaluate a closest point to a NURBS curve
-	 * @param[in] crv NURBS curve
-	 * @param segments param for sample NURBS curve
-	 * return the closest point
+	 * The box no longer depends on a sample count, segments is ignored
 	 */
-	inline vec3 curve_closest_point(const RationalCurve& crv, vec3 pos, int segments)
-	{
-		const auto point_arr = sample_curve(crv, segments);
-		vec3 close_point;
-		scalar dist = std::numeric_limits<float>::max();
-
-		for (int i = 1; i < point_arr.size(); i++)
-		{
-			vec3 temp_nearest_point;
-			scalar temp_dist = internal::dist_point_line_segment(pos, point_arr[i - 1], point_arr[i], temp_nearest_point);
-			if (temp_dist < dist)
-			{
-				dist = temp_dist;
-				close_point = temp_nearest_point;
-			}
-		}
-		return close_point;
-	}
+	[[deprecated("use curve_box(crv)")]] inline AABB3 curve_box(const RationalCurve& crv, int /*segments*/) { return curve_box(crv); }
 	/*
 	*
 	*/
@@ -1228,8 +2762,9 @@ namespace Geomerty::nurbs::util
 
 			int spanIndex = find_span(degree, knotVector, uk[i]);
 
-			auto basis = bspline_basis(degree, spanIndex, knotVector, uk[i]);
-			std::vector<std::vector<scalar>> derBasis = bspline_der_basis(degree, spanIndex, knotVector, uk[i], 1);
+			BasisDerTable derBasis;
+			bspline_der_basis(degree, spanIndex, knotVector, uk[i], 1, derBasis);
+			const BasisArray& basis = derBasis[0];
 			for (int j = 0; j <= degree; j++)
 			{
 				A(2 * i, spanIndex - degree + j) = basis[j];
@@ -7,6 +7,7 @@
 #include "nurbs_surface.h"
 #include "nurbs_util.h"
 #include "mesh/range.h"
+#include "glviewer/parallel_for.h"
 
 namespace Geomerty
 {
@@ -26,13 +27,13 @@ namespace Geomerty
 			 * @return Whether valid
 			 */
 			inline bool surface_is_valid(const size_t degree_u, const size_t degree_v, const std::vector<scalar>& knots_u, const std::vector<scalar>& knots_v,
-				const std::vector<std::vector<vec3>>& control_points)
+				const Array2<vec3>& control_points)
 			{
-				if (degree_u < 1 || degree_u > 9 || degree_v < 1 || degree_v > 9)
+				if (degree_u < 1 || degree_u > N_MAX_DEGREE || degree_v < 1 || degree_v > N_MAX_DEGREE)
 				{
 					return false;
 				}
-				if (!is_valid_relation(degree_u, knots_u.size(), control_points.size()) || !is_valid_relation(degree_v, knots_v.size(), control_points[0].size()))
+				if (!is_valid_relation(degree_u, knots_u.size(), control_points.rows()) || !is_valid_relation(degree_v, knots_v.size(), control_points.cols()))
 				{
 					return false;
 				}
@@ -47,7 +48,7 @@ namespace Geomerty
 			 */
 			inline bool surface_is_valid(const RationalSurface& srf)
 			{
-				if (srf.m_control_points.size() != srf.m_weights.size() || srf.m_control_points[0].size() != srf.m_weights[0].size())
+				if (srf.m_control_points.rows() != srf.m_weights.rows() || srf.m_control_points.cols() != srf.m_weights.cols())
 					return false;
 				return surface_is_valid(srf.m_degree_u, srf.m_degree_v, srf.m_knots_u, srf.m_knots_v, srf.m_control_points);
 			}
@@ -155,21 +156,22 @@ namespace Geomerty
 			 */
 			template<typename T>
 			inline T surface_point(const size_t degree_u, const size_t degree_v, const std::vector<scalar>& knots_u, const std::vector<scalar>& knots_v,
-				const std::vector<std::vector<T>>& control_points, scalar u, scalar v)
+				const Array2<T>& control_points, scalar u, scalar v)
 			{
 				T point = T::Zero();
 				// Find span and non-zero basis functions
 				int span_u = find_span(degree_u, knots_u, u);
 				int span_v = find_span(degree_v, knots_v, v);
-				std::vector<scalar> nu = bspline_basis(degree_u, span_u, knots_u, u);
-				std::vector<scalar> nv = bspline_basis(degree_v, span_v, knots_v, v);
+				BasisArray nu, nv;
+				bspline_basis(degree_u, span_u, knots_u, u, nu);
+				bspline_basis(degree_v, span_v, knots_v, v, nv);
 
 				for (auto l : IndexRange(degree_v + 1))
 				{
 					T temp = T::Zero();
 					for (auto k : IndexRange(degree_u + 1))
 					{
-						temp += nu[k] * control_points[span_u - degree_u + k][span_v - degree_v + l];
+						temp += nu[k] * control_points(span_u - degree_u + k, span_v - degree_v + l);
 					}
 
 					point += nv[l] * temp;
@@ -179,7 +181,7 @@ namespace Geomerty
 			}
 
 			/**
-			 * Evaluate derivatives on a non-rational NURBS surface
+			 * Evaluate derivatives on a non-rational NURBS surface without allocating
 			 * @param[in] degree_u Degree of the given surface in u-direction.
 			 * @param[in] degree_v Degree of the given surface in v-direction.
 			 * @param[in] knots_u Knot vector of the surface in u-direction.
@@ -188,36 +190,36 @@ namespace Geomerty
 			 * @param[in] num_ders Number of times to differentiate
 			 * @param[in] u Parameter to evaluate the surface at.
 			 * @param[in] v Parameter to evaluate the surface at.
-			 * @param[out] surf_ders Derivatives of the surface at (u, v).
+			 * @param[out] surf_ders surf_ders[k * (num_ders + 1) + l] is the derivative k times in u and l times in v at (u, v).
 			 */
 			template<typename T>
-			inline std::vector<std::vector<T>> surface_derivatives(const size_t degree_u, const size_t degree_v, const std::vector<scalar>& knots_u, const std::vector<scalar>& knots_v,
-				const std::vector<std::vector<T>>& control_points, size_t num_ders, scalar u, scalar v)
+			inline void surface_derivatives(const size_t degree_u, const size_t degree_v, const std::vector<scalar>& knots_u, const std::vector<scalar>& knots_v,
+				const Array2<T>& control_points, size_t num_ders, scalar u, scalar v, std::span<T> surf_ders)
 			{
-
-				std::vector<std::vector<T>> surf_ders(num_ders + 1, std::vector<T>(num_ders + 1, T::Zero()));
-
-				// Find span and basis function derivatives
-				scalar span_u = find_span(degree_u, knots_u, u);
-				scalar span_v = find_span(degree_v, knots_v, v);
-				std::vector<std::vector<scalar>> ders_u = bspline_der_basis(degree_u, span_u, knots_u, u, num_ders);
-				std::vector<std::vector<scalar>> ders_v = bspline_der_basis(degree_v, span_v, knots_v, v, num_ders);
+				std::fill_n(surf_ders.begin(), (num_ders + 1) * (num_ders + 1), T::Zero());
 
 				// Number of non-zero derivatives is <= degree
 				size_t du = num_ders > degree_u ? degree_u : num_ders;
 
 				size_t dv = num_ders > degree_v ? degree_v : num_ders;
 
+				// Find span and basis function derivatives
+				int span_u = find_span(degree_u, knots_u, u);
+				int span_v = find_span(degree_v, knots_v, v);
+				BasisDerTable ders_u, ders_v;
+				bspline_der_basis(degree_u, span_u, knots_u, u, du, ders_u);
+				bspline_der_basis(degree_v, span_v, knots_v, v, dv, ders_v);
+
 				// Compute derivatives
 				for (auto k : IndexRange(du + 1))
 				{
-					std::vector<T> temp;
-					temp.resize(degree_v + 1, T::Zero());
+					std::array<T, N_MAX_DEGREE + 1> temp;
 					for (auto s : IndexRange(degree_v + 1))
 					{
+						temp[s] = T::Zero();
 						for (auto r : IndexRange(degree_u + 1))
 						{
-							temp[s] += ders_u[k][r] * control_points[span_u - degree_u + r][span_v - degree_v + s];
+							temp[s] += ders_u[k][r] * control_points(span_u - degree_u + r, span_v - degree_v + s);
 						}
 					}
 
@@ -227,40 +229,536 @@ namespace Geomerty
 					{
 						for (auto s : IndexRange(degree_v + 1))
 						{
-							surf_ders[k][l] += ders_v[l][s] * temp[s];
+							surf_ders[k * (num_ders + 1) + l] += ders_v[l][s] * temp[s];
 						}
 					}
 				}
-				return surf_ders;
-
 			}
 
 			/**
-			 * Evaluate point on a non-rational NURBS surface
-			 * @param[in] srf RationalSurface object
+			 * Evaluate derivatives on a non-rational NURBS surface
+			 * @param[in] degree_u Degree of the given surface in u-direction.
+			 * @param[in] degree_v Degree of the given surface in v-direction.
+			 * @param[in] knots_u Knot vector of the surface in u-direction.
+			 * @param[in] knots_v Knot vector of the surface in v-direction.
+			 * @param[in] control_points Control points of the surface in a 2D array.
+			 * @param[in] num_ders Number of times to differentiate
 			 * @param[in] u Parameter to evaluate the surface at.
 			 * @param[in] v Parameter to evaluate the surface at.
-			 * @return Resulting point on the surface at (u, v).
+			 * @param[out] surf_ders Derivatives of the surface at (u, v).
 			 */
-			inline vec3 surface_point(const RationalSurface& srf, scalar u, scalar v)
+			template<typename T>
+			inline std::vector<std::vector<T>> surface_derivatives(const size_t degree_u, const size_t degree_v, const std::vector<scalar>& knots_u, const std::vector<scalar>& knots_v,
+				const Array2<T>& control_points, size_t num_ders, scalar u, scalar v)
 			{
-				if (!surface_is_valid(srf))
-					return vec3::Zero();
+				std::vector<T> flat((num_ders + 1) * (num_ders + 1));
+				surface_derivatives(degree_u, degree_v, knots_u, knots_v, control_points, num_ders, u, v, std::span<T>(flat));
+				std::vector<std::vector<T>> surf_ders(num_ders + 1);
+				for (size_t k = 0; k <= num_ders; k++)
+				{
+					surf_ders[k].assign(flat.begin() + k * (num_ders + 1), flat.begin() + (k + 1) * (num_ders + 1));
+				}
+				return surf_ders;
+			}
+
+			/**
+			 * Precompiled evaluator of a rational B-spline surface.
+			 * The validation result, the classified knot vectors and the homogenous control points
+			 * are built once at construction, so any number of queries on the same surface reuse them.
+			 * @tparam Real Scalar type of the evaluation, SurfaceEvaluator for tessellation and display,
+			 * BasicSurfaceEvaluator<double> for solvers.
+			 */
+			template<typename Real>
+			class BasicSurfaceEvaluator
+			{
+			public:
+				using Vec3 = vec3_t<Real>;
+				using Vec4 = vec4_t<Real>;
+
+				BasicSurfaceEvaluator() = default;
+				explicit BasicSurfaceEvaluator(const RationalSurface& srf);
+				/**
+				 * Same evaluator in another scalar type. The knots and the homogenous control points are
+				 * converted, the surface is not validated again.
+				 */
+				template<typename Other>
+				explicit BasicSurfaceEvaluator(const BasicSurfaceEvaluator<Other>& other);
+
+				bool is_valid() const { return m_valid; }
+				const BasicKnotBasis<Real>& basis_u() const { return m_basis_u; }
+				const BasicKnotBasis<Real>& basis_v() const { return m_basis_v; }
+				const Array2<Vec4>& homogenous_points() const { return m_cw; }
+				Real u_min() const { return m_basis_u.knots().front(); }
+				Real u_max() const { return m_basis_u.knots().back(); }
+				Real v_min() const { return m_basis_v.knots().front(); }
+				Real v_max() const { return m_basis_v.knots().back(); }
+
+				/**
+				 * Evaluate point on the surface
+				 * @param[in] u Parameter to evaluate the surface at.
+				 * @param[in] v Parameter to evaluate the surface at.
+				 * @return Point on the surface at (u, v), zero if the surface is invalid.
+				 */
+				Vec3 point(Real u, Real v) const;
+				/**
+				 * Evaluate derivatives of the surface without allocating
+				 * @param[in] num_ders Number of times to differentiate
+				 * @param[in] u Parameter to evaluate the surface at.
+				 * @param[in] v Parameter to evaluate the surface at.
+				 * @param[out] ders ders[k * (num_ders + 1) + l] is the derivative k times in u and l times in v,
+				 * for k + l <= num_ders.
+				 * @param[in,out] workspace Scratch memory
+				 */
+				void derivatives(int num_ders, Real u, Real v, std::span<Vec3> ders, NurbsWorkspace& workspace) const;
+				/**
+				 * Conservative bounding box of the surface, within N_BOUNDS_RELATIVE_TOLERANCE of the exact one.
+				 * Computed on the first call and shared by all copies of the evaluator.
+				 * @return Bounding box, empty if the surface is invalid.
+				 */
+				const AABB3& bounds() const;
+
+			private:
+				template<typename Other> friend class BasicSurfaceEvaluator;
+
+				bool m_valid = false;
+				BasicKnotBasis<Real> m_basis_u, m_basis_v;
+				Array2<Vec4> m_cw;
+				std::shared_ptr<internal::BoundsCache> m_bounds;
+			};
+			using SurfaceEvaluator = BasicSurfaceEvaluator<scalar>;
+
+			template<typename Real>
+			inline BasicSurfaceEvaluator<Real>::BasicSurfaceEvaluator(const RationalSurface& srf)
+				: m_valid(surface_is_valid(srf))
+			{
+				if (!m_valid)
+				{
+					return;
+				}
+				m_basis_u = BasicKnotBasis<Real>(srf.m_degree_u, std::vector<Real>(srf.m_knots_u.begin(), srf.m_knots_u.end()));
+				m_basis_v = BasicKnotBasis<Real>(srf.m_degree_v, std::vector<Real>(srf.m_knots_v.begin(), srf.m_knots_v.end()));
+				m_bounds = std::make_shared<internal::BoundsCache>();
 				// Compute homogenous coordinates of control points
-				std::vector<std::vector<vec4>> cw(srf.m_control_points.size(), std::vector<vec4>(srf.m_control_points[0].size()));
-				for (int i = 0; i < srf.m_control_points.size(); i++)
+				m_cw.assign(srf.m_control_points.rows(), srf.m_control_points.cols());
+				std::span<const vec3> points = srf.m_control_points.flat();
+				std::span<const scalar> weights = srf.m_weights.flat();
+				std::span<Vec4> cw = m_cw.flat();
+				for (size_t k = 0; k < cw.size(); k++)
+				{
+					const Real w = static_cast<Real>(weights[k]);
+					cw[k] << points[k].template cast<Real>() * w, w;
+				}
+			}
+
+			template<typename Real>
+			template<typename Other>
+			inline BasicSurfaceEvaluator<Real>::BasicSurfaceEvaluator(const BasicSurfaceEvaluator<Other>& other)
+				: m_valid(other.m_valid), m_basis_u(other.m_basis_u), m_basis_v(other.m_basis_v)
+			{
+				if (!m_valid)
 				{
-					for (int j = 0; j < srf.m_control_points[0].size(); j++)
+					return;
+				}
+				m_bounds = std::make_shared<internal::BoundsCache>();
+				m_cw.assign(other.m_cw.rows(), other.m_cw.cols());
+				std::span<const vec4_t<Other>> cw = other.m_cw.flat();
+				for (size_t k = 0; k < cw.size(); k++)
+				{
+					m_cw.flat()[k] = cw[k].template cast<Real>();
+				}
+			}
+
+			template<typename Real>
+			inline vec3_t<Real> BasicSurfaceEvaluator<Real>::point(Real u, Real v) const
+			{
+				if (!m_valid)
+				{
+					return Vec3::Zero();
+				}
+				const size_t degree_u = m_basis_u.degree();
+				const size_t degree_v = m_basis_v.degree();
+				int span_u = m_basis_u.span(u);
+				int span_v = m_basis_v.span(v);
+				BasisArrayT<Real> nu, nv;
+				m_basis_u.basis(span_u, u, nu);
+				m_basis_v.basis(span_v, v, nv);
+
+				// Compute point using homogenous coordinates
+				Vec4 point_w = Vec4::Zero();
+				for (auto l : IndexRange(degree_v + 1))
+				{
+					Vec4 temp = Vec4::Zero();
+					for (auto k : IndexRange(degree_u + 1))
 					{
-						cw[i][j] = cartesian_to_homogenous(srf.m_control_points[i][j], srf.m_weights[i][j]);
+						temp += nu[k] * m_cw(span_u - degree_u + k, span_v - degree_v + l);
 					}
+					point_w += nv[l] * temp;
 				}
-				// Compute point using homogenous coordinates
-				vec4 point_w = surface_point(srf.m_degree_u, srf.m_degree_v, srf.m_knots_u, srf.m_knots_v, cw, u, v);
 				// Convert back to cartesian coordinates
 				return homogenous_to_cartesian(point_w);
 			}
 
+			template<typename Real>
+			inline void BasicSurfaceEvaluator<Real>::derivatives(int num_ders, Real u, Real v, std::span<Vec3> ders, NurbsWorkspace& workspace) const
+			{
+				const size_t stride = num_ders + 1;
+				std::fill_n(ders.begin(), stride * stride, Vec3::Zero());
+				if (!m_valid)
+				{
+					return;
+				}
+				const int degree_u = static_cast<int>(m_basis_u.degree());
+				const int degree_v = static_cast<int>(m_basis_v.degree());
+				const int du = std::min(num_ders, degree_u);
+				const int dv = std::min(num_ders, degree_v);
+				const int span_u = m_basis_u.span(u);
+				const int span_v = m_basis_v.span(v);
+				BasisDerTableT<Real> ders_u, ders_v;
+				m_basis_u.der_basis(span_u, u, du, ders_u);
+				m_basis_v.der_basis(span_v, v, dv, ders_v);
+
+				// Derivatives of Sw, those above the degrees vanish
+				std::span<Vec4> homo_ders = workspace.scratch<Vec4>(0, stride * stride);
+				std::fill(homo_ders.begin(), homo_ders.end(), Vec4::Zero());
+				for (int k = 0; k <= du; k++)
+				{
+					std::array<Vec4, N_MAX_DEGREE + 1> temp;
+					for (int s = 0; s <= degree_v; s++)
+					{
+						temp[s] = Vec4::Zero();
+						for (int r = 0; r <= degree_u; r++)
+						{
+							temp[s] += ders_u[k][r] * m_cw(span_u - degree_u + r, span_v - degree_v + s);
+						}
+					}
+					for (int l = 0; l <= std::min(num_ders - k, dv); l++)
+					{
+						for (int s = 0; s <= degree_v; s++)
+						{
+							homo_ders[k * stride + l] += ders_v[l][s] * temp[s];
+						}
+					}
+				}
+
+				// Compute rational derivatives
+				auto A = [&](int k, int l) { return homo_ders[k * stride + l]; };
+				auto S = [&](int k, int l) -> Vec3& { return ders[k * stride + l]; };
+				for (int k = 0; k <= num_ders; k++)
+				{
+					for (int l = 0; l <= num_ders - k; l++)
+					{
+						Vec3 der = A(k, l).template head<3>();
+						for (int j = 1; j <= l; j++)
+						{
+							der -= binomial(l, j) * A(0, j).w() * S(k, l - j);
+						}
+						for (int i = 1; i <= k; i++)
+						{
+							der -= binomial(k, i) * A(i, 0).w() * S(k - i, l);
+							Vec3 tmp = Vec3::Zero();
+							for (int j = 1; j <= l; j++)
+							{
+								tmp += binomial(l, j) * A(i, j).w() * S(k - i, l - j);
+							}
+							der -= binomial(k, i) * tmp;
+						}
+						S(k, l) = der / A(0, 0).w();
+					}
+				}
+			}
+
+			/**
+			 * Bezier patches of a surface packed in one buffer.
+			 * Patch (s, t) covers [breaks_u[s], breaks_u[s + 1]] x [breaks_v[t], breaks_v[t + 1]],
+			 * its control point (k, l) is patch(s, t)[k * (degree_v + 1) + l].
+			 */
+			struct BezierPatches
+			{
+				size_t degree_u = 0;
+				size_t degree_v = 0;
+				std::vector<vec4> points;
+				std::vector<scalar> breaks_u;
+				std::vector<scalar> breaks_v;
+
+				size_t size_u() const { return breaks_u.empty() ? 0 : breaks_u.size() - 1; }
+				size_t size_v() const { return breaks_v.empty() ? 0 : breaks_v.size() - 1; }
+				size_t size() const { return size_u() * size_v(); }
+				size_t stride() const { return (degree_u + 1) * (degree_v + 1); }
+				const vec4* patch(size_t s, size_t t) const { return points.data() + (s * size_v() + t) * stride(); }
+				vec4* patch(size_t s, size_t t) { return points.data() + (s * size_v() + t) * stride(); }
+			};
+
+			/**
+			 * Decompose a rational surface into its Bezier patches (Piegl & Tiller A5.7).
+			 * The whole net is decomposed along u at once, then the resulting Bezier rows along v.
+			 * @param[in] evaluator SurfaceEvaluator of the surface
+			 * @return Bezier patches in parameter order, empty if the surface is invalid.
+			 */
+			inline BezierPatches decompose_surface(const SurfaceEvaluator& evaluator)
+			{
+				BezierPatches patches;
+				const size_t degree_u = evaluator.basis_u().degree();
+				const size_t degree_v = evaluator.basis_v().degree();
+				if (!evaluator.is_valid() || degree_u > N_MAX_DEGREE || degree_v > N_MAX_DEGREE)
+				{
+					return patches;
+				}
+				patches.degree_u = degree_u;
+				patches.degree_v = degree_v;
+
+				// Along u, row i of the net holds the control points with u index i
+				const auto& cw = evaluator.homogenous_points();
+				const size_t count_v = cw.cols();
+				std::vector<vec4> net(cw.begin(), cw.end());
+				std::vector<scalar> knots_u = evaluator.basis_u().knots();
+				internal::clamp_columns(degree_u, knots_u, net, count_v);
+				std::vector<vec4> strips;
+				internal::decompose_columns(degree_u, knots_u, net, count_v, strips, patches.breaks_u);
+
+				// Along v, each Bezier row of the strips is one column
+				const size_t lines = strips.size() / count_v;
+				net.resize(strips.size());
+				for (size_t line = 0; line < lines; line++)
+				{
+					for (size_t j = 0; j < count_v; j++)
+					{
+						net[j * lines + line] = strips[line * count_v + j];
+					}
+				}
+				std::vector<scalar> knots_v = evaluator.basis_v().knots();
+				internal::clamp_columns(degree_v, knots_v, net, lines);
+
+				// Point l of Bezier row s * (degree_u + 1) + k in segment t is point (k, l) of patch (s, t)
+				const size_t size_u = patches.breaks_u.size() - 1;
+				const size_t size_v = internal::bezier_segment_count(degree_v, knots_v);
+				const size_t stride = patches.stride();
+				patches.points.resize(size_u * size_v * stride);
+				internal::decompose_columns(degree_v, knots_v, net, lines, patches.breaks_v,
+					[&](size_t t, const vec4* segment)
+					{
+						for (size_t s = 0; s < size_u; s++)
+						{
+							vec4* patch = patches.points.data() + (s * size_v + t) * stride;
+							const vec4* rows = segment + s * (degree_u + 1);
+							for (size_t k = 0; k <= degree_u; k++)
+							{
+								for (size_t l = 0; l <= degree_v; l++)
+								{
+									*patch++ = rows[l * lines + k];
+								}
+							}
+						}
+					});
+				return patches;
+			}
+			inline BezierPatches decompose_surface(const RationalSurface& srf) { return decompose_surface(SurfaceEvaluator(srf)); }
+
+			/**
+			 * Evaluate derivatives of a rational Bezier patch with respect to its local parameters
+			 * @param[in] cw Homogenous control points of the patch, point (k, l) is cw[k * (degree_v + 1) + l].
+			 * @param[in] degree_u Degree of the patch along u
+			 * @param[in] degree_v Degree of the patch along v
+			 * @param[in] s Local parameter along u in [0, 1]
+			 * @param[in] t Local parameter along v in [0, 1]
+			 * @param[in] num_ders Number of times to differentiate, at most N_MAX_DEGREE
+			 * @param[out] ders ders[k * (num_ders + 1) + l] is the derivative k times in u and l times in v,
+			 * for k + l <= num_ders.
+			 */
+			template<typename Real>
+			inline void bezier_patch_derivatives(const vec4_t<Real>* cw, size_t degree_u, size_t degree_v, std::type_identity_t<Real> s, std::type_identity_t<Real> t,
+				int num_ders, vec3_t<Real>* ders)
+			{
+				using Vec3 = vec3_t<Real>;
+				using Vec4 = vec4_t<Real>;
+				assert(num_ders <= static_cast<int>(N_MAX_DEGREE));
+				const size_t stride = num_ders + 1;
+
+				// Derivatives along u of every column of the patch, then of those along v
+				std::array<std::array<Vec4, N_MAX_DEGREE + 1>, N_MAX_DEGREE + 1> columns;
+				std::array<Vec4, N_MAX_DEGREE + 1> line, line_ders;
+				int du = 0;
+				for (size_t l = 0; l <= degree_v; l++)
+				{
+					for (size_t k = 0; k <= degree_u; k++)
+					{
+						line[k] = cw[k * (degree_v + 1) + l];
+					}
+					du = bezier_homogenous_derivatives(line.data(), degree_u, s, num_ders, line_ders.data());
+					for (int k = 0; k <= du; k++)
+					{
+						columns[k][l] = line_ders[k];
+					}
+				}
+				std::array<Vec4, (N_MAX_DEGREE + 1) * (N_MAX_DEGREE + 1)> homo_ders;
+				std::fill_n(homo_ders.begin(), stride * stride, Vec4::Zero());
+				for (int k = 0; k <= du; k++)
+				{
+					const int dv = bezier_homogenous_derivatives(columns[k].data(), degree_v, t, num_ders - k, line_ders.data());
+					for (int l = 0; l <= dv; l++)
+					{
+						homo_ders[k * stride + l] = line_ders[l];
+					}
+				}
+
+				// Compute rational derivatives
+				auto A = [&](int k, int l) { return homo_ders[k * stride + l]; };
+				auto S = [&](int k, int l) -> Vec3& { return ders[k * stride + l]; };
+				for (int k = 0; k <= num_ders; k++)
+				{
+					for (int l = 0; l <= num_ders - k; l++)
+					{
+						Vec3 der = A(k, l).template head<3>();
+						for (int j = 1; j <= l; j++)
+						{
+							der -= binomial(l, j) * A(0, j).w() * S(k, l - j);
+						}
+						for (int i = 1; i <= k; i++)
+						{
+							der -= binomial(k, i) * A(i, 0).w() * S(k - i, l);
+							Vec3 tmp = Vec3::Zero();
+							for (int j = 1; j <= l; j++)
+							{
+								tmp += binomial(l, j) * A(i, j).w() * S(k - i, l - j);
+							}
+							der -= binomial(k, i) * tmp;
+						}
+						S(k, l) = der / A(0, 0).w();
+					}
+				}
+			}
+
+			/**
+			 * Bounding box of Bezier patches refined on their control hulls, the surface counterpart
+			 * of bezier_bounds. The corners of every piece lie on the surface and span the inner box,
+			 * pieces sticking out of it by more than the tolerance are bisected alternately in u and v.
+			 * @param[in] patches Bezier patches of the surface
+			 * @param[in] tolerance Absolute tolerance of the box
+			 * @return Bounding box, empty if there are no patches.
+			 */
+			inline AABB3 bezier_bounds(const BezierPatches& patches, scalar tolerance)
+			{
+				const size_t pu = patches.degree_u;
+				const size_t pv = patches.degree_v;
+				const size_t count = patches.stride();
+				AABB3 inner, outer;
+				auto extend_corners = [&](const vec4* cw)
+				{
+					inner.extend(homogenous_to_cartesian(cw[0]));
+					inner.extend(homogenous_to_cartesian(cw[pv]));
+					inner.extend(homogenous_to_cartesian(cw[pu * (pv + 1)]));
+					inner.extend(homogenous_to_cartesian(cw[count - 1]));
+				};
+				for (size_t s = 0; s < patches.size_u(); s++)
+				{
+					for (size_t t = 0; t < patches.size_v(); t++)
+					{
+						extend_corners(patches.patch(s, t));
+					}
+				}
+
+				struct Piece
+				{
+					std::array<vec4, (N_MAX_DEGREE + 1) * (N_MAX_DEGREE + 1)> cw;
+					int depth;
+				};
+				std::vector<Piece> stack;
+				std::array<vec4, N_MAX_DEGREE + 1> line, left_line, right_line;
+				for (size_t s = 0; s < patches.size_u(); s++)
+				{
+					for (size_t t = 0; t < patches.size_v(); t++)
+					{
+						stack.emplace_back();
+						std::copy_n(patches.patch(s, t), count, stack.back().cw.begin());
+						stack.back().depth = 0;
+						while (!stack.empty())
+						{
+							Piece top = stack.back();
+							stack.pop_back();
+							AABB3 hull;
+							bool positive = internal::bezier_hull_box(top.cw.data(), count, hull);
+							AABB3 accept(inner.min() - vec3::Constant(tolerance), inner.max() + vec3::Constant(tolerance));
+							if ((positive && accept.contains(hull)) || top.depth >= N_MAX_BOUNDS_DEPTH)
+							{
+								if (positive)
+								{
+									outer.extend(hull);
+								}
+								else
+								{
+									outer.extend(homogenous_to_cartesian(top.cw[0]));
+									outer.extend(homogenous_to_cartesian(top.cw[count - 1]));
+								}
+								continue;
+							}
+							Piece left, right;
+							left.depth = right.depth = top.depth + 1;
+							if (top.depth % 2 == 0)
+							{
+								// Split every column along u
+								for (size_t l = 0; l <= pv; l++)
+								{
+									for (size_t k = 0; k <= pu; k++)
+									{
+										line[k] = top.cw[k * (pv + 1) + l];
+									}
+									bezier_split(line.data(), pu, 0.5f, left_line.data(), right_line.data());
+									for (size_t k = 0; k <= pu; k++)
+									{
+										left.cw[k * (pv + 1) + l] = left_line[k];
+										right.cw[k * (pv + 1) + l] = right_line[k];
+									}
+								}
+							}
+							else
+							{
+								// Split every row along v
+								for (size_t k = 0; k <= pu; k++)
+								{
+									bezier_split(top.cw.data() + k * (pv + 1), pv, 0.5f, left.cw.data() + k * (pv + 1), right.cw.data() + k * (pv + 1));
+								}
+							}
+							extend_corners(right.cw.data());
+							stack.push_back(right);
+							stack.push_back(left);
+						}
+					}
+				}
+				return outer;
+			}
+
+			template<typename Real>
+			inline const AABB3& BasicSurfaceEvaluator<Real>::bounds() const
+			{
+				static const AABB3 empty;
+				if (!m_valid)
+				{
+					return empty;
+				}
+				std::call_once(m_bounds->once,
+					[this]()
+					{
+						if constexpr (std::is_same_v<Real, scalar>)
+						{
+							const scalar tolerance = N_BOUNDS_RELATIVE_TOLERANCE * internal::control_box(m_cw.flat()).diagonal().norm();
+							m_bounds->box = bezier_bounds(decompose_surface(*this), tolerance);
+						}
+						else
+						{
+							m_bounds->box = SurfaceEvaluator(*this).bounds();
+						}
+					});
+				return m_bounds->box;
+			}
+
+			/**
+			 * Evaluate point on a non-rational NURBS surface
+			 * @param[in] srf RationalSurface object
+			 * @param[in] u Parameter to evaluate the surface at.
+			 * @param[in] v Parameter to evaluate the surface at.
+			 * @return Resulting point on the surface at (u, v).
+			 */
+			inline vec3 surface_point(const RationalSurface& srf, scalar u, scalar v) { return SurfaceEvaluator(srf).point(u, v); }
+
 			/**
 			 * Evaluate derivatives on a non-rational NURBS surface
 			 * @param[in] degree_u Degree of the given surface in u-direction.
@@ -296,55 +794,13 @@ namespace Geomerty
 				{
 					return std::vector<std::vector<vec3>>{};
 				}
-				std::vector<std::vector<vec4>> homo_cp(srf.m_control_points.size(), std::vector<vec4>(srf.m_control_points[0].size()));
-				for (int i = 0; i < srf.m_control_points.size(); i++)
+				NurbsWorkspace workspace;
+				std::span<vec3> ders = workspace.scratch<vec3>(0, (num_ders + 1) * (num_ders + 1));
+				SurfaceEvaluator(srf).derivatives(num_ders, u, v, ders, workspace);
+				std::vector<std::vector<vec3>> surf_ders(num_ders + 1);
+				for (int k = 0; k <= num_ders; k++)
 				{
-					for (int j = 0; j < srf.m_control_points[0].size(); j++)
-					{
-						homo_cp[i][j] = cartesian_to_homogenous(srf.m_control_points[i][j], srf.m_weights[i][j]);
-					}
-				}
-
-				std::vector<std::vector<vec4>> homo_ders = surface_derivatives(srf.m_degree_u, srf.m_degree_v, srf.m_knots_u, srf.m_knots_v, homo_cp, num_ders, u, v);
-
-				std::vector<std::vector<vec3>> aders(num_ders + 1, std::vector<vec3>(num_ders + 1));
-
-				for (int i = 0; i < homo_ders.size(); i++)
-				{
-					for (int j = 0; j < homo_ders[0].size(); j++)
-					{
-						aders[i][j] = homo_ders[i][j].head<3>();
-					}
-				}
-
-				std::vector<std::vector<vec3>> surf_ders(num_ders + 1, std::vector<vec3>(num_ders + 1));
-				for (int k = 0; k < num_ders + 1; k++)
-				{
-					for (int l = 0; l < num_ders - k + 1; l++)
-					{
-						vec3 der = aders[k][l];
-
-						for (int j = 1; j < l + 1; j++)
-						{
-							der -= binomial(l, j) * homo_ders[0][j].w() * surf_ders[k][l - j];
-						}
-
-						for (int i = 1; i < k + 1; i++)
-						{
-							der -= binomial(k, i) * homo_ders[i][0].w() * surf_ders[k - i][l];
-
-							vec3 tmp = vec3::Zero();
-							for (int j = 0; j < l + 1; j++)
-							{
-								tmp -= binomial(l, j) * homo_ders[i][j].w() * surf_ders[k - 1][l - j];
-							}
-
-							der -= binomial(k, i) * tmp;
-						}
-
-						der *= 1 / homo_ders[0][0].w();
-						surf_ders[k][l] = der;
-					}
+					surf_ders[k].assign(ders.begin() + k * (num_ders + 1), ders.begin() + (k + 1) * (num_ders + 1));
 				}
 				return surf_ders;
 			}
@@ -402,6 +858,49 @@ namespace Geomerty
 				}
 				return n;
 			}
+			/**
+			 * Insert knots in the surface along one direction without allocating
+			 * @param[in] degree Degree of the surface along which to insert knot
+			 * @param[in] knots Knot vector
+			 * @param[in] cp Flat control net, point (i, j) is cp[i * cols + j] with i along u.
+			 * @param[in] rows Number of control points along u
+			 * @param[in] cols Number of control points along v
+			 * @param[in] knot Knot value to insert
+			 * @param[in] r Number of times to insert
+			 * @param[in] along_u Whether inserting along u-direction
+			 * @param[out] new_knots Updated knot vector, knots.size() + knot_insert_count(degree, knots, knot, r) entries.
+			 * @param[out] new_cp Updated flat control net with knot_insert_count(degree, knots, knot, r) more rows or columns.
+			 * @return Number of knots inserted
+			 */
+			template<typename T>
+			inline size_t surface_knot_insert(size_t degree, const std::vector<scalar>& knots, std::span<const T> cp, size_t rows, size_t cols, scalar knot, size_t r,
+				bool along_u, std::span<scalar> new_knots, std::span<T> new_cp)
+			{
+				const int span = find_span(degree, knots, knot);
+				const size_t s = knot_multiplicity(knots, knot);
+				r = knot_insert_count(degree, knots, knot, r);
+				internal::InsertAlphas alpha;
+				internal::knot_insert_alphas(degree, knots, knot, span, s, r, alpha);
+				internal::knot_insert_knots(knots, knot, span, r, new_knots.data());
+				if (along_u)
+				{
+					// Each column is a curve along u
+					for (size_t col = 0; col < cols; col++)
+					{
+						internal::knot_insert_polygon(degree, span, s, r, alpha, cp.data() + col, rows, cols, new_cp.data() + col, cols);
+					}
+				}
+				else
+				{
+					// Each row is a curve along v
+					for (size_t row = 0; row < rows; row++)
+					{
+						internal::knot_insert_polygon(degree, span, s, r, alpha, cp.data() + row * cols, cols, 1, new_cp.data() + row * (cols + r), 1);
+					}
+				}
+				return r;
+			}
+
 			/**
 			 * Insert knots in the surface along one direction
 			 * @param[in] degree Degree of the surface along which to insert knot
@@ -414,148 +913,93 @@ namespace Geomerty
 			 * @param[out] new_cp Updated control points
 			 */
 			template<typename T>
-			inline void surface_knot_insert(size_t degree, const std::vector<scalar>& knots, const std::vector<std::vector<T>>& cp, scalar knot, size_t r, bool along_u,
-				std::vector<scalar>& new_knots, std::vector<std::vector<T>>& new_cp)
+			inline void surface_knot_insert(size_t degree, const std::vector<scalar>& knots, const Array2<T>& cp, scalar knot, size_t r, bool along_u,
+				std::vector<scalar>& new_knots, Array2<T>& new_cp)
 			{
-
-				int span = find_span(degree, knots, knot);
-				size_t s = knot_multiplicity(knots, knot);
 				// Knot multiplicity cannot be greater than degree
-				if (s > degree)
+				if (knot_multiplicity(knots, knot) > degree)
 				{
 					return;
 				}
-				if (s == degree)
-				{
-					new_cp = cp;
-					new_knots = knots;
-					return;
-				}
-				if ((r + s) > degree)
-				{
-					r = degree - s;
-				}
-
-				// Create a new knot vector
+				const size_t rows = cp.rows();
+				const size_t cols = cp.cols();
+				r = knot_insert_count(degree, knots, knot, r);
+				new_cp.assign(along_u ? rows + r : rows, along_u ? cols : cols + r);
 				new_knots.resize(knots.size() + r);
-				for (auto i : IndexRange(span + 1))
-				{
-					new_knots[i] = knots[i];
-				}
-				for (auto i : IndexRange<size_t>(1, r + 1))
+				surface_knot_insert(degree, knots, cp.flat(), rows, cols, knot, r, along_u, std::span<scalar>(new_knots), new_cp.flat());
+			}
+
+			/**
+			 * Split the surface into two along given parameter direction without allocating
+			 * @param[in] degree Degree of surface along given direction
+			 * @param[in] knots Knot vector of surface along given direction
+			 * @param[in] control_points Flat control net, point (i, j) is control_points[i * cols + j] with i along u.
+			 * @param[in] rows Number of control points along u
+			 * @param[in] cols Number of control points along v
+			 * @param[in] param Parameter to split surface
+			 * @param[in] along_u Whether the direction to split along is the u-direction
+			 * @param[out] left_knots Knots of the left part of the surface
+			 * @param[out] left_control_points Flat control net of the left part of the surface
+			 * @param[out] right_knots Knots of the right part of the surface
+			 * @param[out] right_control_points Flat control net of the right part of the surface
+			 * @param[in,out] workspace Scratch memory
+			 * Along the split direction the parts have the sizes given by curve_split_sizes, their knots degree + 1 more.
+			 * @return false if param is not inside the domain, the outputs are untouched then.
+			 */
+			template<typename T>
+			inline bool surface_split(size_t degree, const std::vector<scalar>& knots, std::span<const T> control_points, size_t rows, size_t cols, scalar param,
+				bool along_u, std::span<scalar> left_knots, std::span<T> left_control_points, std::span<scalar> right_knots, std::span<T> right_control_points,
+				NurbsWorkspace& workspace)
+			{
+				const auto [left_count, right_count] = curve_split_sizes(degree, knots, param);
+				if (left_count == 0)
 				{
-					new_knots[span + i] = knot;
+					return false;
 				}
-				for (auto i : IndexRange<size_t>(span + 1, knots.size()))
+				// Insert param until its multiplicity equals the degree
+				const int span = find_span(degree, knots, param);
+				const size_t s = knot_multiplicity(knots, param);
+				const size_t r = degree - s;
+				const size_t count = along_u ? rows : cols;
+				// Curves along the split direction, count + r points each
+				const size_t lines = along_u ? cols : rows;
+				const size_t line_stride = along_u ? 1 : cols;
+				const size_t point_stride = along_u ? cols : 1;
+				internal::InsertAlphas alpha;
+				internal::knot_insert_alphas(degree, knots, param, span, s, r, alpha);
+				std::span<T> tmp_cp = workspace.scratch<T>(0, (count + r) * lines);
+				for (size_t line = 0; line < lines; line++)
 				{
-					new_knots[i + r] = knots[i];
+					internal::knot_insert_polygon(degree, span, s, r, alpha, control_points.data() + line * line_stride, count, point_stride,
+						tmp_cp.data() + line * (count + r), 1);
 				}
-				// Compute alpha
-				std::vector<std::vector<scalar>> alpha(degree - s, std::vector<scalar>(r + 1, 0.0f));
-				for (auto j : IndexRange<size_t>(1, r + 1))
-				{
-					int L = span - degree + j;
-					for (auto i : IndexRange(degree - j - s + 1))
-					{
-						alpha[i][j] = (knot - knots[L + i]) / (knots[i + span + 1] - knots[L + i]);
-					}
-				}
-
-				// Create a temporary container for affected control points per row/column
-				std::vector<T> tmp(degree + 1);
-
-				if (along_u)
-				{
-
-					// Create new control points with additional rows
-					new_cp = std::vector<std::vector<T>>(cp.size() + r, std::vector<T>(cp[0].size()));
 
-					// Update control points
-					// Each row is a u-isocurve, each col is a v-isocurve
-					for (auto col : IndexRange(cp[0].size()))
-					{
-
-						// Copy unaffected control points
-						for (auto i : IndexRange(span - degree + 1))
-						{
-							new_cp[i][col] = cp[i][col];
-						}
-						for (auto i : IndexRange(span - s, cp.size()))
-						{
-							new_cp[i + r][col] = cp[i][col];
-						}
-						// Copy affected control points to temp array
-						for (auto i : IndexRange(degree - s + 1))
-						{
-							tmp[i] = cp[span - degree + i][col];
-						}
-						// Insert knot
-						for (auto j : IndexRange<size_t>(1, r + 1))
-						{
-							int L = span - degree + j;
-							for (auto i : IndexRange(degree - j - s + 1))
-							{
-								scalar a = alpha[i][j];
-								tmp[i] = (1 - a) * tmp[i] + a * tmp[i + 1];
-							}
-							new_cp[L][col] = tmp[0];
-							new_cp[span + r - j - s][col] = tmp[degree - j - s];
-						}
-						int L = span - degree + r;
-						for (auto i : IndexRange<size_t>(L + 1, span - s))
-						{
-							new_cp[i][col] = tmp[i - L];
-						}
-					}
-				}
-				else
+				// Both parts are clamped at param
+				std::copy(knots.begin(), knots.begin() + span + 1, left_knots.begin());
+				std::fill_n(left_knots.begin() + span + 1, r + 1, param);
+				std::fill_n(right_knots.begin(), degree + 1, param);
+				std::copy(knots.begin() + span + 1, knots.end(), right_knots.begin() + degree + 1);
+				auto scatter = [&](size_t first, size_t size, std::span<T> part)
 				{
-					// Create new control points with additional columns
-					new_cp = std::vector<std::vector<T>>(cp.size(), std::vector<T>(cp[0].size() + r));
-					// Update control points
-					// Each row is a u-isocurve, each col is a v-isocurve
-					for (auto row : IndexRange(cp.size()))
+					for (size_t line = 0; line < lines; line++)
 					{
-						// Copy unaffected control points
-						for (auto i : IndexRange(span - degree + 1))
-						{
-							new_cp[row][i] = cp[row][i];
-						}
-						for (auto i : IndexRange(span - s, cp[0].size()))
+						const T* curve = tmp_cp.data() + line * (count + r) + first;
+						for (size_t i = 0; i < size; i++)
 						{
-							new_cp[row][i + r] = cp[row][i];
-						}
-						// Copy affected control points to temp array
-						for (auto i : IndexRange(degree - s + 1))
-						{
-							tmp[i] = cp[row][span - degree + i];
-						}
-						// Insert knot
-						for (auto j : IndexRange<size_t>(1, r + 1))
-						{
-							int L = span - degree + j;
-							for (auto i : IndexRange(degree - j - s + 1))
-							{
-								scalar a = alpha[i][j];
-								tmp[i] = (1 - a) * tmp[i] + a * tmp[i + 1];
-							}
-							new_cp[row][L] = tmp[0];
-							new_cp[row][span + r - j - s] = tmp[degree - j - s];
-						}
-						int L = span - degree + r;
-						for (auto i : IndexRange<size_t>(L + 1, span - s))
-						{
-							new_cp[row][i] = tmp[i - L];
+							part[along_u ? i * cols + line : line * size + i] = curve[i];
 						}
 					}
-				}
+				};
+				scatter(0, left_count, left_control_points);
+				scatter(left_count - 1, right_count, right_control_points);
+				return true;
 			}
 
 			/**
 			 * Split the surface into two along given parameter direction
 			 * @param[in] degree Degree of surface along given direction
 			 * @param[in] knots Knot vector of surface along given direction
-			 * @param[in] control_points std::vector of control points
+			 * @param[in] control_points 2D array of control points
 			 * @param[in] param Parameter to split curve
 			 * @param[in] along_u Whether the direction to split along is the u-direction
 			 * @param[out] left_knots Knots of the left part of the curve
@@ -564,83 +1008,166 @@ namespace Geomerty
 			 * @param[out] right_control_points Control points of the right part of the curve
 			 */
 			template<typename T>
-			inline void surface_split(size_t degree, const std::vector<scalar>& knots, const std::vector<std::vector<T>>& control_points, scalar param, bool along_u,
-				std::vector<scalar>& left_knots, std::vector<std::vector<T>>& left_control_points, std::vector<scalar>& right_knots,
-				std::vector<std::vector<T>>& right_control_points)
+			inline void surface_split(size_t degree, const std::vector<scalar>& knots, const Array2<T>& control_points, scalar param, bool along_u,
+				std::vector<scalar>& left_knots, Array2<T>& left_control_points, std::vector<scalar>& right_knots, Array2<T>& right_control_points)
 			{
-				std::vector<scalar> tmp_knots;
-				std::vector<std::vector<T>> tmp_cp;
-
-				int span = find_span(degree, knots, param);
-				size_t r = degree - knot_multiplicity(knots, param);
-				surface_knot_insert(degree, knots, control_points, param, r, along_u, tmp_knots, tmp_cp);
-
-				left_knots.clear();
-				right_knots.clear();
-
-				int span_l = find_span(degree, tmp_knots, param) + 1;
-				for (auto i : IndexRange(span_l))
+				const auto [left_count, right_count] = curve_split_sizes(degree, knots, param);
+				if (left_count == 0)
 				{
-					left_knots.push_back(tmp_knots[i]);
+					return;
 				}
-				left_knots.push_back(param);
+				const size_t rows = control_points.rows();
+				const size_t cols = control_points.cols();
+				left_control_points.assign(along_u ? left_count : rows, along_u ? cols : left_count);
+				right_control_points.assign(along_u ? right_count : rows, along_u ? cols : right_count);
+				left_knots.resize(left_count + degree + 1);
+				right_knots.resize(right_count + degree + 1);
+				NurbsWorkspace workspace;
+				surface_split(degree, knots, control_points.flat(), rows, cols, param, along_u, std::span<scalar>(left_knots), left_control_points.flat(),
+					std::span<scalar>(right_knots), right_control_points.flat(), workspace);
+			}
 
-				for (auto i : IndexRange(degree + 1))
+			/**
+			 * Insert a list of knots in the surface along one direction in one pass (Piegl & Tiller A5.5)
+			 * @param[in] degree Degree of the surface along which to insert the knots
+			 * @param[in] knots Knot vector
+			 * @param[in] cp 2D array of control points
+			 * @param[in] X Knots to insert, ascending and inside the domain of the surface.
+			 * @param[in] along_u Whether inserting along u-direction
+			 * @param[out] new_knots Updated knot vector
+			 * @param[out] new_cp Updated control points
+			 */
+			template<typename T>
+			inline void surface_knot_refine(size_t degree, const std::vector<scalar>& knots, const Array2<T>& cp, const std::vector<scalar>& X, bool along_u,
+				std::vector<scalar>& new_knots, Array2<T>& new_cp)
+			{
+				// The refined direction runs along the rows of the flat net, the other one along its columns
+				const Array2<T> transposed = along_u ? Array2<T>() : cp.transposed();
+				const Array2<T>& net = along_u ? cp : transposed;
+				std::vector<T> new_net;
+				internal::knot_refine_columns(degree, knots, std::vector<T>(net.begin(), net.end()), net.cols(), X, new_knots, new_net);
+
+				Array2<T> refined(net.rows() + X.size(), net.cols());
+				std::copy(new_net.begin(), new_net.end(), refined.begin());
+				if (along_u)
 				{
-					right_knots.push_back(param);
+					new_cp.swap(refined);
 				}
-				for (auto i : IndexRange<size_t>(span_l, tmp_knots.size()))
+				else
 				{
-					right_knots.push_back(tmp_knots[i]);
+					new_cp = refined.transposed();
 				}
+			}
 
-				int ks = span - degree + 1;
+			/**
+			 * Insert a list of knots in the rational surface along one direction in one pass
+			 * @param[in] srf RationalSurface object
+			 * @param[in] X Knots to insert, ascending and inside the domain of the surface.
+			 * @param[in] along_u Whether inserting along u-direction
+			 * @return New RationalSurface object after knot refinement
+			 */
+			inline RationalSurface surface_knot_refine(const RationalSurface& srf, const std::vector<scalar>& X, bool along_u)
+			{
+				if (!surface_is_valid(srf))
+				{
+					return RationalSurface();
+				}
+				RationalSurface new_srf;
+				new_srf.m_degree_u = srf.m_degree_u;
+				new_srf.m_degree_v = srf.m_degree_v;
+				new_srf.m_knots_u = srf.m_knots_u;
+				new_srf.m_knots_v = srf.m_knots_v;
+
+				// Original control points in homogenous coordinates
+				const Array2<vec4> Cw = srf.homogenous_points();
+
+				Array2<vec4> new_Cw;
 				if (along_u)
 				{
-					size_t ii = 0;
-					left_control_points = std::vector<std::vector<T>>(ks + r, std::vector<T>(tmp_cp[0].size()));
-					for (auto i : IndexRange(ks + r))
-					{
-						for (auto j : IndexRange(tmp_cp[0].size()))
-						{
-							left_control_points[ii / tmp_cp[0].size()][ii % tmp_cp[0].size()] = tmp_cp[i][j];
-							ii++;
-						}
-					}
-					ii = 0;
-					right_control_points = std::vector<std::vector<T>>(tmp_cp.size() - ks - r + 1, std::vector<T>(tmp_cp[0].size()));
-					for (auto i : IndexRange(ks + r - 1, tmp_cp.size()))
-					{
-						for (int j = 0; j < tmp_cp[0].size(); ++j)
-						{
-							right_control_points[ii / tmp_cp[0].size()][ii % tmp_cp[0].size()] = tmp_cp[i][j];
-							ii++;
-						}
-					}
+					surface_knot_refine(srf.m_degree_u, srf.m_knots_u, Cw, X, true, new_srf.m_knots_u, new_Cw);
 				}
 				else
 				{
-					size_t ii = 0;
-					left_control_points = std::vector<std::vector<T>>(tmp_cp.size(), std::vector<T>(ks + r));
-					for (auto i : IndexRange(tmp_cp.size()))
+					surface_knot_refine(srf.m_degree_v, srf.m_knots_v, Cw, X, false, new_srf.m_knots_v, new_Cw);
+				}
+
+				// Convert back to cartesian coordinates
+				new_srf.set_homogenous_points(new_Cw);
+				return new_srf;
+			}
+			inline RationalSurface surface_knot_refine_u(const RationalSurface& srf, const std::vector<scalar>& X) { return surface_knot_refine(srf, X, true); }
+			inline RationalSurface surface_knot_refine_v(const RationalSurface& srf, const std::vector<scalar>& X) { return surface_knot_refine(srf, X, false); }
+
+			/**
+			 * Remove as many knots of the surface as possible, along u first and then along v, while it
+			 * stays within a distance of the original. The deviation bound is tracked per pair of spans,
+			 * so removals along v only spend what removals along u left over at the same place.
+			 * @param[in] srf RationalSurface object
+			 * @param[in] tolerance Maximum distance between the original and the reduced surface
+			 * @return Reduced RationalSurface object and an upper bound of its distance to the original,
+			 * the original surface and 0 if the surface is invalid.
+			 */
+			inline std::tuple<RationalSurface, scalar> remove_knots(const RationalSurface& srf, scalar tolerance)
+			{
+				const size_t degree_u = srf.m_degree_u;
+				const size_t degree_v = srf.m_degree_v;
+				if (!surface_is_valid(srf) || degree_u < 1 || degree_v < 1 || degree_u > N_MAX_DEGREE || degree_v > N_MAX_DEGREE || !(tolerance > 0.0f))
+				{
+					return std::make_tuple(srf, 0.0f);
+				}
+				size_t rows = srf.m_control_points.rows();
+				size_t cols = srf.m_control_points.cols();
+				const Array2<vec4> cw = srf.homogenous_points();
+				std::vector<vec4> net(cw.begin(), cw.end());
+				scalar max_norm = 0.0f;
+				for (const vec3& point : srf.m_control_points)
+				{
+					max_norm = std::max(max_norm, point.norm());
+				}
+				const auto [min_weight, max_weight] = std::minmax_element(srf.m_weights.begin(), srf.m_weights.end());
+				const scalar factor = internal::homogenous_tolerance(1.0f, *min_weight, *max_weight, max_norm);
+
+				RationalSurface result;
+				result.m_degree_u = degree_u;
+				result.m_degree_v = degree_v;
+				result.m_knots_u = srf.m_knots_u;
+				result.m_knots_v = srf.m_knots_v;
+
+				// Along u, errors[k * spans_v + x] bounds the deviation over span k along u and span x along v
+				size_t spans_u = result.m_knots_u.size() - 1;
+				const size_t spans_v = result.m_knots_v.size() - 1;
+				std::vector<scalar> errors(spans_u * spans_v, 0.0f);
+				internal::remove_knots_columns(degree_u, result.m_knots_u, net, cols, errors, spans_v,
+					[&](size_t j) { return std::make_pair(j, j + degree_v + 1); }, tolerance * factor);
+				rows = net.size() / cols;
+				spans_u = result.m_knots_u.size() - 1;
+
+				// Along v the net and the errors are transposed
+				std::vector<vec4> transposed(net.size());
+				for (size_t i = 0; i < rows; i++)
+				{
+					for (size_t j = 0; j < cols; j++)
 					{
-						for (auto j : IndexRange(ks + r))
-						{
-							left_control_points[ii / (ks + r)][ii % (ks + r)] = tmp_cp[i][j];
-							ii++;
-						}
+						transposed[j * rows + i] = net[i * cols + j];
 					}
-					ii = 0;
-					right_control_points = std::vector<std::vector<T>>(tmp_cp.size(), std::vector<T>(tmp_cp[0].size() - ks - r + 1));
-					for (auto i : IndexRange(tmp_cp.size()))
+				}
+				std::vector<scalar> transposed_errors(errors.size());
+				for (size_t k = 0; k < spans_u; k++)
+				{
+					for (size_t x = 0; x < spans_v; x++)
 					{
-						for (auto j : IndexRange(ks + r - 1, tmp_cp[0].size()))
-						{
-							right_control_points[ii / (tmp_cp[0].size() - ks - r + 1)][ii % (tmp_cp[0].size() - ks - r + 1)] = tmp_cp[i][j];
-							ii++;
-						}
+						transposed_errors[x * spans_u + k] = errors[k * spans_v + x];
 					}
 				}
+				internal::remove_knots_columns(degree_v, result.m_knots_v, transposed, rows, transposed_errors, spans_u,
+					[&](size_t i) { return std::make_pair(i, i + degree_u + 1); }, tolerance * factor);
+				cols = transposed.size() / rows;
+
+				Array2<vec4> reduced(cols, rows);
+				std::copy(transposed.begin(), transposed.end(), reduced.begin());
+				result.set_homogenous_points(reduced.transposed());
+				const scalar error = *std::max_element(transposed_errors.begin(), transposed_errors.end()) / factor;
+				return std::make_tuple(std::move(result), error);
 			}
 
 			/**
@@ -662,31 +1189,15 @@ namespace Geomerty
 				new_srf.m_knots_v = srf.m_knots_v;
 
 				// Original control points in homogenous coordinates
-				std::vector<std::vector<vec4>> Cw = std::vector<std::vector<vec4>>(srf.m_control_points.size(), std::vector<vec4>(srf.m_control_points[0].size()));
-				for (int i = 0; i < srf.m_control_points.size(); i++)
-				{
-					for (int j = 0; j < srf.m_control_points[0].size(); j++)
-					{
-						Cw[i][j] = cartesian_to_homogenous(srf.m_control_points[i][j], srf.m_weights[i][j]);
-					}
-				}
+				const Array2<vec4> Cw = srf.homogenous_points();
 
 				// New knots and new homogenous control points after knot insertion
 				std::vector<scalar> new_knots_u;
-				std::vector<std::vector<vec4>> new_Cw;
+				Array2<vec4> new_Cw;
 				surface_knot_insert(srf.m_degree_u, srf.m_knots_u, Cw, u, repeat, true, new_srf.m_knots_u, new_Cw);
 
 				// Convert back to cartesian coordinates
-				new_srf.m_control_points = std::vector<std::vector<vec3>>(new_Cw.size(), std::vector<vec3>(new_Cw[0].size()));
-				new_srf.m_weights = std::vector<std::vector<scalar>>(new_Cw.size(), std::vector<scalar>(new_Cw[0].size()));
-				for (int i = 0; i < new_Cw.size(); i++)
-				{
-					for (int j = 0; j < new_Cw[0].size(); j++)
-					{
-						new_srf.m_control_points[i][j] = homogenous_to_cartesian(new_Cw[i][j]);
-						new_srf.m_weights[i][j] = new_Cw[i][j].w();
-					}
-				}
+				new_srf.set_homogenous_points(new_Cw);
 				return new_srf;
 			}
 
@@ -705,31 +1216,15 @@ namespace Geomerty
 				new_srf.m_degree_v = srf.m_degree_v;
 				new_srf.m_knots_u = srf.m_knots_u;
 				// Original control points in homogenous coordinates
-				std::vector<std::vector<vec4>> Cw = std::vector<std::vector<vec4>>(srf.m_control_points.size(), std::vector<vec4>(srf.m_control_points[0].size()));
-				for (int i = 0; i < srf.m_control_points.size(); i++)
-				{
-					for (int j = 0; j < srf.m_control_points[0].size(); j++)
-					{
-						Cw[i][j] = cartesian_to_homogenous(srf.m_control_points[i][j], srf.m_weights[i][j]);
-					}
-				}
+				const Array2<vec4> Cw = srf.homogenous_points();
 
 				// New knots and new homogenous control points after knot insertion
 				std::vector<scalar> new_knots_v;
-				std::vector<std::vector<vec4>> new_Cw;
+				Array2<vec4> new_Cw;
 				surface_knot_insert(srf.m_degree_v, srf.m_knots_v, Cw, v, repeat, false, new_srf.m_knots_v, new_Cw);
 
 				// Convert back to cartesian coordinates
-				new_srf.m_control_points = std::vector<std::vector<vec3>>(new_Cw.size(), std::vector<vec3>(new_Cw[0].size()));
-				new_srf.m_weights = std::vector<std::vector<scalar>>(new_Cw.size(), std::vector<scalar>(new_Cw[0].size()));
-				for (int i = 0; i < new_Cw.size(); i++)
-				{
-					for (int j = 0; j < new_Cw[0].size(); j++)
-					{
-						new_srf.m_control_points[i][j] = homogenous_to_cartesian(new_Cw[i][j]);
-						new_srf.m_weights[i][j] = new_Cw[i][j].w();
-					}
-				}
+				new_srf.set_homogenous_points(new_Cw);
 				return new_srf;
 			}
 
@@ -751,14 +1246,14 @@ namespace Geomerty
 				right.m_knots_v = srf.m_knots_v;
 
 				// Compute homogenous coordinates of control points and weights
-				std::vector<std::vector<vec4>> Cw = cartesian_to_homogenous(srf.m_control_points, srf.m_weights);
+				const Array2<vec4> Cw = srf.homogenous_points();
 
 				// Split surface with homogenous coordinates
-				std::vector<std::vector<vec4>> left_Cw, right_Cw;
+				Array2<vec4> left_Cw, right_Cw;
 				surface_split(srf.m_degree_u, srf.m_knots_u, Cw, u, true, left.m_knots_u, left_Cw, right.m_knots_u, right_Cw);
 
-				homogenous_to_cartesian(left_Cw, left.m_control_points, left.m_weights);
-				homogenous_to_cartesian(right_Cw, right.m_control_points, right.m_weights);
+				left.set_homogenous_points(left_Cw);
+				right.set_homogenous_points(right_Cw);
 
 				return std::tuple<RationalSurface, RationalSurface>(std::move(left), std::move(right));
 			}
@@ -781,82 +1276,74 @@ namespace Geomerty
 				right.m_knots_u = srf.m_knots_u;
 
 				// Compute homogenous coordinates of control points and weights
-				std::vector<std::vector<vec4>> Cw = cartesian_to_homogenous(srf.m_control_points, srf.m_weights);
+				const Array2<vec4> Cw = srf.homogenous_points();
 
 				// Split surface with homogenous coordinates
-				std::vector<std::vector<vec4>> left_Cw, right_Cw;
+				Array2<vec4> left_Cw, right_Cw;
 				surface_split(srf.m_degree_v, srf.m_knots_v, Cw, v, false, left.m_knots_v, left_Cw, right.m_knots_v, right_Cw);
 
 				// Convert back to cartesian coordinates
-				homogenous_to_cartesian(left_Cw, left.m_control_points, left.m_weights);
-				homogenous_to_cartesian(right_Cw, right.m_control_points, right.m_weights);
+				left.set_homogenous_points(left_Cw);
+				right.set_homogenous_points(right_Cw);
 
 				return std::tuple<RationalSurface, RationalSurface>(std::move(left), std::move(right));
 			}
 
 			/**
-			 * Approximate a group of points with nubrs
-			 * @param[in] through_points a group of points
+			 * Approximate a grid of points with a non-rational surface in the least squares sense (Piegl & Tiller 9.4.3).
+			 * The columns are fitted along u, then the rows of the result along v. Every column shares one factorised
+			 * normal matrix in u and every row one in v.
+			 * @param[in] through_points Grid of points, through_points[i][j] is fitted at (uk[i], vl[j]).
 			 * @param degree_u degree Parameter in the u-direction
 			 * @param degree_v degree Parameter in the v-direction
-			 * @param control_points_rows rows in the u-direction
-			 * @param control_points_columns cols in the v-direction
-			 * @param[out] surface RationalSurface
+			 * @param control_points_rows rows in the u-direction, at most through_points.size()
+			 * @param control_points_columns cols in the v-direction, at most through_points[0].size()
+			 * @param[out] surface RationalSurface, unchanged on failure.
+			 * @return false if the grid cannot be approximated with that many control points.
 			 */
 			inline bool global_approximation(const std::vector<std::vector<vec3>>& through_points, int degree_u, int degree_v, int control_points_rows,
 				int control_points_columns, RationalSurface& surface)
 			{
-				int rows = control_points_rows;
-				int n = rows - 1;
-				int columns = control_points_columns;
-				int m = columns - 1;
-
-				std::vector<scalar> knot_vector_u;
-				std::vector<scalar> knot_vector_v;
-
-				Eigen::Matrix<vec3, -1, -1> temp_row_control_points(rows, columns);
-				for (int i = 0; i < rows; i++)
+				std::vector<scalar> uk;
+				std::vector<scalar> vl;
+				if (through_points.empty() || !get_surfacemesh_parameterization(through_points, uk, vl))
 				{
-					RationalCurve tc;
-					bool result = least_square_approximation(degree_u, through_points[i], columns, tc);
-					if (!result)
-						return false;
-					temp_row_control_points.row(i) = Eigen::Matrix<vec3, -1, 1>::Map(tc.m_control_points.data(), tc.m_control_points.size());
-					knot_vector_u = tc.m_knots;
+					return false;
 				}
 
-				Eigen::Matrix<vec3, -1, -1> temp_col_cpoints(rows, columns);
-				for (int i = 0; i < columns; i++)
-				{
-					auto col_i = temp_row_control_points.col(i);
-					RationalCurve tc;
-					bool result = least_square_approximation(degree_v, std::vector<vec3>{ col_i.begin(), col_i.end() }, rows, tc);
-					if (!result)
-						return false;
-					temp_col_cpoints.col(i) = Eigen::Matrix<vec3, 1, -1>::Map(tc.m_control_points.data(), tc.m_control_points.size());
-					knot_vector_v = tc.m_knots;
-				}
-				surface.m_control_points.resize(rows);
-				for (int i = 0; i < rows; i++)
+				const int cols = static_cast<int>(through_points[0].size());
+				CurveApproximator approximator_u(degree_u, uk, control_points_rows);
+				CurveApproximator approximator_v(degree_v, vl, control_points_columns);
+				if (!approximator_u.is_valid() || !approximator_v.is_valid())
 				{
-					auto row_i = temp_col_cpoints.row(i);
-					surface.m_control_points[i] = std::vector<vec3>{ row_i.begin(), row_i.end() };
+					return false;
 				}
 
+				// Fit the columns along u, then the rows of the result along v as columns of its transpose
+				const Array2<vec3> grid(through_points);
+				Array2<vec3> fitted_u(control_points_rows, cols);
+				approximator_u.solve_many(grid.data(), cols, fitted_u.data());
+				const Array2<vec3> transposed = fitted_u.transposed();
+				Array2<vec3> fitted_v(control_points_columns, control_points_rows);
+				approximator_v.solve_many(transposed.data(), control_points_rows, fitted_v.data());
+
 				surface.m_degree_u = degree_u;
 				surface.m_degree_v = degree_v;
-				surface.m_knots_u.swap(knot_vector_u);
-				surface.m_knots_v.swap(knot_vector_v);
-				surface.m_weights = std::vector<std::vector<scalar>>(surface.m_control_points.size(), std::vector<scalar>(surface.m_control_points[0].size(), 1.0f));
+				surface.m_knots_u = approximator_u.knots();
+				surface.m_knots_v = approximator_v.knots();
+				surface.m_control_points = fitted_v.transposed();
+				surface.m_weights.assign(control_points_rows, control_points_columns, 1.0f);
 				return true;
 			}
 
 			/**
-			 * Approximate a group of points with nubrs
-			 * @param[in] through_points a group of points
-			 * @param degree_u degree Parameter in the u-direction
-			 * @param degree_v degree Parameter in the v-direction
-			 * @param[out] surface RationalSurface
+			 * Interpolate a grid of points with a non-rational surface (Piegl & Tiller A9.4).
+			 * Every column shares one factorised interpolation matrix in u and every row one in v,
+			 * each direction is solved as a single multi-column system.
+			 * @param[in] throughpoints Grid of points, throughpoints[i][j] is interpolated at (uk[i], vl[j]).
+			 * @param degreeU degree Parameter in the u-direction
+			 * @param degreeV degree Parameter in the v-direction
+			 * @param[out] surface RationalSurface, unchanged if the grid cannot be interpolated.
 			 */
 			inline void global_interpolation(const std::vector<std::vector<vec3>>& throughpoints, int degreeU, int degreeV, RationalSurface& surface)
 			{
@@ -864,150 +1351,319 @@ namespace Geomerty
 				std::vector<scalar> uk;
 				std::vector<scalar> vl;
 
-				get_surfacemesh_parameterization(throughpoints, uk, vl);
+				if (!get_surfacemesh_parameterization(throughpoints, uk, vl))
+				{
+					return;
+				}
 
 				int rows = throughpoints.size();
 				int cols = throughpoints[0].size();
+				CurveInterpolator interpolator_u(degreeU, uk);
+				CurveInterpolator interpolator_v(degreeV, vl);
+				if (!interpolator_u.is_valid() || !interpolator_v.is_valid())
+				{
+					return;
+				}
+
+				// Interpolate the columns along u, then the rows of the result along v as columns of its transpose
+				Array2<vec3> grid(throughpoints);
+				interpolator_u.solve_many(grid.data(), cols);
+				Array2<vec3> transposed = grid.transposed();
+				interpolator_v.solve_many(transposed.data(), rows);
+
+				surface.m_degree_u = degreeU;
+				surface.m_degree_v = degreeV;
+				surface.m_knots_u = interpolator_u.knots();
+				surface.m_knots_v = interpolator_v.knots();
+				surface.m_control_points = transposed.transposed();
+				surface.m_weights.assign(rows, cols, 1.0f);
+			}
+			/**
+			 * Indexed triangle mesh of a surface
+			 */
+			struct SurfaceTessellation
+			{
+				std::vector<vec3> positions;
+				// Unit normals Sv x Su as in surface_normal, zero only where no neighbouring vertex has a defined normal either
+				std::vector<vec3> normals;
+				// Parameters normalised to [0, 1] over the domain
+				std::vector<vec2> uvs;
+				// Three indices per triangle, counter-clockwise around the normals
+				std::vector<size_t> indices;
+			};
+			/**
+			 * Triangulated (count_u x count_v) grid of a surface, two triangles per grid cell.
+			 * Vertex (i, j), the ith sample along u and the jth along v, is stored at i + j * count_u.
+			 */
+			struct SurfaceGrid : public SurfaceTessellation
+			{
+				size_t count_u = 0, count_v = 0;
+			};
 
-				std::vector<std::vector<vec3>> controlpoints(rows, std::vector<vec3>(cols));
-				std::vector<std::vector<scalar>> weights(rows, std::vector<scalar>(cols, 1.0f));
-				std::vector<scalar> knotVectorU = average_knot_vector(degreeU, uk);
-				std::vector<scalar> knotVectorV = average_knot_vector(degreeV, vl);
+			// Largest number of v samples in one tile of tessellate_surface_grid
+			inline constexpr size_t N_GRID_TILE = 64;
 
-				for (int j = 0; j < cols; j++)
+			namespace internal
+			{
+				/*
+				 * Span and basis functions with their first derivatives at each sample of [min, max]
+				 */
+				template<typename Real>
+				struct GridBasis
+				{
+					std::vector<int> spans;
+					std::vector<BasisDerTableT<Real>> ders;
+				};
+
+				template<typename Real>
+				inline GridBasis<Real> grid_basis(const BasicKnotBasis<Real>& basis, size_t count)
 				{
-					std::vector<vec3> temp(rows);
-					for (int i = 0; i < rows; i++)
+					GridBasis<Real> grid;
+					grid.spans.resize(count);
+					grid.ders.resize(count);
+					const Real min = basis.knots().front();
+					const Real max = basis.knots().back();
+					const int num_ders = std::min<int>(1, static_cast<int>(basis.degree()));
+					for (size_t i = 0; i < count; i++)
 					{
-						temp[i] = throughpoints[i][j];
+						const Real t = (i + 1 == count) ? max : min + (max - min) * (static_cast<Real>(i) / static_cast<Real>(count - 1));
+						grid.spans[i] = basis.span(t);
+						grid.ders[i] = {};
+						basis.der_basis(grid.spans[i], t, num_ders, grid.ders[i]);
 					}
-					RationalCurve tc;
-					global_interpolation(degreeU, temp, tc);
-					for (int i = 0; i < rows; i++)
+					return grid;
+				}
+
+				/*
+				 * Split samples into tiles of at most N_GRID_TILE, a tile starts at every knot span so it only touches
+				 * the control points of the spans it covers.
+				 * return Index of the first sample of each tile followed by the number of samples.
+				 */
+				inline std::vector<size_t> grid_tiles(const std::vector<int>& spans)
+				{
+					std::vector<size_t> tiles{ 0 };
+					for (size_t i = 1; i < spans.size(); i++)
 					{
-						controlpoints[i][j] = tc.m_control_points[i];
+						if (spans[i] != spans[i - 1] || i - tiles.back() == N_GRID_TILE)
+						{
+							tiles.push_back(i);
+						}
 					}
+					tiles.push_back(spans.size());
+					return tiles;
 				}
-
-				for (int i = 0; i < rows; i++)
+				/*
+				 * Positions and normals of the grid vertices [i0, i1) x [j0, j1) from the homogenous net.
+				 * The net is contracted along u on the columns under the v spans of the rows, then along v.
+				 * Vertices whose normal is not defined are appended to degenerate.
+				 */
+				template<typename Real>
+				inline void grid_region(const Array2<vec4_t<Real>>& cw, const GridBasis<Real>& basis_u, const GridBasis<Real>& basis_v, int degree_u, int degree_v,
+					size_t i0, size_t i1, size_t j0, size_t j1, SurfaceGrid& grid, NurbsWorkspace& workspace, std::vector<size_t>& degenerate)
 				{
-					std::vector<vec3> temp(cols);
-					for (int j = 0; j < cols; j++)
+					using Vec3 = vec3_t<Real>;
+					using Vec4 = vec4_t<Real>;
+					const size_t count_u = grid.count_u;
+					const size_t rows = i1 - i0;
+					// Columns of the net under the v spans of the rows
+					const int col0 = basis_v.spans[j0] - degree_v;
+					const size_t width = basis_v.spans[j1 - 1] - col0 + 1;
+
+					// First pass: Sw and dSw/du on these v isolines of the net at each u sample
+					std::span<Vec4> net = workspace.scratch<Vec4>(0, rows * width);
+					std::span<Vec4> net_du = workspace.scratch<Vec4>(1, rows * width);
+					std::fill(net.begin(), net.end(), Vec4::Zero());
+					std::fill(net_du.begin(), net_du.end(), Vec4::Zero());
+					for (size_t i = i0; i < i1; i++)
 					{
-						temp[j] = throughpoints[i][j];
+						const int first = basis_u.spans[i] - degree_u;
+						const BasisDerTableT<Real>& ders = basis_u.ders[i];
+						Vec4* point = net.data() + (i - i0) * width;
+						Vec4* du = net_du.data() + (i - i0) * width;
+						for (int r = 0; r <= degree_u; r++)
+						{
+							const Vec4* row = cw.row(first + r).data() + col0;
+							for (size_t j = 0; j < width; j++)
+							{
+								point[j] += ders[0][r] * row[j];
+								du[j] += ders[1][r] * row[j];
+							}
+						}
 					}
-					RationalCurve tc;
-					global_interpolation(degreeV, temp, tc);
-					for (int j = 0; j < cols; j++)
+
+					// Second pass: contract along v and convert to cartesian position and derivatives
+					for (size_t j = j0; j < j1; j++)
 					{
-						controlpoints[i][j] = tc.m_control_points[j];
+						const int first = basis_v.spans[j] - degree_v - col0;
+						const BasisDerTableT<Real>& ders = basis_v.ders[j];
+						vec3* positions = grid.positions.data() + j * count_u;
+						vec3* normals = grid.normals.data() + j * count_u;
+						for (size_t i = i0; i < i1; i++)
+						{
+							const Vec4* point = net.data() + (i - i0) * width + first;
+							const Vec4* du = net_du.data() + (i - i0) * width + first;
+							Vec4 A = Vec4::Zero(), Au = Vec4::Zero(), Av = Vec4::Zero();
+							for (int s = 0; s <= degree_v; s++)
+							{
+								A += ders[0][s] * point[s];
+								Au += ders[0][s] * du[s];
+								Av += ders[1][s] * point[s];
+							}
+							const Vec3 S = A.template head<3>() / A.w();
+							const Vec3 Su = (Au.template head<3>() - Au.w() * S) / A.w();
+							const Vec3 Sv = (Av.template head<3>() - Av.w() * S) / A.w();
+							positions[i] = S.template cast<scalar>();
+							normals[i] = Sv.cross(Su).normalized().template cast<scalar>();
+							if (!(normals[i].squaredNorm() > 0.5f))
+							{
+								degenerate.push_back(i + j * count_u);
+							}
+						}
 					}
 				}
-				surface.m_degree_u = degreeU;
-				surface.m_degree_v = degreeV;
-				surface.m_knots_u.swap(knotVectorU);
-				surface.m_knots_v.swap(knotVectorV);
-				surface.m_control_points = controlpoints;
-				surface.m_weights.swap(weights);
-			}
-			/*
-			 * sample a NURBS surface according to segments
-			 */
-			inline std::tuple<std::vector<vec3>, std::vector<size_t>> sample_nurbs_surface(const RationalSurface& srf, int segments)
-			{
-				// Sample the NURBS to get triangles
-				scalar u_min = std::numeric_limits<float>::max();
-				scalar u_max = -std::numeric_limits<float>::max();
-				scalar v_min = std::numeric_limits<float>::max();
-				scalar v_max = -std::numeric_limits<float>::max();;
-				for (auto u_temp : srf.m_knots_u)
-				{
-					u_min = std::min(u_min, u_temp);
-					u_max = std::max(u_max, u_temp);
-				}
-				for (auto v_temp : srf.m_knots_v)
-				{
-					v_min = std::min(v_min, v_temp);
-					v_max = std::max(v_max, v_temp);
-				}
-				std::vector<vec3> point_arr((segments + 1) * (segments + 1));
-				std::vector<size_t> index_arr(segments * segments * 6);
-				const float seg = 1.0f / segments;
-				for (int iy = 0; iy <= segments; iy++)
+
+				/*
+				 * Uvs of the grid rows [j0, j1) and the triangles of the cells whose lower corner lies in them
+				 */
+				inline void grid_connectivity(size_t j0, size_t j1, SurfaceGrid& grid)
 				{
-					for (int ix = 0; ix <= segments; ix++)
+					const size_t count_u = grid.count_u;
+					const size_t count_v = grid.count_v;
+					for (size_t j = j0; j < j1; j++)
+					{
+						vec2* uvs = grid.uvs.data() + j * count_u;
+						const scalar v = static_cast<scalar>(j) / (count_v - 1);
+						for (size_t i = 0; i < count_u; i++)
+						{
+							uvs[i] = vec2(static_cast<scalar>(i) / (count_u - 1), v);
+						}
+					}
+					for (size_t j = j0; j < std::min(j1, count_v - 1); j++)
 					{
-						const float u = ix * seg;
-						const float v = iy * seg;
-						const scalar norm_u = u_min + (u_max - u_min) * u;
-						const scalar norm_v = v_min + (v_max - v_min) * v;
-						point_arr[ix + iy * (segments + 1)] = surface_point(srf, norm_u, norm_v);
+						size_t* cell = grid.indices.data() + j * (count_u - 1) * 6;
+						for (size_t i = 0; i + 1 < count_u; i++, cell += 6)
+						{
+							const size_t id = i + j * count_u;
+							cell[0] = id + count_u;
+							cell[1] = id + count_u + 1;
+							cell[2] = id + 1;
+							cell[3] = id + count_u;
+							cell[4] = id + 1;
+							cell[5] = id;
+						}
 					}
 				}
 
-				int index = 0;
-				for (int iy = 0; iy < segments; iy++)
+				/*
+				 * Sv x Su vanishes at poles and degenerate edges, take the normal of the nearest vertex inside
+				 * for which is_degenerate(index) is false
+				 */
+				template<typename Degenerate>
+				inline void repair_grid_normals(const std::vector<size_t>& degenerate, const Degenerate& is_degenerate, SurfaceGrid& grid)
 				{
-					for (int ix = 0; ix < segments; ix++)
+					const size_t count_u = grid.count_u;
+					const size_t count_v = grid.count_v;
+					std::vector<std::pair<size_t, vec3>> replaced;
+					for (size_t index : degenerate)
 					{
-						const int id = ix + iy * (segments + 1);
-						index_arr[index++] = id + segments + 1;
-						index_arr[index++] = id + segments + 2;
-						index_arr[index++] = id + 1;
-						index_arr[index++] = id + segments + 1;
-						index_arr[index++] = id + 1;
-						index_arr[index++] = id;
+						const size_t i = index % count_u, j = index / count_u;
+						const size_t ni = (i == 0) ? 1 : (i + 1 == count_u ? i - 1 : i);
+						const size_t nj = (j == 0) ? 1 : (j + 1 == count_v ? j - 1 : j);
+						vec3 normal = vec3::Zero();
+						for (size_t candidate : { ni + j * count_u, i + nj * count_u, ni + nj * count_u })
+						{
+							if (!is_degenerate(candidate))
+							{
+								normal = grid.normals[candidate];
+								break;
+							}
+						}
+						replaced.emplace_back(index, normal);
+					}
+					for (const auto& [index, normal] : replaced)
+					{
+						grid.normals[index] = normal;
 					}
 				}
-				return { point_arr, index_arr };
 			}
 
-			/*
-			 * Evaluate the closest point to a NURBS.
-			 */
-			inline vec3 surface_closest_point(const RationalSurface& srf, const vec3& pos, int segments)
-			{
-				auto&& [point_arr, index_arr] = sample_nurbs_surface(srf, segments);
-				// construct KdTree and query
-				internal::TriangleKdTree kdtree(point_arr, index_arr);
-				return kdtree.nearest(pos).nearest;
-			}
-			/*
-			 * Evaluate bounding box on a nonrational NURBS surface
-			 * @param[in] srf NURBS surface
-			 * @param segments param for sample NURBS surface
-			 * return the bounding box with given segments
+			/**
+			 * Tessellate a surface as a uniform grid in its parameter domain.
+			 * The basis functions of every u and v sample are computed once, then the homogenous net is contracted
+			 * along u for each u sample and the result along v for each grid vertex, so every control point is read
+			 * once per u sample instead of once per vertex.
+			 * The grid is cut into bands of rows along the v knot spans which are evaluated in parallel, each vertex is written
+			 * to its fixed place by the same operations, so the result does not depend on the number of threads.
+			 * @param[in] evaluator SurfaceEvaluator of the surface
+			 * @param[in] count_u Number of samples along u, at least 2
+			 * @param[in] count_v Number of samples along v, at least 2
+			 * @return Vertices, normals, uvs and triangles of the grid, empty if the surface is invalid.
 			 */
-			inline AABB3 surface_box(const RationalSurface& srf, int segments)
+			template<typename Real>
+			inline SurfaceGrid tessellate_surface_grid(const BasicSurfaceEvaluator<Real>& evaluator, size_t count_u, size_t count_v)
 			{
-				scalar u_min = std::numeric_limits<float>::max();
-				scalar u_max = -std::numeric_limits<float>::max();
-				scalar v_min = std::numeric_limits<float>::max();
-				scalar v_max = -std::numeric_limits<float>::max();
-				for (auto u_temp : srf.m_knots_u)
-				{
-					u_min = std::min(u_min, u_temp);
-					u_max = std::max(u_max, u_temp);
-				}
-				for (auto v_temp : srf.m_knots_v)
+				SurfaceGrid grid;
+				if (!evaluator.is_valid() || count_u < 2 || count_v < 2)
 				{
-					v_min = std::min(v_min, v_temp);
-					v_max = std::max(v_max, v_temp);
+					return grid;
 				}
-				AABB3 box;
-				for (int i = 0; i < segments + 1; i++)
-				{
-					scalar u = static_cast<scalar>(i) / static_cast<scalar>(segments);
-					scalar norm_u = u_min + (u_max - u_min) * u;
-					for (int j = 0; i < segments + 1; j++)
+				const int degree_u = static_cast<int>(evaluator.basis_u().degree());
+				const int degree_v = static_cast<int>(evaluator.basis_v().degree());
+				const internal::GridBasis<Real> basis_u = internal::grid_basis(evaluator.basis_u(), count_u);
+				const internal::GridBasis<Real> basis_v = internal::grid_basis(evaluator.basis_v(), count_v);
+				// Tiles are bands of whole grid rows so every tile writes long contiguous runs of vertices
+				const std::vector<size_t> tiles = internal::grid_tiles(basis_v.spans);
+				const size_t num_tiles = tiles.size() - 1;
+
+				grid.count_u = count_u;
+				grid.count_v = count_v;
+				grid.positions.resize(count_u * count_v);
+				grid.normals.resize(count_u * count_v);
+				grid.uvs.resize(count_u * count_v);
+				grid.indices.resize((count_u - 1) * (count_v - 1) * 6);
+				std::vector<std::vector<size_t>> degenerate(num_tiles);
+				std::vector<NurbsWorkspace> workspaces;
+				parallel_for(num_tiles, [&](size_t threads) { workspaces.resize(threads); },
+					[&](size_t tile, size_t thread)
 					{
-						scalar v = static_cast<scalar>(j) / static_cast<scalar>(segments);
-						scalar norm_v = v_min + (v_max - v_min) * v;
-						box.extend(surface_point(srf, norm_u, norm_v));
-					}
+						internal::grid_region(evaluator.homogenous_points(), basis_u, basis_v, degree_u, degree_v, 0, count_u, tiles[tile], tiles[tile + 1],
+							grid, workspaces[thread], degenerate[tile]);
+						internal::grid_connectivity(tiles[tile], tiles[tile + 1], grid);
+					}, [](size_t) {}, 2);
+
+				std::vector<size_t> all;
+				for (const auto& list : degenerate)
+				{
+					all.insert(all.end(), list.begin(), list.end());
 				}
-				return box;
+				internal::repair_grid_normals(all, [&](size_t index) { return !(grid.normals[index].squaredNorm() > 0.5f); }, grid);
+				return grid;
 			}
+			inline SurfaceGrid tessellate_surface_grid(const RationalSurface& srf, size_t count_u, size_t count_v)
+			{
+				return tessellate_surface_grid(SurfaceEvaluator(srf), count_u, count_v);
+			}
+
+			/*
+			 * sample a NURBS surface according to segments
+			 */
+			inline std::tuple<std::vector<vec3>, std::vector<size_t>> sample_nurbs_surface(const RationalSurface& srf, int segments)
+			{
+				SurfaceGrid grid = tessellate_surface_grid(srf, segments + 1, segments + 1);
+				return { std::move(grid.positions), std::move(grid.indices) };
+			}
+
+			/**
+			 * Evaluate bounding box of a NURBS surface from its Bezier control hulls, see bezier_bounds
+			 * @param[in] evaluator SurfaceEvaluator of the surface, the box is cached on it.
+			 * @return Bounding box, empty if the surface is invalid.
+			 */
+			inline AABB3 surface_box(const SurfaceEvaluator& evaluator) { return evaluator.bounds(); }
+			inline AABB3 surface_box(const RationalSurface& srf) { return surface_box(SurfaceEvaluator(srf)); }
+			/*
+			 * The box no longer depends on a sample count, segments is ignored
+			 */
+			[[deprecated("use surface_box(srf)")]] inline AABB3 surface_box(const RationalSurface& srf, int /*segments*/) { return surface_box(srf); }
 		}
 	}
 }
\ No newline at end of file
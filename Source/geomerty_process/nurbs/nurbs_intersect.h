@@ -0,0 +1,548 @@
+#pragma once
+#include <Eigen/Dense>
+#include <algorithm>
+#include <array>
+#include <limits>
+#include <tuple>
+#include <vector>
+
+#include "glviewer/parallel_for.h"
+#include "nurbs_curve.h"
+#include "nurbs_evalute_curve.h"
+#include "nurbs_projection.h"
+#include "nurbs_util.h"
+
+namespace Geomerty::nurbs::util
+{
+	inline constexpr int N_MAX_INTERSECTION_DEPTH = 24;
+	inline constexpr scalar N_INTERSECTION_FLATNESS = 1e-3f;
+	inline constexpr size_t N_PARALLEL_INTERSECTION_PAIRS = 32;
+
+	/**
+	 * Intersection of two curves, either a single point or a coincident part
+	 */
+	struct CurveIntersection
+	{
+		// Parameters of the intersection on the first and on the second curve
+		scalar param0 = 0.0f;
+		scalar param1 = 0.0f;
+		vec3 point = vec3::Zero();
+		// The curves coincide from (param0, param1) to (param0_end, param1_end), param0 <= param0_end and
+		// param1_end is below param1 when the curves run in opposite directions.
+		bool overlap = false;
+		scalar param0_end = 0.0f;
+		scalar param1_end = 0.0f;
+	};
+
+	namespace internal
+	{
+		/*
+		 * Part [t0, t1] of a Bezier segment in its local parameter, with its homogenous control points
+		 */
+		struct IntersectionPiece
+		{
+			std::array<vec4, N_MAX_DEGREE + 1> cw;
+			scalar t0 = 0.0f, t1 = 1.0f;
+		};
+
+		/*
+		 * Control hull box of a Bezier piece, unbounded if a weight is not positive since the hull then
+		 * does not bound the piece.
+		 */
+		inline AABB3 intersection_box(const vec4* cw, size_t degree)
+		{
+			AABB3 box;
+			if (!bezier_hull_box(cw, degree + 1, box))
+			{
+				box = AABB3(vec3::Constant(-std::numeric_limits<scalar>::max()), vec3::Constant(std::numeric_limits<scalar>::max()));
+			}
+			return box;
+		}
+
+		/*
+		 * Point of a Bezier segment nearest to a position by Newton iteration from the best of a coarse
+		 * sample and the incoming t when it lies in [0, 1]. Steps that move away from the position are halved.
+		 * The iteration runs in double on a converted copy of the segment.
+		 * return Distance to the position, t receives the local parameter.
+		 */
+		inline scalar project_to_bezier(const vec4* segment, size_t degree, const vec3& point, scalar tolerance, scalar& param)
+		{
+			using dvec3 = vec3_t<double>;
+			const auto cw = bezier_cast<double, scalar>(segment, degree);
+			const dvec3 pos = point.cast<double>();
+			auto distance_at = [&](double s) { return (homogenous_to_cartesian(bezier_point(cw.data(), degree, s)) - pos).norm(); };
+			double t = param;
+			double distance = std::numeric_limits<double>::max();
+			if (t >= 0.0 && t <= 1.0)
+			{
+				distance = distance_at(t);
+			}
+			const int samples = 2 * static_cast<int>(degree) + 2;
+			for (int k = 0; k <= samples; k++)
+			{
+				const double s = static_cast<double>(k) / static_cast<double>(samples);
+				const double d = distance_at(s);
+				if (d < distance)
+				{
+					distance = d;
+					t = s;
+				}
+			}
+			std::array<dvec3, 3> ders;
+			for (int iter = 0; iter < N_MAX_NEWTON_ITERATIONS && distance > 0.0; iter++)
+			{
+				bezier_derivatives(cw.data(), degree, t, 2, ders.data());
+				const dvec3 diff = ders[0] - pos;
+				double df = ders[1].dot(ders[1]) + diff.dot(ders[2]);
+				if (!(df > 0.0))
+				{
+					df = ders[1].dot(ders[1]);
+					if (!(df > 0.0))
+					{
+						break;
+					}
+				}
+				double next = std::clamp(t - diff.dot(ders[1]) / df, 0.0, 1.0);
+				double next_distance = distance_at(next);
+				for (int halving = 0; halving < 8 && next_distance > distance; halving++)
+				{
+					next = 0.5 * (t + next);
+					next_distance = distance_at(next);
+				}
+				if (next_distance > distance)
+				{
+					break;
+				}
+				const double step = std::abs(next - t) * ders[1].norm();
+				t = next;
+				distance = next_distance;
+				if (step <= 0.1 * tolerance)
+				{
+					break;
+				}
+			}
+			param = static_cast<scalar>(t);
+			return static_cast<scalar>(distance);
+		}
+
+		/*
+		 * Refine a parameter pair (s, t) of two Bezier segments to a common point with Gauss-Newton
+		 * iteration on A(s) - B(t) in double, damped where the tangents are parallel.
+		 * return Distance between A(s) and B(t) after refinement
+		 */
+		inline scalar refine_intersection(const vec4* segment_a, size_t degree_a, const vec4* segment_b, size_t degree_b, scalar tolerance, scalar& param_s, scalar& param_t)
+		{
+			using dvec3 = vec3_t<double>;
+			const auto a = bezier_cast<double, scalar>(segment_a, degree_a);
+			const auto b = bezier_cast<double, scalar>(segment_b, degree_b);
+			double s = param_s, t = param_t;
+			std::array<dvec3, 2> da, db;
+			for (int iter = 0; iter < N_MAX_NEWTON_ITERATIONS; iter++)
+			{
+				bezier_derivatives(a.data(), degree_a, s, 1, da.data());
+				bezier_derivatives(b.data(), degree_b, t, 1, db.data());
+				const dvec3 f = da[0] - db[0];
+				const double a11 = da[1].squaredNorm();
+				const double a22 = db[1].squaredNorm();
+				const double a12 = -da[1].dot(db[1]);
+				const double g1 = da[1].dot(f);
+				const double g2 = -db[1].dot(f);
+				const double damping = 1e-6 * (a11 + a22);
+				const double det = (a11 + damping) * (a22 + damping) - a12 * a12;
+				if (!(det > 0.0))
+				{
+					break;
+				}
+				const double ds = -((a22 + damping) * g1 - a12 * g2) / det;
+				const double dt = -((a11 + damping) * g2 - a12 * g1) / det;
+				const double next_s = std::clamp(s + ds, 0.0, 1.0);
+				const double next_t = std::clamp(t + dt, 0.0, 1.0);
+				const double step = std::abs(next_s - s) * std::sqrt(a11) + std::abs(next_t - t) * std::sqrt(a22);
+				s = next_s;
+				t = next_t;
+				if (step <= 0.1 * tolerance)
+				{
+					break;
+				}
+			}
+			param_s = static_cast<scalar>(s);
+			param_t = static_cast<scalar>(t);
+			return static_cast<scalar>((homogenous_to_cartesian(bezier_point(a.data(), degree_a, s)) - homogenous_to_cartesian(bezier_point(b.data(), degree_b, t))).norm());
+		}
+
+		/*
+		 * Whether a piece is close enough to its chord for one Newton refinement,
+		 * end points receive the ends of the chord.
+		 */
+		inline bool piece_is_flat(const IntersectionPiece& piece, size_t degree, scalar tolerance, vec3& p0, vec3& p1)
+		{
+			p0 = homogenous_to_cartesian(piece.cw[0]);
+			p1 = homogenous_to_cartesian(piece.cw[degree]);
+			const scalar bound = std::max(tolerance, N_INTERSECTION_FLATNESS * (p1 - p0).norm());
+			vec3 nearest;
+			for (size_t i = 1; i < degree; i++)
+			{
+				if (!(piece.cw[i].w() > 0.0f) || dist_point_line_segment(homogenous_to_cartesian(piece.cw[i]), p0, p1, nearest) > bound)
+				{
+					return false;
+				}
+			}
+			return true;
+		}
+
+		/*
+		 * Parameters in [0, 1] of the closest points of the segments [p0, p1] and [q0, q1]
+		 */
+		inline void closest_chord_params(const vec3& p0, const vec3& p1, const vec3& q0, const vec3& q1, scalar& u, scalar& v)
+		{
+			const vec3 d1 = p1 - p0;
+			const vec3 d2 = q1 - q0;
+			const vec3 r = p0 - q0;
+			const scalar a = d1.squaredNorm();
+			const scalar e = d2.squaredNorm();
+			const scalar f = d2.dot(r);
+			if (a <= 0.0f && e <= 0.0f)
+			{
+				u = v = 0.0f;
+				return;
+			}
+			if (a <= 0.0f)
+			{
+				u = 0.0f;
+				v = std::clamp(f / e, 0.0f, 1.0f);
+				return;
+			}
+			const scalar c = d1.dot(r);
+			if (e <= 0.0f)
+			{
+				v = 0.0f;
+				u = std::clamp(-c / a, 0.0f, 1.0f);
+				return;
+			}
+			const scalar b = d1.dot(d2);
+			const scalar denom = a * e - b * b;
+			u = denom > 0.0f ? std::clamp((b * f - c * e) / denom, 0.0f, 1.0f) : 0.0f;
+			v = (b * u + f) / e;
+			if (v < 0.0f)
+			{
+				v = 0.0f;
+				u = std::clamp(-c / a, 0.0f, 1.0f);
+			}
+			else if (v > 1.0f)
+			{
+				v = 1.0f;
+				u = std::clamp((b - c) / a, 0.0f, 1.0f);
+			}
+		}
+
+		/*
+		 * Coincident part of two Bezier segments. A common part of two segments ends at an end of one
+		 * of them, so the ends lying on the other segment bound it and samples in between confirm it.
+		 * return Whether the segments coincide on more than a point, s and t receive the local parameters of its ends.
+		 */
+		inline bool bezier_overlap(const vec4* a, size_t degree_a, const AABB3& box_a, const vec4* b, size_t degree_b, const AABB3& box_b, scalar tolerance,
+			std::array<scalar, 2>& s, std::array<scalar, 2>& t)
+		{
+			std::array<std::pair<scalar, scalar>, 4> ends;
+			size_t count = 0;
+			for (scalar end : { 0.0f, 1.0f })
+			{
+				const vec3 p = homogenous_to_cartesian(end == 0.0f ? a[0] : a[degree_a]);
+				scalar param = -1.0f;
+				if (box_b.exteriorDistance(p) <= tolerance && project_to_bezier(b, degree_b, p, tolerance, param) <= tolerance)
+				{
+					ends[count++] = { end, param };
+				}
+				const vec3 q = homogenous_to_cartesian(end == 0.0f ? b[0] : b[degree_b]);
+				param = -1.0f;
+				if (box_a.exteriorDistance(q) <= tolerance && project_to_bezier(a, degree_a, q, tolerance, param) <= tolerance)
+				{
+					ends[count++] = { param, end };
+				}
+			}
+			if (count < 2)
+			{
+				return false;
+			}
+			const auto [first, last] = std::minmax_element(ends.begin(), ends.begin() + count);
+			const vec3 p0 = homogenous_to_cartesian(bezier_point(a, degree_a, first->first));
+			const vec3 p1 = homogenous_to_cartesian(bezier_point(a, degree_a, last->first));
+			if ((p1 - p0).norm() <= tolerance)
+			{
+				return false;
+			}
+			// Interior samples of the first segment must lie on the second one
+			const int samples = 4 * static_cast<int>(std::max(degree_a, degree_b) + 1);
+			for (int k = 1; k < samples; k++)
+			{
+				const scalar ratio = static_cast<scalar>(k) / static_cast<scalar>(samples);
+				const scalar param = first->first + (last->first - first->first) * ratio;
+				scalar param_b = first->second + (last->second - first->second) * ratio;
+				if (project_to_bezier(b, degree_b, homogenous_to_cartesian(bezier_point(a, degree_a, param)), tolerance, param_b) > tolerance)
+				{
+					return false;
+				}
+			}
+			s = { first->first, last->first };
+			t = { first->second, last->second };
+			return true;
+		}
+
+		/*
+		 * Intersect one Bezier segment of each curve, appending the results in curve parameters
+		 */
+		inline void intersect_bezier(const BezierSegments& a, size_t i, const AABB3& box_a, const BezierSegments& b, size_t j, const AABB3& box_b,
+			scalar tolerance, std::vector<CurveIntersection>& out)
+		{
+			const vec4* cw_a = a.segment(i);
+			const vec4* cw_b = b.segment(j);
+			const size_t pa = a.degree;
+			const size_t pb = b.degree;
+			auto param_a = [&](scalar s) { return a.breaks[i] + (a.breaks[i + 1] - a.breaks[i]) * s; };
+			auto param_b = [&](scalar t) { return b.breaks[j] + (b.breaks[j + 1] - b.breaks[j]) * t; };
+
+			std::array<scalar, 2> s, t;
+			if (bezier_overlap(cw_a, pa, box_a, cw_b, pb, box_b, tolerance, s, t))
+			{
+				CurveIntersection overlap;
+				overlap.overlap = true;
+				overlap.param0 = param_a(s[0]);
+				overlap.param1 = param_b(t[0]);
+				overlap.param0_end = param_a(s[1]);
+				overlap.param1_end = param_b(t[1]);
+				overlap.point = homogenous_to_cartesian(bezier_point(cw_a, pa, s[0]));
+				out.push_back(overlap);
+				return;
+			}
+
+			// Subdivide both segments, dropping pairs of pieces whose hulls are apart
+			struct PiecePair
+			{
+				IntersectionPiece a, b;
+				int depth;
+			};
+			std::vector<PiecePair> stack(1);
+			std::copy_n(cw_a, pa + 1, stack[0].a.cw.begin());
+			std::copy_n(cw_b, pb + 1, stack[0].b.cw.begin());
+			stack[0].depth = 0;
+			while (!stack.empty())
+			{
+				PiecePair pair = stack.back();
+				stack.pop_back();
+				AABB3 hull_a = intersection_box(pair.a.cw.data(), pa);
+				const AABB3 hull_b = intersection_box(pair.b.cw.data(), pb);
+				hull_a.min().array() -= tolerance;
+				hull_a.max().array() += tolerance;
+				if (!hull_a.intersects(hull_b))
+				{
+					continue;
+				}
+				vec3 p0, p1, q0, q1;
+				const bool flat_a = piece_is_flat(pair.a, pa, tolerance, p0, p1);
+				const bool flat_b = piece_is_flat(pair.b, pb, tolerance, q0, q1);
+				if ((flat_a && flat_b) || pair.depth >= N_MAX_INTERSECTION_DEPTH)
+				{
+					scalar u, v;
+					closest_chord_params(p0, p1, q0, q1, u, v);
+					scalar si = pair.a.t0 + (pair.a.t1 - pair.a.t0) * u;
+					scalar ti = pair.b.t0 + (pair.b.t1 - pair.b.t0) * v;
+					if (refine_intersection(cw_a, pa, cw_b, pb, tolerance, si, ti) <= tolerance)
+					{
+						CurveIntersection hit;
+						hit.param0 = param_a(si);
+						hit.param1 = param_b(ti);
+						hit.point = 0.5f * (homogenous_to_cartesian(bezier_point(cw_a, pa, si)) + homogenous_to_cartesian(bezier_point(cw_b, pb, ti)));
+						out.push_back(hit);
+					}
+					continue;
+				}
+				// Split the pieces that are not flat yet at their middle
+				std::array<IntersectionPiece, 2> parts_a, parts_b;
+				size_t count_a = 1, count_b = 1;
+				parts_a[0] = pair.a;
+				parts_b[0] = pair.b;
+				auto split = [](const IntersectionPiece& piece, size_t degree, std::array<IntersectionPiece, 2>& parts)
+				{
+					const scalar mid = 0.5f * (piece.t0 + piece.t1);
+					bezier_split(piece.cw.data(), degree, 0.5f, parts[0].cw.data(), parts[1].cw.data());
+					parts[0].t0 = piece.t0;
+					parts[0].t1 = mid;
+					parts[1].t0 = mid;
+					parts[1].t1 = piece.t1;
+				};
+				if (!flat_a)
+				{
+					split(pair.a, pa, parts_a);
+					count_a = 2;
+				}
+				if (!flat_b)
+				{
+					split(pair.b, pb, parts_b);
+					count_b = 2;
+				}
+				for (size_t k = 0; k < count_a; k++)
+				{
+					for (size_t l = 0; l < count_b; l++)
+					{
+						stack.push_back({ parts_a[k], parts_b[l], pair.depth + 1 });
+					}
+				}
+			}
+		}
+
+		/*
+		 * Point of a curve given by its Bezier segments
+		 */
+		inline vec3 segments_point(const BezierSegments& segments, scalar u)
+		{
+			const auto& breaks = segments.breaks;
+			size_t s = std::upper_bound(breaks.begin() + 1, breaks.end() - 1, u) - (breaks.begin() + 1);
+			s = std::min(s, segments.size() - 1);
+			const scalar width = breaks[s + 1] - breaks[s];
+			const scalar t = width > 0.0f ? std::clamp((u - breaks[s]) / width, 0.0f, 1.0f) : 0.0f;
+			return homogenous_to_cartesian(bezier_point(segments.segment(s), segments.degree, t));
+		}
+	}// namespace internal
+
+	/**
+	 * Intersect two curves given by their Bezier segments.
+	 * Pairs of segments with overlapping hull boxes are checked for a coincident part first, otherwise
+	 * subdivided while their hulls overlap until both pieces are flat, and each remaining pair of pieces
+	 * seeds a Newton refinement of the parameter pair. Many pairs of segments run in parallel.
+	 * @param[in] a Bezier segments of the first curve
+	 * @param[in] b Bezier segments of the second curve
+	 * @param[in] tolerance Distance in model units below which two points are one
+	 * @return Intersection points and coincident parts ordered by the parameter on the first curve.
+	 */
+	inline std::vector<CurveIntersection> intersect_curves(const BezierSegments& a, const BezierSegments& b, scalar tolerance = 1e-5f)
+	{
+		std::vector<CurveIntersection> result;
+		if (a.size() == 0 || b.size() == 0)
+		{
+			return result;
+		}
+		std::vector<AABB3> boxes_a(a.size()), boxes_b(b.size());
+		for (size_t i = 0; i < a.size(); i++)
+		{
+			boxes_a[i] = internal::intersection_box(a.segment(i), a.degree);
+		}
+		for (size_t j = 0; j < b.size(); j++)
+		{
+			boxes_b[j] = internal::intersection_box(b.segment(j), b.degree);
+		}
+		std::vector<std::pair<size_t, size_t>> pairs;
+		for (size_t i = 0; i < a.size(); i++)
+		{
+			AABB3 box = boxes_a[i];
+			box.min().array() -= tolerance;
+			box.max().array() += tolerance;
+			for (size_t j = 0; j < b.size(); j++)
+			{
+				if (box.intersects(boxes_b[j]))
+				{
+					pairs.emplace_back(i, j);
+				}
+			}
+		}
+
+		std::vector<std::vector<CurveIntersection>> found;
+		parallel_for(pairs.size(), [&](size_t threads) { found.resize(threads); },
+			[&](size_t k, size_t thread)
+			{
+				const auto [i, j] = pairs[k];
+				internal::intersect_bezier(a, i, boxes_a[i], b, j, boxes_b[j], tolerance, found[thread]);
+			}, [](size_t) {}, N_PARALLEL_INTERSECTION_PAIRS);
+
+		std::vector<CurveIntersection> points, overlaps;
+		for (const auto& list : found)
+		{
+			for (const auto& hit : list)
+			{
+				(hit.overlap ? overlaps : points).push_back(hit);
+			}
+		}
+		auto by_params = [](const CurveIntersection& x, const CurveIntersection& y) { return std::tie(x.param0, x.param1) < std::tie(y.param0, y.param1); };
+		std::sort(points.begin(), points.end(), by_params);
+		std::sort(overlaps.begin(), overlaps.end(), by_params);
+
+		// Coincident parts found on neighbouring pairs of segments join into one
+		std::vector<CurveIntersection> merged;
+		for (const auto& overlap : overlaps)
+		{
+			if (!merged.empty())
+			{
+				CurveIntersection& last = merged.back();
+				const bool touching = overlap.param0 <= last.param0_end ||
+					(internal::segments_point(a, overlap.param0) - internal::segments_point(a, last.param0_end)).norm() <= tolerance;
+				if (touching && (internal::segments_point(b, overlap.param1) - internal::segments_point(b, last.param1_end)).norm() <= tolerance)
+				{
+					if (overlap.param0_end > last.param0_end)
+					{
+						last.param0_end = overlap.param0_end;
+						last.param1_end = overlap.param1_end;
+					}
+					continue;
+				}
+			}
+			merged.push_back(overlap);
+		}
+
+		// Points found by several pieces, or along a tangential contact, are one as long as the curves
+		// stay together between them. The point closer to both curves is kept.
+		auto inside_overlap = [&](const CurveIntersection& point)
+		{
+			for (const auto& overlap : merged)
+			{
+				if ((point.param0 >= overlap.param0 && point.param0 <= overlap.param0_end) ||
+					(point.point - overlap.point).norm() <= tolerance ||
+					(point.point - internal::segments_point(a, overlap.param0_end)).norm() <= tolerance)
+				{
+					return true;
+				}
+			}
+			return false;
+		};
+		auto residual = [&](const CurveIntersection& point)
+		{
+			return (internal::segments_point(a, point.param0) - internal::segments_point(b, point.param1)).norm();
+		};
+		for (const auto& point : points)
+		{
+			if (inside_overlap(point))
+			{
+				continue;
+			}
+			if (!result.empty())
+			{
+				CurveIntersection& last = result.back();
+				const vec3 middle_a = internal::segments_point(a, 0.5f * (point.param0 + last.param0));
+				const vec3 middle_b = internal::segments_point(b, 0.5f * (point.param1 + last.param1));
+				if ((middle_a - middle_b).norm() <= tolerance)
+				{
+					if (residual(point) < residual(last))
+					{
+						last = point;
+					}
+					continue;
+				}
+			}
+			result.push_back(point);
+		}
+		result.insert(result.end(), merged.begin(), merged.end());
+		std::sort(result.begin(), result.end(), by_params);
+		return result;
+	}
+
+	/**
+	 * Intersect two rational curves, see intersect_curves on Bezier segments
+	 * @param[in] a First RationalCurve object
+	 * @param[in] b Second RationalCurve object
+	 * @param[in] tolerance Distance in model units below which two points are one
+	 * @return Intersection points and coincident parts ordered by the parameter on the first curve,
+	 * empty if a curve is invalid.
+	 */
+	inline std::vector<CurveIntersection> intersect_curves(const RationalCurve& a, const RationalCurve& b, scalar tolerance = 1e-5f)
+	{
+		return intersect_curves(decompose_curve(a), decompose_curve(b), tolerance);
+	}
+}
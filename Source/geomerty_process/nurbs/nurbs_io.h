@@ -227,30 +227,30 @@ namespace Geomerty
 
 			inline void surface_write_obj(std::ostream& os, unsigned int deg_u, unsigned int deg_v,
 				const std::vector<scalar>& knots_u, const std::vector<scalar>& knots_v,
-				const std::vector<std::vector<vec3>>& ctrlPts, const std::vector<std::vector<scalar>>& weights, bool rational)
+				const Array2<vec3>& ctrlPts, const Array2<scalar>& weights, bool rational)
 			{
 
 				using std::endl;
 
-				if (ctrlPts.size() == 0 || ctrlPts[0].size() == 0)
+				if (ctrlPts.rows() == 0 || ctrlPts.cols() == 0)
 				{
 					return;
 				}
 
-				for (int j = 0; j < ctrlPts[0].size(); j++)
+				for (size_t j = 0; j < ctrlPts.cols(); j++)
 				{
-					for (int i = 0; i < ctrlPts.size(); i++)
+					for (size_t i = 0; i < ctrlPts.rows(); i++)
 					{
-						os << "v " << ctrlPts[i][j][0] << " " << ctrlPts[i][j][1] << " " << ctrlPts[i][j][2]
-							<< " " << weights[i][j] << endl;
+						os << "v " << ctrlPts(i, j)[0] << " " << ctrlPts(i, j)[1] << " " << ctrlPts(i, j)[2]
+							<< " " << weights(i, j) << endl;
 					}
 				}
 
 				int nknots_u = knots_u.size();
 				int nknots_v = knots_v.size();
 
-				int nCpU = ctrlPts.size();
-				int nCpV = ctrlPts[0].size();
+				int nCpU = ctrlPts.rows();
+				int nCpV = ctrlPts.cols();
 
 				if (!rational)
 				{
@@ -293,7 +293,7 @@ namespace Geomerty
 
 			inline void surfaceReadOBJ(std::istream& is, size_t& deg_u, size_t& deg_v,
 				std::vector<scalar>& knots_u, std::vector<scalar>& knots_v,
-				std::vector<std::vector<vec3>>& ctrlPts, std::vector<std::vector<scalar>>& weights, bool& rational)
+				Array2<vec3>& ctrlPts, Array2<scalar>& weights, bool& rational)
 			{
 				scalar uknot_min = 0, uknot_max = 1;
 				scalar vknot_min = 0, vknot_max = 1;
@@ -445,16 +445,15 @@ namespace Geomerty
 				int num_cp_u = num_knots_u - deg_u - 1;
 				int num_cp_v = num_knots_v - deg_v - 1;
 
-				ctrlPts = std::vector<std::vector<vec3>>(num_cp_u, std::vector<vec3>(num_cp_v, vec3::Zero()));
-				weights = std::vector<std::vector<scalar>>(num_cp_u, std::vector<scalar>(num_cp_v, 0.0));
+				ctrlPts.assign(num_cp_u, num_cp_v, vec3::Zero());
+				weights.assign(num_cp_u, num_cp_v, 0.0f);
 				size_t num = 0;
 				for (int j = 0; j < num_cp_v; ++j)
 				{
 					for (int i = 0; i < num_cp_u; ++i)
 					{
-						assert(i < ctrlPts.size() && j < ctrlPts[0].size());
-						ctrlPts[i][j] = ctrl_pts_buf[indices[num] - 1];
-						weights[i][j] = weights_buf[indices[num] - 1];
+						ctrlPts(i, j) = ctrl_pts_buf[indices[num] - 1];
+						weights(i, j) = weights_buf[indices[num] - 1];
 						++num;
 					}
 				}
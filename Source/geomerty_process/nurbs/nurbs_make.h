@@ -289,14 +289,14 @@ namespace Geomerty::nurbs::util
 	{
 		int n = profile.m_control_points.size() - 1;
 		int m = rail.m_control_points.size() - 1;
-		std::vector<std::vector<vec3>> controlPoints(n + 1, std::vector<vec3>(m + 1));
-		std::vector<std::vector<scalar>> weights(n + 1, std::vector<float>(m + 1));
+		Array2<vec3> controlPoints(n + 1, m + 1);
+		Array2<scalar> weights(n + 1, m + 1);
 		for (int i = 0; i <= n; i++)
 		{
 			for (int j = 0; j <= m; j++)
 			{
-				controlPoints[i][j] = rail.m_control_points[j] / rail.m_weights[j] + profile.m_control_points[i] / profile.m_weights[i];
-				weights[i][j] = profile.m_weights[i] * rail.m_weights[j];
+				controlPoints(i, j) = rail.m_control_points[j] / rail.m_weights[j] + profile.m_control_points[i] / profile.m_weights[i];
+				weights(i, j) = profile.m_weights[i] * rail.m_weights[j];
 			}
 		}
 
@@ -304,8 +304,8 @@ namespace Geomerty::nurbs::util
 		srf.m_degree_v = rail.m_degree;
 		srf.m_knots_u = profile.m_knots;
 		srf.m_knots_v = rail.m_knots;
-		srf.m_control_points = controlPoints;
-		srf.m_weights = weights;
+		srf.m_control_points.swap(controlPoints);
+		srf.m_weights.swap(weights);
 	}
 	inline void loft_surface(const std::vector<RationalCurve>& sections, RationalSurface& srf, int custom_trajectory_degree = 0,
 		const std::vector<scalar>& custom_trajectory_knot_vector = {})
@@ -381,40 +381,33 @@ namespace Geomerty::nurbs::util
 			degree_v = custom_trajectory_degree;
 			vl = custom_trajectory_knot_vector;
 		}
-		std::vector<scalar> knot_vector_v = average_knot_vector(degree_v, vl);
-		std::vector<std::vector<vec3>> control_points;
-		std::vector<std::vector<scalar>> control_points_weight;
+		// Every column of control points is interpolated at vl, one factorisation serves all of them
+		CurveInterpolator interpolator(degree_v, vl);
+		if (!interpolator.is_valid())
+		{
+			return;
+		}
+		std::vector<scalar> knot_vector_v = interpolator.knots();
 		int column = curves_control_points[0].size();
-		for (int c = 0; c < column; c++)
+		Array2<vec3> grid(size, column);
+		Array2<scalar> grid_weights(size, column);
+		for (int k = 0; k < size; k++)
 		{
-			std::vector<vec3> temp(size);
-			std::vector<scalar> weight_cache(size);
-			for (int k = 0; k < size; k++)
-			{
-				vec3 cp = curves_control_points[k][c];
-				scalar w = curves_weight[k][c];
-				weight_cache[k] = w;
-				temp[k] = cp / w;
-			}
-			RationalCurve tc;
-			global_interpolation(degree_v, temp, tc, vl);
-			for (int i = 0; i < tc.m_control_points.size(); i++)
+			for (int c = 0; c < column; c++)
 			{
-				vec3 cp = tc.m_control_points[i];
-				scalar w = tc.m_weights[i];
-				tc.m_control_points[i] = cp / w;
-				tc.m_weights[i] = weight_cache[i];
+				grid(k, c) = curves_control_points[k][c] / curves_weight[k][c];
+				grid_weights(k, c) = curves_weight[k][c];
 			}
-			control_points.emplace_back(tc.m_control_points);
-			control_points_weight.emplace_back(tc.m_weights);
 		}
+		interpolator.solve_many(grid.data(), column);
 
+		// Sections run along u, the interpolated columns along v
 		srf.m_degree_u = degree_u;
 		srf.m_degree_v = degree_v;
 		srf.m_knots_u = internals[0].m_knots;
 		srf.m_knots_v = knot_vector_v;
-		srf.m_control_points = control_points;
-		srf.m_weights = control_points_weight;
+		srf.m_control_points = grid.transposed();
+		srf.m_weights = grid_weights.transposed();
 	}
 	//++++
 	bool cylindrical_surface(const vec3& origin, const vec3& xAxis, const vec3& yAxis, scalar startRad, scalar endRad, scalar radius, scalar height, RationalSurface& surface)
@@ -433,27 +426,27 @@ namespace Geomerty::nurbs::util
 		vec3 halfTranslation = 0.5 * height * axis;
 
 		int size = arc.m_control_points.size();
-		std::vector<std::vector<vec3>> controlPoints(3, std::vector<vec3>(size));
-		std::vector<std::vector<float>> controlPoints_W(3, std::vector<scalar>(size));
+		Array2<vec3> controlPoints(3, size);
+		Array2<scalar> controlPoints_W(3, size);
 
 
 		for (int i = 0; i < size; i++)
 		{
 			vec3 car_pos = arc.m_control_points[i] / arc.m_weights[i];
-			controlPoints_W[2][i] = arc.m_weights[i];
-			controlPoints_W[1][i] = arc.m_weights[i];
-			controlPoints_W[0][i] = arc.m_weights[i];
-			controlPoints[2][i] = car_pos;
-			controlPoints[1][i] = halfTranslation + car_pos;
-			controlPoints[0][i] = translation + car_pos;
+			controlPoints_W(2, i) = arc.m_weights[i];
+			controlPoints_W(1, i) = arc.m_weights[i];
+			controlPoints_W(0, i) = arc.m_weights[i];
+			controlPoints(2, i) = car_pos;
+			controlPoints(1, i) = halfTranslation + car_pos;
+			controlPoints(0, i) = translation + car_pos;
 		}
 
 		surface.m_degree_u = 2;
 		surface.m_degree_v = 2;
 		surface.m_knots_u = { 0,0,0,1,1,1 };
 		surface.m_knots_v = arc.m_knots;
-		surface.m_control_points = controlPoints;
-		surface.m_weights = controlPoints_W;
+		surface.m_control_points.swap(controlPoints);
+		surface.m_weights.swap(controlPoints_W);
 		return true;
 	}
 	void bilinear_surface(const vec3& topLeftPoint, const vec3& topRightPoint, const vec3& bottomLeftPoint, const vec3& bottomRightPoint, RationalSurface& surface)
@@ -463,22 +456,19 @@ namespace Geomerty::nurbs::util
 
 		std::vector<scalar> knotVectorU;
 		std::vector<scalar> knotVectorV;
-		std::vector<std::vector<vec3>> controlPoints;
-		std::vector<std::vector<scalar>> controlPoints_w(degree + 1, std::vector<scalar>(degree + 1, 1.0));
+		Array2<vec3> controlPoints(degree + 1, degree + 1);
+		Array2<scalar> controlPoints_w(degree + 1, degree + 1, 1.0f);
 
 		for (int i = 0; i <= degree; i++)
 		{
-			std::vector<vec3> row;
 			scalar l = 1.0 - i / (scalar)degree;
 			for (int j = 0; j <= degree; j++)
 			{
 				vec3 d1 = l * topLeftPoint + (1 - l) * bottomLeftPoint;
 				vec3 d2 = l * topRightPoint + (1 - l) * bottomRightPoint;
 
-				vec3 res = d1 * (1 - j / (scalar)degree) + (j / (scalar)degree) * d2;
-				row.emplace_back(res);
+				controlPoints(i, j) = d1 * (1 - j / (scalar)degree) + (j / (scalar)degree) * d2;
 			}
-			controlPoints.emplace_back(row);
 
 			knotVectorU.insert(knotVectorU.begin(), 0.0);
 			knotVectorU.emplace_back(1.0);
@@ -488,8 +478,8 @@ namespace Geomerty::nurbs::util
 		}
 		surface.m_knots_u = knotVectorU;
 		surface.m_knots_v = knotVectorV;
-		surface.m_control_points = controlPoints;
-		surface.m_weights = controlPoints_w;
+		surface.m_control_points.swap(controlPoints);
+		surface.m_weights.swap(controlPoints_w);
 	}
 
 }// namespace nous::nurbs::util
@@ -0,0 +1,930 @@
+#pragma once
+#include <Eigen/Dense>
+#include <algorithm>
+#include <array>
+#include <span>
+#include <tuple>
+
+#include "glviewer/parallel_for.h"
+#include "nurbs_curve.h"
+#include "nurbs_evalute_curve.h"
+#include "nurbs_evalute_surface.h"
+#include "nurbs_surface.h"
+#include "nurbs_util.h"
+
+namespace Geomerty::nurbs::util
+{
+	inline constexpr int N_MAX_NEWTON_ITERATIONS = 20;
+
+	namespace internal
+	{
+		/*
+		 * Bounding volume hierarchy over the boxes of Bezier segments or patches, split at the median
+		 * along the longest axis. The children of an inner node are stored at child and child + 1.
+		 */
+		class BoxTree
+		{
+		public:
+			BoxTree() = default;
+			explicit BoxTree(const std::vector<AABB3>& boxes)
+			{
+				if (boxes.empty())
+				{
+					return;
+				}
+				std::vector<int> leaves(boxes.size());
+				for (int i = 0; i < static_cast<int>(leaves.size()); i++)
+				{
+					leaves[i] = i;
+				}
+				m_nodes.reserve(2 * leaves.size());
+				m_nodes.emplace_back();
+				build(boxes, leaves, 0, 0, static_cast<int>(leaves.size()));
+			}
+
+			bool empty() const { return m_nodes.empty(); }
+
+			/*
+			 * Call visit(leaf) for every leaf whose box is nearer to pos than distance, nearer child first.
+			 * visit may lower distance, which prunes the boxes not visited yet.
+			 */
+			template<typename Visit>
+			void nearest(const vec3& pos, const scalar& distance, Visit&& visit) const
+			{
+				if (m_nodes.empty())
+				{
+					return;
+				}
+				// Depth first; the depth of a median split hierarchy is log2 of the leaf count
+				std::array<std::pair<scalar, int>, 64> stack;
+				int top = 0;
+				stack[top++] = { m_nodes[0].box.squaredExteriorDistance(pos), 0 };
+				while (top > 0)
+				{
+					const auto [box_distance, index] = stack[--top];
+					if (box_distance >= distance * distance)
+					{
+						continue;
+					}
+					const Node& node = m_nodes[index];
+					if (node.leaf >= 0)
+					{
+						visit(node.leaf);
+						continue;
+					}
+					scalar d0 = m_nodes[node.child].box.squaredExteriorDistance(pos);
+					scalar d1 = m_nodes[node.child + 1].box.squaredExteriorDistance(pos);
+					if (d0 < d1)
+					{
+						stack[top++] = { d1, node.child + 1 };
+						stack[top++] = { d0, node.child };
+					}
+					else
+					{
+						stack[top++] = { d0, node.child };
+						stack[top++] = { d1, node.child + 1 };
+					}
+				}
+			}
+
+		private:
+			struct Node
+			{
+				AABB3 box;
+				int child = -1;
+				int leaf = -1;
+			};
+
+			void build(const std::vector<AABB3>& boxes, std::vector<int>& leaves, int node, int first, int last)
+			{
+				AABB3 box;
+				for (int i = first; i < last; i++)
+				{
+					box.extend(boxes[leaves[i]]);
+				}
+				m_nodes[node].box = box;
+				if (last - first == 1)
+				{
+					m_nodes[node].leaf = leaves[first];
+					return;
+				}
+
+				// Median split along the longest axis of the box
+				int axis = 0;
+				box.sizes().maxCoeff(&axis);
+				const int mid = (first + last) / 2;
+				std::nth_element(leaves.begin() + first, leaves.begin() + mid, leaves.begin() + last,
+					[&](int a, int b) { return boxes[a].center()[axis] < boxes[b].center()[axis]; });
+
+				const int child = static_cast<int>(m_nodes.size());
+				m_nodes[node].child = child;
+				m_nodes.resize(m_nodes.size() + 2);
+				build(boxes, leaves, child, first, mid);
+				build(boxes, leaves, child + 1, mid, last);
+			}
+
+			std::vector<Node> m_nodes;
+		};
+	}// namespace internal
+
+	/**
+	 * Result of projecting a point onto a curve
+	 */
+	struct CurveProjection
+	{
+		scalar param = 0.0f;
+		vec3 point = vec3::Zero();
+		scalar distance = std::numeric_limits<scalar>::max();
+	};
+
+	/**
+	 * Exact closest point queries on a rational curve.
+	 * The curve is decomposed into Bezier segments once and their control hull boxes are kept in a
+	 * bounding volume hierarchy. A query walks the hierarchy nearest box first, prunes every box
+	 * farther than the best point found, seeds each visited segment with a coarse sample and refines
+	 * the seed with Newton iteration on (C(u) - P) . C'(u) = 0.
+	 * The projector is read-only after construction and may be shared between threads.
+	 */
+	class CurveProjector
+	{
+	public:
+		CurveProjector() = default;
+		explicit CurveProjector(const RationalCurve& crv) : CurveProjector(CurveEvaluator(crv)) {}
+		explicit CurveProjector(const CurveEvaluator& evaluator);
+
+		bool is_valid() const { return m_evaluator.is_valid() && m_segments.size() > 0; }
+		const CurveEvaluator& evaluator() const { return m_evaluator; }
+		const BezierSegments& segments() const { return m_segments; }
+		const std::vector<AABB3>& boxes() const { return m_boxes; }
+
+		/**
+		 * Project a point onto the curve
+		 * @param[in] pos Point to project
+		 * @param[in] tolerance Distance in model units the returned point may be away from the exact foot point
+		 * @return Parameter, point and distance of the closest point, distance is max() if the curve is invalid.
+		 */
+		CurveProjection project(const vec3& pos, scalar tolerance = 1e-5f) const;
+		/**
+		 * Project a point onto the curve, warm started from a parameter near the result
+		 * e.g. the parameter of the previous point of a polyline. The Bezier segment containing start is
+		 * refined from start instead of a coarse seed, the other segments are searched as in project()
+		 * and a close start lets more of them be pruned.
+		 * @param[in] pos Point to project
+		 * @param[in] tolerance Distance in model units the returned point may be away from the exact foot point
+		 * @param[in] start Parameter to start from
+		 * @return Parameter, point and distance of the closest point, distance is max() if the curve is invalid.
+		 */
+		CurveProjection project(const vec3& pos, scalar tolerance, scalar start) const;
+		/**
+		 * Refine a parameter to the nearest foot point on one Bezier segment with Newton iteration
+		 * @param[in] pos Point to project
+		 * @param[in] segment Index of the Bezier segment, the iteration is kept inside it
+		 * @param[in] u Start parameter
+		 * @param[in] tolerance Distance in model units the returned point may be away from the exact foot point
+		 * @return Parameter, point and distance of the local foot point.
+		 */
+		CurveProjection refine(const vec3& pos, size_t segment, scalar u, scalar tolerance) const;
+		/**
+		 * Index of the Bezier segment containing a parameter, clamped to the curve domain
+		 */
+		size_t segment_of(scalar u) const;
+
+	private:
+		void search(const vec3& pos, scalar tolerance, int skip, CurveProjection& best) const;
+		CurveProjection project_segment(const vec3& pos, size_t segment, scalar tolerance) const;
+
+		CurveEvaluator m_evaluator;
+		BezierSegments m_segments;
+		std::vector<AABB3> m_boxes;
+		internal::BoxTree m_tree;
+	};
+
+	inline CurveProjector::CurveProjector(const CurveEvaluator& evaluator)
+		: m_evaluator(evaluator), m_segments(decompose_curve(m_evaluator))
+	{
+		const size_t degree = m_segments.degree;
+		m_boxes.resize(m_segments.size());
+		for (size_t s = 0; s < m_segments.size(); s++)
+		{
+			const vec4* cw = m_segments.segment(s);
+			AABB3& box = m_boxes[s];
+			for (int i = 0; i <= static_cast<int>(degree); i++)
+			{
+				if (!(cw[i].w() > 0.0f))
+				{
+					// The curve only lies in the control hull for positive weights, never cull this segment
+					box.min().setConstant(-std::numeric_limits<scalar>::infinity());
+					box.max().setConstant(std::numeric_limits<scalar>::infinity());
+					break;
+				}
+				box.extend(homogenous_to_cartesian(cw[i]));
+			}
+		}
+
+		m_tree = internal::BoxTree(m_boxes);
+	}
+
+	inline CurveProjection CurveProjector::refine(const vec3& pos, size_t segment, scalar u, scalar tolerance) const
+	{
+		// Iterate on the local parameter of the Bezier segment, so that derivatives at its ends
+		// are never taken from the neighbouring span. Newton runs in double, the residual
+		// diff.dot(d1) cancels badly in float near the foot point.
+		using dvec3 = vec3_t<double>;
+		const size_t degree = m_segments.degree;
+		const auto cw = bezier_cast<double, scalar>(m_segments.segment(segment), degree);
+		const dvec3 target = pos.cast<double>();
+		const double lo = m_segments.breaks[segment];
+		const double width = m_segments.breaks[segment + 1] - lo;
+		double t = width > 0.0 ? std::clamp((u - lo) / width, 0.0, 1.0) : 0.0;
+
+		std::array<dvec3, 3> ders;
+		for (int iter = 0; iter < N_MAX_NEWTON_ITERATIONS; iter++)
+		{
+			bezier_derivatives(cw.data(), degree, t, 2, ders.data());
+			const dvec3 diff = ders[0] - target;
+			const double speed = ders[1].norm();
+			const double f = diff.dot(ders[1]);
+			// Zero cosine, the tangential offset is within tolerance
+			if (std::abs(f) <= tolerance * speed)
+			{
+				break;
+			}
+			double df = ders[1].dot(ders[1]) + diff.dot(ders[2]);
+			if (!(df > 0.0))
+			{
+				// Away from a minimum the curvature term may point to a maximum, fall back to Gauss-Newton
+				df = ders[1].dot(ders[1]);
+				if (!(df > 0.0))
+				{
+					break;
+				}
+			}
+			const double next = std::clamp(t - f / df, 0.0, 1.0);
+			const double step = std::abs(next - t) * speed;
+			t = next;
+			if (step <= tolerance)
+			{
+				break;
+			}
+		}
+		CurveProjection result;
+		result.param = static_cast<scalar>(lo + width * t);
+		result.point = homogenous_to_cartesian(bezier_point(cw.data(), degree, t)).cast<scalar>();
+		result.distance = (result.point - pos).norm();
+		return result;
+	}
+
+	inline size_t CurveProjector::segment_of(scalar u) const
+	{
+		const auto& breaks = m_segments.breaks;
+		size_t s = std::upper_bound(breaks.begin() + 1, breaks.end() - 1, u) - (breaks.begin() + 1);
+		return std::min(s, m_segments.size() - 1);
+	}
+
+	inline CurveProjection CurveProjector::project_segment(const vec3& pos, size_t segment, scalar tolerance) const
+	{
+		// Coarse seed on the Bezier segment
+		const vec4* cw = m_segments.segment(segment);
+		const size_t degree = m_segments.degree;
+		const int samples = 2 * static_cast<int>(degree) + 2;
+		scalar seed_t = 0.0f;
+		scalar seed_distance = std::numeric_limits<scalar>::max();
+		for (int k = 0; k <= samples; k++)
+		{
+			scalar t = static_cast<scalar>(k) / static_cast<scalar>(samples);
+			scalar d = (homogenous_to_cartesian(bezier_point(cw, degree, t)) - pos).squaredNorm();
+			if (d < seed_distance)
+			{
+				seed_distance = d;
+				seed_t = t;
+			}
+		}
+		const scalar lo = m_segments.breaks[segment];
+		const scalar hi = m_segments.breaks[segment + 1];
+		return refine(pos, segment, lo + (hi - lo) * seed_t, tolerance);
+	}
+
+	inline void CurveProjector::search(const vec3& pos, scalar tolerance, int skip, CurveProjection& best) const
+	{
+		m_tree.nearest(pos, best.distance, [&](int segment)
+			{
+				if (segment == skip)
+				{
+					return;
+				}
+				CurveProjection candidate = project_segment(pos, segment, tolerance);
+				if (candidate.distance < best.distance)
+				{
+					best = candidate;
+				}
+			});
+	}
+
+	inline CurveProjection CurveProjector::project(const vec3& pos, scalar tolerance) const
+	{
+		CurveProjection best;
+		if (is_valid())
+		{
+			search(pos, tolerance, -1, best);
+		}
+		return best;
+	}
+
+	inline CurveProjection CurveProjector::project(const vec3& pos, scalar tolerance, scalar start) const
+	{
+		CurveProjection best;
+		if (is_valid())
+		{
+			// The start segment is refined from start instead of a coarse seed
+			const size_t segment = segment_of(start);
+			best = refine(pos, segment, start, tolerance);
+			search(pos, tolerance, static_cast<int>(segment), best);
+		}
+		return best;
+	}
+
+	/**
+	 * Project a point onto a rational curve, see CurveProjector
+	 * @param[in] crv RationalCurve object
+	 * @param[in] pos Point to project
+	 * @param[in] tolerance Distance in model units the returned point may be away from the exact foot point
+	 * @return Parameter, point and distance of the closest point.
+	 */
+	inline CurveProjection project_point_to_curve(const RationalCurve& crv, const vec3& pos, scalar tolerance = 1e-5f)
+	{
+		return CurveProjector(crv).project(pos, tolerance);
+	}
+
+	/**
+	 * Evaluate the closest point to a NURBS curve, see CurveProjector
+	 * @param[in] evaluator CurveEvaluator of the curve
+	 * @param[in] pos Point to project
+	 * @return The closest point on the curve.
+	 */
+	inline vec3 curve_closest_point(const CurveEvaluator& evaluator, const vec3& pos) { return CurveProjector(evaluator).project(pos).point; }
+	inline vec3 curve_closest_point(const RationalCurve& crv, const vec3& pos) { return CurveProjector(crv).project(pos).point; }
+	/*
+	 * The projection is exact, segments is ignored
+	 */
+	[[deprecated("use curve_closest_point(evaluator, pos)")]] inline vec3 curve_closest_point(const CurveEvaluator& evaluator, vec3 pos, int /*segments*/)
+	{
+		return curve_closest_point(evaluator, pos);
+	}
+	[[deprecated("use curve_closest_point(crv, pos)")]] inline vec3 curve_closest_point(const RationalCurve& crv, vec3 pos, int /*segments*/)
+	{
+		return curve_closest_point(crv, pos);
+	}
+
+	/**
+	 * Project a batch of points onto a curve in parallel.
+	 * Points are processed in contiguous chunks across all cores, all sharing the projector.
+	 * @param[in] projector CurveProjector of the curve
+	 * @param[in] points Points to project
+	 * @param[out] params params[i] is the parameter of the closest point to points[i].
+	 * @param[out] residuals residuals[i] is the distance from points[i] to the curve.
+	 * @param[in] ordered Whether consecutive points are close to each other (scanlines, polylines),
+	 * each point is then warm started from the parameter of the previous one.
+	 * @param[in] tolerance Distance in model units a foot point may be away from the exact one
+	 */
+	inline void project_points_to_curve(const CurveProjector& projector, std::span<const vec3> points, std::span<scalar> params, std::span<scalar> residuals,
+		bool ordered = false, scalar tolerance = 1e-5f)
+	{
+		assert(params.size() >= points.size() && residuals.size() >= points.size());
+		constexpr size_t chunk_size = 256;
+		const size_t chunks = (points.size() + chunk_size - 1) / chunk_size;
+		parallel_for(chunks, [&](size_t chunk)
+			{
+				const size_t first = chunk * chunk_size;
+				const size_t last = std::min(first + chunk_size, points.size());
+				for (size_t i = first; i < last; i++)
+				{
+					CurveProjection result = ordered && i > first ? projector.project(points[i], tolerance, params[i - 1]) : projector.project(points[i], tolerance);
+					params[i] = result.param;
+					residuals[i] = result.distance;
+				}
+			}, 2);
+	}
+
+	/**
+	 * Project a batch of points onto a rational curve in parallel, see CurveProjector
+	 * @param[in] crv RationalCurve object
+	 * @param[in] points Points to project
+	 * @param[in] ordered Whether consecutive points are close to each other (scanlines, polylines)
+	 * @param[in] tolerance Distance in model units a foot point may be away from the exact one
+	 * @return Parameters of the closest points and distances from the points to the curve.
+	 */
+	inline std::tuple<std::vector<scalar>, std::vector<scalar>> project_points_to_curve(const RationalCurve& crv, std::span<const vec3> points,
+		bool ordered = false, scalar tolerance = 1e-5f)
+	{
+		std::vector<scalar> params(points.size());
+		std::vector<scalar> residuals(points.size());
+		project_points_to_curve(CurveProjector(crv), points, params, residuals, ordered, tolerance);
+		return std::make_tuple(std::move(params), std::move(residuals));
+	}
+
+	/**
+	 * Result of projecting a point onto a surface
+	 */
+	struct SurfaceProjection
+	{
+		scalar u = 0.0f;
+		scalar v = 0.0f;
+		vec3 point = vec3::Zero();
+		scalar distance = std::numeric_limits<scalar>::max();
+	};
+
+	/**
+	 * Exact closest point queries on a rational surface.
+	 * The surface is decomposed into Bezier patches once, their control hull boxes are kept in a bounding
+	 * volume hierarchy and a coarse grid of seed points is sampled on every patch. A query walks the
+	 * hierarchy nearer box first, prunes every box farther than the best point found, and on each visited
+	 * patch refines the grid points nearer than their neighbours with Newton iteration on
+	 * (S(u, v) - P) . Su = (S(u, v) - P) . Sv = 0, clamped to the patch. A foot point left on the border
+	 * of the domain, or where Newton did not converge, is checked against the boundary curves.
+	 * The projector is read-only after construction and may be shared between threads.
+	 */
+	class SurfaceProjector
+	{
+	public:
+		SurfaceProjector() = default;
+		explicit SurfaceProjector(const RationalSurface& srf);
+
+		bool is_valid() const { return m_evaluator.is_valid() && m_patches.size() > 0; }
+		const SurfaceEvaluator& evaluator() const { return m_evaluator; }
+		const BezierPatches& patches() const { return m_patches; }
+		const std::vector<AABB3>& boxes() const { return m_boxes; }
+
+		/**
+		 * Project a point onto the surface
+		 * @param[in] pos Point to project
+		 * @param[in] tolerance Distance in model units the returned point may be away from the exact foot point
+		 * @return Parameters, point and distance of the closest point, distance is max() if the surface is invalid.
+		 */
+		SurfaceProjection project(const vec3& pos, scalar tolerance = 1e-5f) const;
+		/**
+		 * Project a point onto the surface, warm started from parameters near the result
+		 * e.g. those of the previous point of a scanline. The Bezier patch containing (u, v) is
+		 * refined from (u, v) instead of a seed, the other patches are searched as in project().
+		 * @param[in] pos Point to project
+		 * @param[in] tolerance Distance in model units the returned point may be away from the exact foot point
+		 * @param[in] u Parameter along u to start from
+		 * @param[in] v Parameter along v to start from
+		 * @return Parameters, point and distance of the closest point, distance is max() if the surface is invalid.
+		 */
+		SurfaceProjection project(const vec3& pos, scalar tolerance, scalar u, scalar v) const;
+		/**
+		 * Refine parameters to the nearest foot point on one Bezier patch with Newton iteration
+		 * @param[in] pos Point to project
+		 * @param[in] patch Index s * patches().size_v() + t of Bezier patch (s, t), the iteration is kept inside it
+		 * @param[in] u Start parameter along u
+		 * @param[in] v Start parameter along v
+		 * @param[in] tolerance Distance in model units the returned point may be away from the exact foot point
+		 * @return Parameters, point and distance of the local foot point.
+		 */
+		SurfaceProjection refine(const vec3& pos, size_t patch, scalar u, scalar v, scalar tolerance) const;
+		/**
+		 * Index of the Bezier patch containing (u, v), clamped to the surface domain
+		 */
+		size_t patch_of(scalar u, scalar v) const;
+
+	private:
+		SurfaceProjection newton(const vec3& pos, size_t patch, scalar u, scalar v, scalar tolerance, bool& converged) const;
+		SurfaceProjection project_patch(const vec3& pos, size_t patch, scalar tolerance, bool& converged) const;
+		void search(const vec3& pos, scalar tolerance, int skip, SurfaceProjection& best, bool& converged) const;
+		void project_boundary(const vec3& pos, scalar tolerance, bool all, SurfaceProjection& best) const;
+
+		SurfaceEvaluator m_evaluator;
+		BezierPatches m_patches;
+		std::vector<AABB3> m_boxes;
+		internal::BoxTree m_tree;
+		// Seed point (a, b) of patch (s, t) is m_seeds[(s * m_seeds_u + a) * (size_v * m_seeds_v + 1) + t * m_seeds_v + b]
+		std::vector<vec3> m_seeds;
+		int m_seeds_u = 0, m_seeds_v = 0;
+		// Boundary curves at u_min and u_max along v, at v_min and v_max along u
+		std::array<CurveProjector, 4> m_boundary;
+	};
+
+	inline SurfaceProjector::SurfaceProjector(const RationalSurface& srf)
+		: m_evaluator(srf), m_patches(decompose_surface(m_evaluator))
+	{
+		if (m_patches.size() == 0)
+		{
+			return;
+		}
+		const size_t pu = m_patches.degree_u;
+		const size_t pv = m_patches.degree_v;
+		const size_t size_u = m_patches.size_u();
+		const size_t size_v = m_patches.size_v();
+		const size_t count = m_patches.stride();
+		// Seed grid as dense as the samples CurveProjector takes on a Bezier segment
+		const int nu = m_seeds_u = 2 * static_cast<int>(pu) + 2;
+		const int nv = m_seeds_v = 2 * static_cast<int>(pv) + 2;
+		const size_t row = size_v * nv + 1;
+		m_boxes.resize(m_patches.size());
+		m_seeds.resize((size_u * nu + 1) * row);
+		parallel_for(m_patches.size(), [&](size_t patch)
+			{
+				const size_t s = patch / size_v;
+				const size_t t = patch % size_v;
+				const vec4* cw = m_patches.patch(s, t);
+				if (!internal::bezier_hull_box(cw, count, m_boxes[patch]))
+				{
+					// The surface only lies in the control hull for positive weights, never cull this patch
+					m_boxes[patch].min().setConstant(-std::numeric_limits<scalar>::infinity());
+					m_boxes[patch].max().setConstant(std::numeric_limits<scalar>::infinity());
+				}
+
+				// Neighbouring patches share their border samples, the last patch in each direction writes them
+				std::array<vec4, N_MAX_DEGREE + 1> line, rows;
+				const int last_a = (s + 1 == size_u) ? nu : nu - 1;
+				const int last_b = (t + 1 == size_v) ? nv : nv - 1;
+				for (int a = 0; a <= last_a; a++)
+				{
+					const scalar su = static_cast<scalar>(a) / nu;
+					for (size_t l = 0; l <= pv; l++)
+					{
+						for (size_t k = 0; k <= pu; k++)
+						{
+							line[k] = cw[k * (pv + 1) + l];
+						}
+						rows[l] = bezier_point(line.data(), pu, su);
+					}
+					vec3* seeds = m_seeds.data() + (s * nu + a) * row + t * nv;
+					for (int b = 0; b <= last_b; b++)
+					{
+						seeds[b] = homogenous_to_cartesian(bezier_point(rows.data(), pv, static_cast<scalar>(b) / nv));
+					}
+				}
+			}, 16);
+		m_tree = internal::BoxTree(m_boxes);
+
+		const auto& cw = m_evaluator.homogenous_points();
+		auto boundary = [&](size_t degree, const std::vector<scalar>& knots, auto point, size_t size)
+		{
+			std::vector<vec3> points(size);
+			std::vector<scalar> weights(size);
+			for (size_t i = 0; i < size; i++)
+			{
+				const vec4& p = point(i);
+				points[i] = homogenous_to_cartesian(p);
+				weights[i] = p.w();
+			}
+			return CurveProjector(RationalCurve(degree, knots, points, weights));
+		};
+		const size_t rows_u = cw.rows(), cols_v = cw.cols();
+		const auto& knots_u = m_evaluator.basis_u().knots();
+		const auto& knots_v = m_evaluator.basis_v().knots();
+		m_boundary[0] = boundary(pv, knots_v, [&](size_t j) { return cw(0, j); }, cols_v);
+		m_boundary[1] = boundary(pv, knots_v, [&](size_t j) { return cw(rows_u - 1, j); }, cols_v);
+		m_boundary[2] = boundary(pu, knots_u, [&](size_t i) { return cw(i, 0); }, rows_u);
+		m_boundary[3] = boundary(pu, knots_u, [&](size_t i) { return cw(i, cols_v - 1); }, rows_u);
+	}
+
+	inline SurfaceProjection SurfaceProjector::newton(const vec3& pos, size_t patch, scalar u, scalar v, scalar tolerance, bool& converged) const
+	{
+		// Iterate on the local parameters of the Bezier patch in double as CurveProjector::refine does.
+		// A parameter stepping out of the patch is held on its border and the other one solved alone,
+		// so a foot point on the border of the patch is found as well.
+		using dvec3 = vec3_t<double>;
+		using dvec4 = vec4_t<double>;
+		const size_t pu = m_patches.degree_u;
+		const size_t pv = m_patches.degree_v;
+		const size_t s_index = patch / m_patches.size_v();
+		const size_t t_index = patch % m_patches.size_v();
+		const vec4* patch_cw = m_patches.patch(s_index, t_index);
+		std::array<dvec4, (N_MAX_DEGREE + 1) * (N_MAX_DEGREE + 1)> cw;
+		for (size_t k = 0; k < m_patches.stride(); k++)
+		{
+			cw[k] = patch_cw[k].cast<double>();
+		}
+		const dvec3 target = pos.cast<double>();
+		const double lo_u = m_patches.breaks_u[s_index];
+		const double width_u = m_patches.breaks_u[s_index + 1] - lo_u;
+		const double lo_v = m_patches.breaks_v[t_index];
+		const double width_v = m_patches.breaks_v[t_index + 1] - lo_v;
+		double s = width_u > 0.0 ? std::clamp((u - lo_u) / width_u, 0.0, 1.0) : 0.0;
+		double t = width_v > 0.0 ? std::clamp((v - lo_v) / width_v, 0.0, 1.0) : 0.0;
+
+		// ders[k * 3 + l] is the derivative k times in s and l times in t
+		std::array<dvec3, 9> ders;
+		converged = false;
+		for (int iter = 0; iter < N_MAX_NEWTON_ITERATIONS; iter++)
+		{
+			bezier_patch_derivatives(cw.data(), pu, pv, s, t, 2, ders.data());
+			const dvec3& Su = ders[3];
+			const dvec3& Sv = ders[1];
+			const dvec3 diff = ders[0] - target;
+			const double f = diff.dot(Su);
+			const double g = diff.dot(Sv);
+			// A parameter on the border of the patch whose gradient points out of it is held there
+			bool hold_s = (s <= 0.0 && f > 0.0) || (s >= 1.0 && f < 0.0);
+			bool hold_t = (t <= 0.0 && g > 0.0) || (t >= 1.0 && g < 0.0);
+			// Zero cosines, the tangential offsets are within tolerance
+			if ((hold_s || std::abs(f) <= tolerance * Su.norm()) && (hold_t || std::abs(g) <= tolerance * Sv.norm()))
+			{
+				converged = true;
+				break;
+			}
+			double j00 = Su.dot(Su) + diff.dot(ders[6]);
+			double j01 = Su.dot(Sv) + diff.dot(ders[4]);
+			double j11 = Sv.dot(Sv) + diff.dot(ders[2]);
+			if (!(j00 > 0.0 && j11 > 0.0 && j00 * j11 - j01 * j01 > 0.0))
+			{
+				// Away from a minimum the curvature terms may point to a saddle or a maximum, fall back to Gauss-Newton
+				j00 = Su.dot(Su);
+				j01 = Su.dot(Sv);
+				j11 = Sv.dot(Sv);
+			}
+			const double det = j00 * j11 - j01 * j01;
+			const bool both = !hold_s && !hold_t && j00 > 0.0 && j11 > 0.0 && det > 0.0;
+			double ds = 0.0, dt = 0.0;
+			if (both)
+			{
+				ds = -(j11 * f - j01 * g) / det;
+				dt = -(j00 * g - j01 * f) / det;
+				// A parameter on the border whose step leaves the patch is held as well
+				hold_s = (s <= 0.0 && ds < 0.0) || (s >= 1.0 && ds > 0.0);
+				hold_t = !hold_s && ((t <= 0.0 && dt < 0.0) || (t >= 1.0 && dt > 0.0));
+			}
+			if (!both || hold_s || hold_t)
+			{
+				ds = dt = 0.0;
+				if (!hold_s && j00 > 0.0 && (hold_t || j00 >= j11))
+				{
+					// Along the border, or at a pole or a degenerate edge where Sv vanishes, step along u alone
+					ds = -f / j00;
+				}
+				else if (!hold_t && j11 > 0.0)
+				{
+					dt = -g / j11;
+				}
+				else
+				{
+					break;
+				}
+			}
+			// Shorten the step to the border of the patch
+			double scale = 1.0;
+			if (s + ds < 0.0 || s + ds > 1.0)
+			{
+				scale = std::min(scale, ((ds < 0.0 ? 0.0 : 1.0) - s) / ds);
+			}
+			if (t + dt < 0.0 || t + dt > 1.0)
+			{
+				scale = std::min(scale, ((dt < 0.0 ? 0.0 : 1.0) - t) / dt);
+			}
+			double next_s = std::clamp(s + scale * ds, 0.0, 1.0);
+			double next_t = std::clamp(t + scale * dt, 0.0, 1.0);
+			// Halve steps that lead away from the point, Newton overshoots where Su or Sv nearly vanishes
+			const double current = diff.squaredNorm();
+			for (int halving = 0; halving < N_MAX_NEWTON_ITERATIONS; halving++)
+			{
+				dvec3 moved;
+				bezier_patch_derivatives(cw.data(), pu, pv, next_s, next_t, 0, &moved);
+				if ((moved - target).squaredNorm() <= current)
+				{
+					break;
+				}
+				next_s = 0.5 * (s + next_s);
+				next_t = 0.5 * (t + next_t);
+			}
+			const double step = ((next_s - s) * Su + (next_t - t) * Sv).norm();
+			s = next_s;
+			t = next_t;
+			if (step <= tolerance)
+			{
+				converged = true;
+				break;
+			}
+		}
+		bezier_patch_derivatives(cw.data(), pu, pv, s, t, 0, ders.data());
+		SurfaceProjection result;
+		result.u = static_cast<scalar>(lo_u + width_u * s);
+		result.v = static_cast<scalar>(lo_v + width_v * t);
+		result.point = ders[0].cast<scalar>();
+		result.distance = (result.point - pos).norm();
+		return result;
+	}
+
+	inline SurfaceProjection SurfaceProjector::refine(const vec3& pos, size_t patch, scalar u, scalar v, scalar tolerance) const
+	{
+		bool converged;
+		return newton(pos, patch, u, v, tolerance, converged);
+	}
+
+	inline size_t SurfaceProjector::patch_of(scalar u, scalar v) const
+	{
+		const auto& breaks_u = m_patches.breaks_u;
+		const auto& breaks_v = m_patches.breaks_v;
+		size_t s = std::upper_bound(breaks_u.begin() + 1, breaks_u.end() - 1, u) - (breaks_u.begin() + 1);
+		size_t t = std::upper_bound(breaks_v.begin() + 1, breaks_v.end() - 1, v) - (breaks_v.begin() + 1);
+		return std::min(s, m_patches.size_u() - 1) * m_patches.size_v() + std::min(t, m_patches.size_v() - 1);
+	}
+
+	inline SurfaceProjection SurfaceProjector::project_patch(const vec3& pos, size_t patch, scalar tolerance, bool& converged) const
+	{
+		// The distance to a patch may have several local minima, start Newton from every local minimum
+		// of the distance to the seed grid on the patch, nearest first
+		constexpr size_t max_starts = 4;
+		constexpr int max_seeds = 2 * N_MAX_DEGREE + 3;
+		const int nu = m_seeds_u, nv = m_seeds_v;
+		const size_t s = patch / m_patches.size_v();
+		const size_t t = patch % m_patches.size_v();
+		const size_t row = m_patches.size_v() * nv + 1;
+		std::array<std::array<scalar, max_seeds>, max_seeds> distances;
+		for (int a = 0; a <= nu; a++)
+		{
+			const vec3* seeds = m_seeds.data() + (s * nu + a) * row + t * nv;
+			for (int b = 0; b <= nv; b++)
+			{
+				distances[a][b] = (seeds[b] - pos).squaredNorm();
+			}
+		}
+		std::array<std::tuple<scalar, int, int>, max_seeds * max_seeds> starts;
+		size_t num_starts = 0;
+		for (int a = 0; a <= nu; a++)
+		{
+			for (int b = 0; b <= nv; b++)
+			{
+				bool minimum = true;
+				for (int na = std::max(a - 1, 0); na <= std::min(a + 1, nu) && minimum; na++)
+				{
+					for (int nb = std::max(b - 1, 0); nb <= std::min(b + 1, nv); nb++)
+					{
+						if (distances[na][nb] < distances[a][b])
+						{
+							minimum = false;
+							break;
+						}
+					}
+				}
+				if (minimum)
+				{
+					starts[num_starts++] = { distances[a][b], a, b };
+				}
+			}
+		}
+		std::sort(starts.begin(), starts.begin() + num_starts);
+
+		const scalar lo_u = m_patches.breaks_u[s], hi_u = m_patches.breaks_u[s + 1];
+		const scalar lo_v = m_patches.breaks_v[t], hi_v = m_patches.breaks_v[t + 1];
+		SurfaceProjection best;
+		for (size_t k = 0; k < std::min(num_starts, max_starts); k++)
+		{
+			const auto [distance, a, b] = starts[k];
+			bool candidate_converged;
+			SurfaceProjection candidate = newton(pos, patch, lo_u + (hi_u - lo_u) * a / nu, lo_v + (hi_v - lo_v) * b / nv, tolerance, candidate_converged);
+			if (candidate.distance < best.distance)
+			{
+				best = candidate;
+				converged = candidate_converged;
+			}
+		}
+		return best;
+	}
+
+	inline void SurfaceProjector::search(const vec3& pos, scalar tolerance, int skip, SurfaceProjection& best, bool& converged) const
+	{
+		m_tree.nearest(pos, best.distance, [&](int patch)
+			{
+				if (patch == skip)
+				{
+					return;
+				}
+				bool candidate_converged;
+				SurfaceProjection candidate = project_patch(pos, patch, tolerance, candidate_converged);
+				if (candidate.distance < best.distance)
+				{
+					best = candidate;
+					converged = candidate_converged;
+				}
+			});
+	}
+
+	inline void SurfaceProjector::project_boundary(const vec3& pos, scalar tolerance, bool all, SurfaceProjection& best) const
+	{
+		const scalar u_min = m_patches.breaks_u.front(), u_max = m_patches.breaks_u.back();
+		const scalar v_min = m_patches.breaks_v.front(), v_max = m_patches.breaks_v.back();
+		const std::array<bool, 4> sides = { best.u <= u_min, best.u >= u_max, best.v <= v_min, best.v >= v_max };
+		for (int side = 0; side < 4; side++)
+		{
+			if (!all && !sides[side])
+			{
+				continue;
+			}
+			// The first two curves run along v, the last two along u. They are searched whole, the foot point
+			// on the surface only shows which border the closest point is near to.
+			const bool along_v = side < 2;
+			const CurveProjection curve = m_boundary[side].project(pos, tolerance);
+			if (curve.distance < best.distance)
+			{
+				best.u = along_v ? (side == 0 ? u_min : u_max) : curve.param;
+				best.v = along_v ? curve.param : (side == 2 ? v_min : v_max);
+				best.point = curve.point;
+				best.distance = curve.distance;
+			}
+		}
+	}
+
+	inline SurfaceProjection SurfaceProjector::project(const vec3& pos, scalar tolerance) const
+	{
+		SurfaceProjection best;
+		if (is_valid())
+		{
+			bool converged = false;
+			search(pos, tolerance, -1, best, converged);
+			project_boundary(pos, tolerance, !converged, best);
+		}
+		return best;
+	}
+
+	inline SurfaceProjection SurfaceProjector::project(const vec3& pos, scalar tolerance, scalar u, scalar v) const
+	{
+		SurfaceProjection best;
+		if (is_valid())
+		{
+			// The start patch is refined from (u, v) instead of a seed
+			const size_t patch = patch_of(u, v);
+			bool converged = false;
+			best = newton(pos, patch, u, v, tolerance, converged);
+			search(pos, tolerance, static_cast<int>(patch), best, converged);
+			project_boundary(pos, tolerance, !converged, best);
+		}
+		return best;
+	}
+
+	/**
+	 * Project a point onto a rational surface, see SurfaceProjector
+	 * @param[in] srf RationalSurface object
+	 * @param[in] pos Point to project
+	 * @param[in] tolerance Distance in model units the returned point may be away from the exact foot point
+	 * @return Parameters, point and distance of the closest point.
+	 */
+	inline SurfaceProjection project_point_to_surface(const RationalSurface& srf, const vec3& pos, scalar tolerance = 1e-5f)
+	{
+		return SurfaceProjector(srf).project(pos, tolerance);
+	}
+
+	/**
+	 * Evaluate the closest point to a NURBS surface, see SurfaceProjector
+	 * @param[in] srf RationalSurface object
+	 * @param[in] pos Point to project
+	 * @return The closest point on the surface.
+	 */
+	inline vec3 surface_closest_point(const RationalSurface& srf, const vec3& pos) { return SurfaceProjector(srf).project(pos).point; }
+	/*
+	 * The projection is exact, segments is ignored
+	 */
+	[[deprecated("use surface_closest_point(srf, pos)")]] inline vec3 surface_closest_point(const RationalSurface& srf, const vec3& pos, int /*segments*/)
+	{
+		return surface_closest_point(srf, pos);
+	}
+
+	/**
+	 * Project a batch of points onto a surface in parallel.
+	 * Points are processed in contiguous chunks across all cores, all sharing the projector.
+	 * @param[in] projector SurfaceProjector of the surface
+	 * @param[in] points Points to project
+	 * @param[out] params params[i] is the (u, v) parameter of the closest point to points[i].
+	 * @param[out] residuals residuals[i] is the distance from points[i] to the surface.
+	 * @param[in] ordered Whether consecutive points are close to each other (scanlines, polylines),
+	 * each point is then warm started from the parameters of the previous one.
+	 * @param[in] tolerance Distance in model units a foot point may be away from the exact one
+	 */
+	inline void project_points_to_surface(const SurfaceProjector& projector, std::span<const vec3> points, std::span<vec2> params, std::span<scalar> residuals,
+		bool ordered = false, scalar tolerance = 1e-5f)
+	{
+		assert(params.size() >= points.size() && residuals.size() >= points.size());
+		constexpr size_t chunk_size = 64;
+		const size_t chunks = (points.size() + chunk_size - 1) / chunk_size;
+		parallel_for(chunks, [&](size_t chunk)
+			{
+				const size_t first = chunk * chunk_size;
+				const size_t last = std::min(first + chunk_size, points.size());
+				for (size_t i = first; i < last; i++)
+				{
+					SurfaceProjection result = ordered && i > first ? projector.project(points[i], tolerance, params[i - 1][0], params[i - 1][1])
+						: projector.project(points[i], tolerance);
+					params[i] = vec2(result.u, result.v);
+					residuals[i] = result.distance;
+				}
+			}, 2);
+	}
+
+	/**
+	 * Project a batch of points onto a rational surface in parallel, see SurfaceProjector
+	 * @param[in] srf RationalSurface object
+	 * @param[in] points Points to project
+	 * @param[in] ordered Whether consecutive points are close to each other (scanlines, polylines)
+	 * @param[in] tolerance Distance in model units a foot point may be away from the exact one
+	 * @return Parameters of the closest points and distances from the points to the surface.
+	 */
+	inline std::tuple<std::vector<vec2>, std::vector<scalar>> project_points_to_surface(const RationalSurface& srf, std::span<const vec3> points,
+		bool ordered = false, scalar tolerance = 1e-5f)
+	{
+		std::vector<vec2> params(points.size());
+		std::vector<scalar> residuals(points.size());
+		project_points_to_surface(SurfaceProjector(srf), points, params, residuals, ordered, tolerance);
+		return std::make_tuple(std::move(params), std::move(residuals));
+	}
+}
@@ -0,0 +1,624 @@
+#pragma once
+#include <Eigen/Dense>
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <limits>
+#include <numeric>
+#include <tuple>
+#include <unordered_map>
+#include <vector>
+
+#include "glviewer/parallel_for.h"
+#include "nurbs_curve.h"
+#include "nurbs_evalute_curve.h"
+#include "nurbs_evalute_surface.h"
+#include "nurbs_surface.h"
+#include "nurbs_util.h"
+
+namespace Geomerty::nurbs::util
+{
+	inline constexpr int N_MAX_ROOT_DEPTH = 24;
+	inline constexpr int N_MAX_ROOT_ITERATIONS = 64;
+	inline constexpr int N_MAX_SLICE_CELLS = 64;
+
+	/**
+	 * Parallel planes dot(normal, x) = offset, one per offset
+	 */
+	struct PlaneStack
+	{
+		vec3 normal = vec3::UnitZ();
+		std::vector<scalar> offsets;
+	};
+
+	/**
+	 * Options of slice_surface_by_planes
+	 */
+	struct SliceOptions
+	{
+		// Maximum distance between the surface and the bilinear cells the sections are traced on
+		scalar chord = 1e-2f;
+		// Fit a curve through each polyline, reduced by knot removal within the chord tolerance
+		bool fit_curves = false;
+		size_t fit_degree = 3;
+	};
+
+	/**
+	 * Section of a surface by one plane
+	 */
+	struct SurfaceSection
+	{
+		scalar offset = 0.0f;
+		// Section polylines and the surface parameters (u, v) of their points, closed ones repeat their first point
+		std::vector<std::vector<vec3>> polylines;
+		std::vector<std::vector<std::array<scalar, 2>>> params;
+		// One curve per polyline if SliceOptions::fit_curves is set
+		std::vector<RationalCurve> curves;
+	};
+
+	namespace internal
+	{
+		/*
+		 * Value of a scalar Bezier polynomial by de Casteljau
+		 */
+		inline scalar bezier_value(const scalar* h, size_t degree, scalar t)
+		{
+			std::array<scalar, N_MAX_DEGREE + 1> tmp;
+			std::copy_n(h, degree + 1, tmp.begin());
+			for (size_t k = 1; k <= degree; k++)
+			{
+				for (size_t i = 0; i <= degree - k; i++)
+				{
+					tmp[i] = (1.0f - t) * tmp[i] + t * tmp[i + 1];
+				}
+			}
+			return tmp[0];
+		}
+
+		/*
+		 * Root of a function in [a, b] whose values fa, fb at the ends have opposite signs,
+		 * by regula falsi with the Illinois modification.
+		 */
+		template <typename F>
+		inline scalar bracketed_root(F&& f, scalar a, scalar b, scalar fa, scalar fb)
+		{
+			int side = 0;
+			for (int iter = 0; iter < N_MAX_ROOT_ITERATIONS; iter++)
+			{
+				const scalar c = (fa * b - fb * a) / (fa - fb);
+				if (!(c > a && c < b))
+				{
+					break;
+				}
+				const scalar fc = f(c);
+				if (fc == 0.0f)
+				{
+					return c;
+				}
+				if ((fc > 0.0f) == (fb > 0.0f))
+				{
+					b = c;
+					fb = fc;
+					if (side == -1)
+					{
+						fa *= 0.5f;
+					}
+					side = -1;
+				}
+				else
+				{
+					a = c;
+					fa = fc;
+					if (side == 1)
+					{
+						fb *= 0.5f;
+					}
+					side = 1;
+				}
+			}
+			return std::abs(fa) < std::abs(fb) ? a : b;
+		}
+
+		/*
+		 * Roots in [0, 1] of a scalar Bezier polynomial. By the variation diminishing property a piece
+		 * whose coefficients do not change sign has no interior root, and one with a single sign change
+		 * between ends of opposite sign has exactly one. Other pieces are bisected, a piece at the depth
+		 * limit reports its middle as a touching root. A root on a split may be reported twice and a
+		 * polynomial that vanishes identically reports none.
+		 */
+		inline void bezier_roots(const scalar* h, size_t degree, std::vector<scalar>& roots)
+		{
+			struct Piece
+			{
+				std::array<scalar, N_MAX_DEGREE + 1> h;
+				scalar t0, t1;
+				int depth;
+			};
+			std::vector<Piece> stack(1);
+			std::copy_n(h, degree + 1, stack[0].h.begin());
+			stack[0].t0 = 0.0f;
+			stack[0].t1 = 1.0f;
+			stack[0].depth = 0;
+			while (!stack.empty())
+			{
+				Piece top = stack.back();
+				stack.pop_back();
+				int changes = 0;
+				int sign = 0;
+				for (size_t i = 0; i <= degree; i++)
+				{
+					const int s = (top.h[i] > 0.0f) - (top.h[i] < 0.0f);
+					if (s != 0 && sign != 0 && s != sign)
+					{
+						changes++;
+					}
+					sign = s != 0 ? s : sign;
+				}
+				if (sign == 0)
+				{
+					continue;
+				}
+				if (changes == 0)
+				{
+					// Only the ends may vanish
+					if (top.h[0] == 0.0f)
+					{
+						roots.push_back(top.t0);
+					}
+					if (top.h[degree] == 0.0f)
+					{
+						roots.push_back(top.t1);
+					}
+					continue;
+				}
+				if (changes == 1 && top.h[0] * top.h[degree] < 0.0f)
+				{
+					const scalar t = bracketed_root([&](scalar x) { return bezier_value(top.h.data(), degree, x); }, 0.0f, 1.0f, top.h[0], top.h[degree]);
+					roots.push_back(top.t0 + (top.t1 - top.t0) * t);
+					continue;
+				}
+				const scalar mid = 0.5f * (top.t0 + top.t1);
+				if (top.depth >= N_MAX_ROOT_DEPTH)
+				{
+					roots.push_back(mid);
+					continue;
+				}
+				Piece left, right;
+				std::array<scalar, N_MAX_DEGREE + 1> tmp = top.h;
+				for (size_t k = 0; k <= degree; k++)
+				{
+					left.h[k] = tmp[0];
+					right.h[degree - k] = tmp[degree - k];
+					for (size_t i = 0; i < degree - k; i++)
+					{
+						tmp[i] = 0.5f * (tmp[i] + tmp[i + 1]);
+					}
+				}
+				left.t0 = top.t0;
+				left.t1 = right.t0 = mid;
+				right.t1 = top.t1;
+				left.depth = right.depth = top.depth + 1;
+				stack.push_back(right);
+				stack.push_back(left);
+			}
+		}
+
+		/*
+		 * Point of a rational Bezier patch whose control point (k, l) is cw[k * (degree_v + 1) + l]
+		 */
+		inline vec3 patch_point(const vec4* cw, size_t degree_u, size_t degree_v, scalar u, scalar v)
+		{
+			std::array<vec4, N_MAX_DEGREE + 1> column;
+			for (size_t k = 0; k <= degree_u; k++)
+			{
+				column[k] = bezier_point(cw + k * (degree_v + 1), degree_v, v);
+			}
+			return homogenous_to_cartesian(bezier_point(column.data(), degree_u, u));
+		}
+
+		/*
+		 * Cells of a span along one direction of the section grid, enough for the chord tolerance by the
+		 * bound degree * (degree - 1) / 8 * max |second difference| / n^2 of the control net.
+		 * Cells of one span are shared by all patches in it so the grid lines run through the whole surface.
+		 */
+		inline int slice_cells(const BezierPatches& patches, size_t span, bool along_u, scalar chord)
+		{
+			const size_t pu = patches.degree_u;
+			const size_t pv = patches.degree_v;
+			const size_t degree = along_u ? pu : pv;
+			if (degree < 2)
+			{
+				return 1;
+			}
+			scalar second = 0.0f;
+			const size_t others = along_u ? patches.size_v() : patches.size_u();
+			for (size_t o = 0; o < others; o++)
+			{
+				const vec4* cw = along_u ? patches.patch(span, o) : patches.patch(o, span);
+				for (size_t line = 0; line <= (along_u ? pv : pu); line++)
+				{
+					auto at = [&](size_t i) { return homogenous_to_cartesian(along_u ? cw[i * (pv + 1) + line] : cw[line * (pv + 1) + i]); };
+					for (size_t i = 1; i < degree; i++)
+					{
+						second = std::max(second, (at(i + 1) - 2.0f * at(i) + at(i - 1)).norm());
+					}
+				}
+			}
+			const scalar bound = static_cast<scalar>(degree * (degree - 1)) / 8.0f * second / std::max(chord, std::numeric_limits<scalar>::min());
+			const int cells = static_cast<int>(std::ceil(std::sqrt(bound)));
+			return std::clamp(cells, static_cast<int>(degree), N_MAX_SLICE_CELLS);
+		}
+	}// namespace internal
+
+	/**
+	 * Parameters where a curve given by its Bezier segments crosses a plane.
+	 * dot(normal, C(u)) - offset has the numerator dot(normal, Pw) - offset * w on each segment, a scalar
+	 * Bezier polynomial whose roots are isolated by subdivision and refined by regula falsi.
+	 * @param[in] segments Bezier segments of the curve
+	 * @param[in] normal Normal of the plane
+	 * @param[in] offset Offset of the plane, it holds the points x with dot(normal, x) = offset
+	 * @return Increasing parameters of the crossings, segments lying in the plane report none.
+	 */
+	inline std::vector<scalar> slice_curve_by_plane(const BezierSegments& segments, const vec3& normal, scalar offset)
+	{
+		std::vector<scalar> params;
+		std::array<scalar, N_MAX_DEGREE + 1> h;
+		std::vector<scalar> roots;
+		for (size_t s = 0; s < segments.size(); s++)
+		{
+			const vec4* cw = segments.segment(s);
+			for (size_t i = 0; i <= segments.degree; i++)
+			{
+				h[i] = normal.dot(cw[i].head<3>()) - offset * cw[i].w();
+			}
+			roots.clear();
+			internal::bezier_roots(h.data(), segments.degree, roots);
+			const scalar u0 = segments.breaks[s];
+			const scalar u1 = segments.breaks[s + 1];
+			for (scalar t : roots)
+			{
+				params.push_back(u0 + (u1 - u0) * t);
+			}
+		}
+		std::sort(params.begin(), params.end());
+		// A crossing at a break is found on both segments around it
+		if (!params.empty())
+		{
+			const scalar eps = 16.0f * std::numeric_limits<scalar>::epsilon() * std::max(std::abs(segments.breaks.front()), std::abs(segments.breaks.back()));
+			params.erase(std::unique(params.begin(), params.end(), [eps](scalar a, scalar b) { return b - a <= eps; }), params.end());
+		}
+		return params;
+	}
+
+	/**
+	 * Parameters where a curve crosses a plane, see slice_curve_by_plane on Bezier segments
+	 * @param[in] crv RationalCurve object
+	 * @param[in] normal Normal of the plane
+	 * @param[in] offset Offset of the plane, it holds the points x with dot(normal, x) = offset
+	 * @return Increasing parameters of the crossings, empty if the curve is invalid.
+	 */
+	inline std::vector<scalar> slice_curve_by_plane(const RationalCurve& crv, const vec3& normal, scalar offset)
+	{
+		return slice_curve_by_plane(decompose_curve(crv), normal, offset);
+	}
+
+	/**
+	 * Sections of a surface by a stack of parallel planes.
+	 * The surface is decomposed into Bezier patches once and its height dot(normal, S) is sampled once on
+	 * a parameter grid dense enough for the chord tolerance. Each grid cell is binned to the planes
+	 * between its lowest and highest corner, then the planes are traced in parallel by marching squares
+	 * on their cells. Every crossing of a cell edge is refined onto the surface and the plane by regula
+	 * falsi along the edge and shared by the two cells of the edge, so the polylines chain exactly.
+	 * @param[in] patches Bezier patches of the surface
+	 * @param[in] planes Stack of parallel planes
+	 * @param[in] options Chord tolerance and curve fitting
+	 * @return One section per offset in the order of planes.offsets.
+	 */
+	inline std::vector<SurfaceSection> slice_surface_by_planes(const BezierPatches& patches, const PlaneStack& planes, const SliceOptions& options = {})
+	{
+		std::vector<SurfaceSection> sections(planes.offsets.size());
+		for (size_t k = 0; k < sections.size(); k++)
+		{
+			sections[k].offset = planes.offsets[k];
+		}
+		if (patches.size() == 0 || sections.empty())
+		{
+			return sections;
+		}
+		const size_t pu = patches.degree_u;
+		const size_t pv = patches.degree_v;
+		const vec3& normal = planes.normal;
+
+		// Cell i along a direction lies in span span[i] over local parameters [local[i], local[i + 1]]
+		struct Axis
+		{
+			std::vector<size_t> span;
+			std::vector<scalar> local;
+			std::vector<scalar> param;
+		};
+		auto make_axis = [&](bool along_u)
+		{
+			Axis axis;
+			const auto& breaks = along_u ? patches.breaks_u : patches.breaks_v;
+			for (size_t s = 0; s + 1 < breaks.size(); s++)
+			{
+				const int cells = internal::slice_cells(patches, s, along_u, options.chord);
+				for (int c = 0; c < cells; c++)
+				{
+					const scalar t = static_cast<scalar>(c) / static_cast<scalar>(cells);
+					axis.span.push_back(s);
+					axis.local.push_back(t);
+					axis.param.push_back(breaks[s] + (breaks[s + 1] - breaks[s]) * t);
+				}
+			}
+			axis.span.push_back(axis.span.back());
+			axis.local.push_back(1.0f);
+			axis.param.push_back(breaks.back());
+			return axis;
+		};
+		const Axis axis_u = make_axis(true);
+		const Axis axis_v = make_axis(false);
+		const size_t cells_u = axis_u.span.size() - 1;
+		const size_t cells_v = axis_v.span.size() - 1;
+		const size_t rows = cells_v + 1;
+
+		// Local parameters of the end of a cell and of grid line `line` in the patch of cell `cell`, which touches it
+		auto cell_end = [](const Axis& axis, size_t cell) { return axis.span[cell + 1] == axis.span[cell] ? axis.local[cell + 1] : 1.0f; };
+		auto line_local = [&](const Axis& axis, size_t cell, size_t line) { return line == cell ? axis.local[cell] : cell_end(axis, cell); };
+		auto point_at = [&](size_t cell_u, scalar u, size_t cell_v, scalar v)
+		{
+			return internal::patch_point(patches.patch(axis_u.span[cell_u], axis_v.span[cell_v]), pu, pv, u, v);
+		};
+
+		// Height of the surface at every grid point, shared by all planes
+		std::vector<scalar> height((cells_u + 1) * rows);
+		parallel_for(cells_u + 1, [&](size_t i)
+			{
+				const size_t cu = std::min(i, cells_u - 1);
+				const scalar u = line_local(axis_u, cu, i);
+				for (size_t j = 0; j < rows; j++)
+				{
+					const size_t cv = std::min(j, cells_v - 1);
+					height[i * rows + j] = normal.dot(point_at(cu, u, cv, line_local(axis_v, cv, j)));
+				}
+			}, 2);
+
+		// Bin every cell to the planes between its lowest and highest corner
+		std::vector<size_t> order(planes.offsets.size());
+		std::iota(order.begin(), order.end(), 0);
+		std::sort(order.begin(), order.end(), [&](size_t a, size_t b) { return planes.offsets[a] < planes.offsets[b]; });
+		std::vector<scalar> sorted(order.size());
+		for (size_t k = 0; k < order.size(); k++)
+		{
+			sorted[k] = planes.offsets[order[k]];
+		}
+		std::vector<std::vector<size_t>> bins(order.size());
+		for (size_t i = 0; i < cells_u; i++)
+		{
+			for (size_t j = 0; j < cells_v; j++)
+			{
+				const scalar h0 = height[i * rows + j], h1 = height[(i + 1) * rows + j];
+				const scalar h2 = height[(i + 1) * rows + j + 1], h3 = height[i * rows + j + 1];
+				const scalar low = std::min({ h0, h1, h2, h3 });
+				const scalar high = std::max({ h0, h1, h2, h3 });
+				// A corner counts as above the plane when its height is not below the offset
+				auto first = std::upper_bound(sorted.begin(), sorted.end(), low);
+				auto last = std::upper_bound(first, sorted.end(), high);
+				for (auto it = first; it != last; ++it)
+				{
+					bins[it - sorted.begin()].push_back(i * cells_v + j);
+				}
+			}
+		}
+
+		parallel_for(order.size(), [&](size_t rank)
+			{
+				SurfaceSection& section = sections[order[rank]];
+				const scalar offset = sorted[rank];
+				std::vector<vec3> points;
+				std::vector<std::array<scalar, 2>> params;
+				std::unordered_map<size_t, size_t> crossing_of_edge;
+				std::vector<std::array<size_t, 2>> links;
+				constexpr size_t none = std::numeric_limits<size_t>::max();
+
+				// Edge e along u from grid point (i, j) has id i * rows + j, along v it is shifted past them
+				const size_t v_edges = (cells_u + 1) * rows;
+				auto crossing = [&](size_t i, size_t j, bool along_u)
+				{
+					const size_t id = along_u ? i * rows + j : v_edges + i * rows + j;
+					auto [it, inserted] = crossing_of_edge.try_emplace(id, points.size());
+					if (!inserted)
+					{
+						return it->second;
+					}
+					const scalar ha = height[i * rows + j] - offset;
+					const scalar hb = (along_u ? height[(i + 1) * rows + j] : height[i * rows + j + 1]) - offset;
+					const size_t cu = along_u ? i : std::min(i, cells_u - 1);
+					const size_t cv = along_u ? std::min(j, cells_v - 1) : j;
+					vec3 point;
+					std::array<scalar, 2> uv;
+					if (along_u)
+					{
+						const scalar v = line_local(axis_v, cv, j);
+						const scalar a = axis_u.local[cu], b = cell_end(axis_u, cu);
+						const scalar u = internal::bracketed_root([&](scalar x) { return normal.dot(point_at(cu, x, cv, v)) - offset; }, a, b, ha, hb);
+						point = point_at(cu, u, cv, v);
+						const scalar width = patches.breaks_u[axis_u.span[cu] + 1] - patches.breaks_u[axis_u.span[cu]];
+						uv = { patches.breaks_u[axis_u.span[cu]] + width * u, axis_v.param[j] };
+					}
+					else
+					{
+						const scalar u = line_local(axis_u, cu, i);
+						const scalar a = axis_v.local[cv], b = cell_end(axis_v, cv);
+						const scalar v = internal::bracketed_root([&](scalar x) { return normal.dot(point_at(cu, u, cv, x)) - offset; }, a, b, ha, hb);
+						point = point_at(cu, u, cv, v);
+						const scalar width = patches.breaks_v[axis_v.span[cv] + 1] - patches.breaks_v[axis_v.span[cv]];
+						uv = { axis_u.param[i], patches.breaks_v[axis_v.span[cv]] + width * v };
+					}
+					points.push_back(point);
+					params.push_back(uv);
+					links.push_back({ none, none });
+					return it->second;
+				};
+				auto link = [&](size_t a, size_t b)
+				{
+					(links[a][0] == none ? links[a][0] : links[a][1]) = b;
+					(links[b][0] == none ? links[b][0] : links[b][1]) = a;
+				};
+
+				// Marching squares, corners 0..3 are (i, j), (i + 1, j), (i + 1, j + 1), (i, j + 1)
+				// and edge e joins corner e to corner e + 1
+				for (size_t cell : bins[rank])
+				{
+					const size_t i = cell / cells_v;
+					const size_t j = cell % cells_v;
+					const std::array<bool, 4> above = {
+						height[i * rows + j] >= offset, height[(i + 1) * rows + j] >= offset,
+						height[(i + 1) * rows + j + 1] >= offset, height[i * rows + j + 1] >= offset };
+					std::array<size_t, 4> edge;
+					size_t count = 0;
+					std::array<size_t, 4> crossed;
+					for (size_t e = 0; e < 4; e++)
+					{
+						if (above[e] == above[(e + 1) % 4])
+						{
+							continue;
+						}
+						switch (e)
+						{
+						case 0: edge[e] = crossing(i, j, true); break;
+						case 1: edge[e] = crossing(i + 1, j, false); break;
+						case 2: edge[e] = crossing(i, j + 1, true); break;
+						default: edge[e] = crossing(i, j, false); break;
+						}
+						crossed[count++] = e;
+					}
+					if (count == 2)
+					{
+						link(edge[crossed[0]], edge[crossed[1]]);
+					}
+					else if (count == 4)
+					{
+						// Saddle, the height at the centre tells whether corners 0 and 2 are joined
+						const scalar centre = normal.dot(point_at(i, 0.5f * (axis_u.local[i] + cell_end(axis_u, i)),
+							j, 0.5f * (axis_v.local[j] + cell_end(axis_v, j))));
+						if ((centre >= offset) == above[0])
+						{
+							link(edge[0], edge[1]);
+							link(edge[2], edge[3]);
+						}
+						else
+						{
+							link(edge[3], edge[0]);
+							link(edge[1], edge[2]);
+						}
+					}
+				}
+
+				// Chain the crossings, open chains start at the surface boundary
+				std::vector<bool> visited(points.size(), false);
+				auto trace = [&](size_t start)
+				{
+					std::vector<vec3> polyline;
+					std::vector<std::array<scalar, 2>> uvs;
+					size_t previous = none;
+					size_t current = start;
+					while (current != none && !visited[current])
+					{
+						visited[current] = true;
+						polyline.push_back(points[current]);
+						uvs.push_back(params[current]);
+						const size_t next = links[current][0] != previous ? links[current][0] : links[current][1];
+						previous = current;
+						current = next;
+					}
+					if (current == start)
+					{
+						polyline.push_back(points[start]);
+						uvs.push_back(params[start]);
+					}
+					section.polylines.push_back(std::move(polyline));
+					section.params.push_back(std::move(uvs));
+				};
+				for (size_t c = 0; c < points.size(); c++)
+				{
+					if (!visited[c] && (links[c][0] == none || links[c][1] == none))
+					{
+						trace(c);
+					}
+				}
+
+				// Open chains ending on a seam of a closed surface go on from the same point across the seam
+				const scalar seam = 1e-2f * options.chord;
+				for (size_t a = 0; a < section.polylines.size(); a++)
+				{
+					auto& polyline = section.polylines[a];
+					auto& uvs = section.params[a];
+					bool joined = true;
+					while (joined && polyline.front() != polyline.back())
+					{
+						joined = false;
+						for (size_t b = a + 1; b < section.polylines.size(); b++)
+						{
+							auto& other = section.polylines[b];
+							auto& other_uvs = section.params[b];
+							if ((other.back() - polyline.back()).norm() <= seam)
+							{
+								std::reverse(other.begin(), other.end());
+								std::reverse(other_uvs.begin(), other_uvs.end());
+							}
+							if ((other.front() - polyline.back()).norm() > seam)
+							{
+								continue;
+							}
+							polyline.insert(polyline.end(), other.begin() + 1, other.end());
+							uvs.insert(uvs.end(), other_uvs.begin() + 1, other_uvs.end());
+							section.polylines.erase(section.polylines.begin() + b);
+							section.params.erase(section.params.begin() + b);
+							joined = true;
+							break;
+						}
+						if ((polyline.back() - polyline.front()).norm() <= seam)
+						{
+							polyline.back() = polyline.front();
+						}
+					}
+				}
+
+				for (size_t c = 0; c < points.size(); c++)
+				{
+					if (!visited[c])
+					{
+						trace(c);
+					}
+				}
+
+				if (options.fit_curves)
+				{
+					for (const auto& polyline : section.polylines)
+					{
+						RationalCurve crv;
+						if (polyline.size() >= 2)
+						{
+							global_interpolation(std::min(options.fit_degree, polyline.size() - 1), polyline, crv);
+							crv = std::get<0>(remove_knots(crv, options.chord));
+						}
+						section.curves.push_back(std::move(crv));
+					}
+				}
+			}, 2);
+		return sections;
+	}
+
+	/**
+	 * Sections of a surface by a stack of parallel planes, see slice_surface_by_planes on Bezier patches
+	 * @param[in] srf RationalSurface object
+	 * @param[in] planes Stack of parallel planes
+	 * @param[in] options Chord tolerance and curve fitting
+	 * @return One section per offset in the order of planes.offsets, without polylines if the surface is invalid.
+	 */
+	inline std::vector<SurfaceSection> slice_surface_by_planes(const RationalSurface& srf, const PlaneStack& planes, const SliceOptions& options = {})
+	{
+		return slice_surface_by_planes(decompose_surface(srf), planes, options);
+	}
+}
@@ -1,5 +1,8 @@
 #pragma once
 #include<vector>
+#include <algorithm>
+#include <cassert>
+#include <span>
 #include <Eigen/Dense>
 #include <Eigen/Sparse>
 namespace Geomerty
@@ -7,8 +10,111 @@ namespace Geomerty
 	namespace nurbs
 	{
 		using scalar = float;
+		using vec2 = Eigen::Vector2<scalar>;
 		using vec3 = Eigen::Vector3<scalar>;
 		using vec4 = Eigen::Vector4<scalar>;
+
+		/**
+		View of every stride-th element of a buffer, e.g. one column of an Array2
+		*/
+		template<typename T>
+		class StridedSpan
+		{
+		public:
+			StridedSpan(T* data, size_t size, size_t stride) : m_data(data), m_size(size), m_stride(stride) {}
+
+			size_t size() const { return m_size; }
+			size_t stride() const { return m_stride; }
+			T& operator[](size_t i) const { return m_data[i * m_stride]; }
+
+		private:
+			T* m_data;
+			size_t m_size;
+			size_t m_stride;
+		};
+
+		/**
+		Two dimensional array stored row-major in one contiguous buffer.
+		a[i][j] and a(i, j) address row i and column j, rows are contiguous spans and columns strided views,
+		so the whole array copies in one block and a row is walked with unit stride.
+		@tparam T Element type
+		*/
+		template<typename T>
+		class Array2
+		{
+		public:
+			Array2() = default;
+			Array2(size_t rows, size_t cols, const T& value = T()) : m_rows(rows), m_cols(cols), m_data(rows * cols, value) {}
+			/**
+			Copy of a nested array, all rows must have the same size
+			*/
+			Array2(const std::vector<std::vector<T>>& nested)
+				: m_rows(nested.size()), m_cols(nested.empty() ? 0 : nested[0].size())
+			{
+				m_data.reserve(m_rows * m_cols);
+				for (const auto& row : nested)
+				{
+					assert(row.size() == m_cols);
+					m_data.insert(m_data.end(), row.begin(), row.end());
+				}
+			}
+
+			size_t rows() const { return m_rows; }
+			size_t cols() const { return m_cols; }
+			bool empty() const { return m_data.empty(); }
+
+			T& operator()(size_t i, size_t j) { return m_data[i * m_cols + j]; }
+			const T& operator()(size_t i, size_t j) const { return m_data[i * m_cols + j]; }
+			std::span<T> operator[](size_t i) { return row(i); }
+			std::span<const T> operator[](size_t i) const { return row(i); }
+			std::span<T> row(size_t i) { return std::span<T>(m_data.data() + i * m_cols, m_cols); }
+			std::span<const T> row(size_t i) const { return std::span<const T>(m_data.data() + i * m_cols, m_cols); }
+			StridedSpan<T> column(size_t j) { return StridedSpan<T>(m_data.data() + j, m_rows, m_cols); }
+			StridedSpan<const T> column(size_t j) const { return StridedSpan<const T>(m_data.data() + j, m_rows, m_cols); }
+
+			T* data() { return m_data.data(); }
+			const T* data() const { return m_data.data(); }
+			std::span<T> flat() { return std::span<T>(m_data); }
+			std::span<const T> flat() const { return std::span<const T>(m_data); }
+			auto begin() { return m_data.begin(); }
+			auto end() { return m_data.end(); }
+			auto begin() const { return m_data.begin(); }
+			auto end() const { return m_data.end(); }
+
+			void assign(size_t rows, size_t cols, const T& value = T())
+			{
+				m_rows = rows;
+				m_cols = cols;
+				m_data.assign(rows * cols, value);
+			}
+			void swap(Array2& other)
+			{
+				std::swap(m_rows, other.m_rows);
+				std::swap(m_cols, other.m_cols);
+				m_data.swap(other.m_data);
+			}
+			/**
+			Same array with rows and columns exchanged
+			*/
+			Array2 transposed() const
+			{
+				Array2 result(m_cols, m_rows);
+				for (size_t i = 0; i < m_rows; i++)
+				{
+					for (size_t j = 0; j < m_cols; j++)
+					{
+						result(j, i) = (*this)(i, j);
+					}
+				}
+				return result;
+			}
+
+		private:
+			size_t m_rows = 0;
+			size_t m_cols = 0;
+			std::vector<T> m_data;
+		};
+
 		/**
 		Struct for representing a non-rational NURBS surface
 		\tparam T Data type of control points and weights
@@ -17,16 +123,49 @@ namespace Geomerty
 		{
 			size_t m_degree_u, m_degree_v;
 			std::vector<scalar> m_knots_u, m_knots_v;
-			std::vector<std::vector<vec3>> m_control_points;
-			std::vector<std::vector<scalar>> m_weights;
+			// Control point (i, j) is the ith along u and the jth along v
+			Array2<vec3> m_control_points;
+			Array2<scalar> m_weights;
 
 			RationalSurface() = default;
 
 			RationalSurface(size_t degree_u, size_t degree_v, const std::vector<scalar>& knots_u, const std::vector<scalar>& knots_v,
-				const std::vector<std::vector<vec3>>& control_points, const std::vector<std::vector<scalar>>& weights)
+				const Array2<vec3>& control_points, const Array2<scalar>& weights)
 				: m_degree_u(degree_u), m_degree_v(degree_v), m_knots_u(knots_u), m_knots_v(knots_v), m_control_points(control_points), m_weights(weights)
 			{
 			}
+
+			/**
+			Control points premultiplied by their weights, (w * x, w * y, w * z, w), in the layout of m_control_points
+			*/
+			Array2<vec4> homogenous_points() const
+			{
+				Array2<vec4> cw(m_control_points.rows(), m_control_points.cols());
+				std::span<const vec3> points = m_control_points.flat();
+				std::span<const scalar> weights = m_weights.flat();
+				std::span<vec4> out = cw.flat();
+				for (size_t k = 0; k < out.size(); k++)
+				{
+					out[k] << weights[k] * points[k], weights[k];
+				}
+				return cw;
+			}
+			/**
+			Replace the control points and weights by those of a homogenous net
+			*/
+			void set_homogenous_points(const Array2<vec4>& cw)
+			{
+				m_control_points.assign(cw.rows(), cw.cols());
+				m_weights.assign(cw.rows(), cw.cols());
+				std::span<const vec4> in = cw.flat();
+				std::span<vec3> points = m_control_points.flat();
+				std::span<scalar> weights = m_weights.flat();
+				for (size_t k = 0; k < in.size(); k++)
+				{
+					points[k] = in[k].head<3>() / in[k].w();
+					weights[k] = in[k].w();
+				}
+			}
 		};
 		/**
 		Struct for representing a B spline surface
@@ -34,11 +173,11 @@ namespace Geomerty
 		struct Surface : public RationalSurface
 		{
 			Surface() = default;
-			Surface(size_t degree_u, size_t degree_v, const std::vector<scalar>& knots_u, const std::vector<scalar>& knots_v, std::vector<std::vector<vec3>> control_points)
+			Surface(size_t degree_u, size_t degree_v, const std::vector<scalar>& knots_u, const std::vector<scalar>& knots_v, const Array2<vec3>& control_points)
 				: RationalSurface(degree_u, degree_v, knots_u, knots_v, control_points,
-					std::vector<std::vector<scalar>>(m_control_points.size(), std::vector<scalar>(m_control_points[0].size(), 1.0)))
+					Array2<scalar>(control_points.rows(), control_points.cols(), 1.0f))
 			{
 			}
 		};
 	}// namespace nurbs
-}// namespace nous
\ No newline at end of file
+}// namespace nous
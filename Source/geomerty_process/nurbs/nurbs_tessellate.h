@@ -0,0 +1,678 @@
+#pragma once
+#include <Eigen/Dense>
+#include <algorithm>
+#include <array>
+#include <map>
+#include <queue>
+#include <tuple>
+
+#include "nurbs_curve.h"
+#include "nurbs_evalute_curve.h"
+#include "nurbs_evalute_surface.h"
+#include "nurbs_surface.h"
+#include "nurbs_util.h"
+
+namespace Geomerty::nurbs::util
+{
+	/**
+	 * Tolerances of adaptive tessellation, a piece is accepted once it meets both bounds
+	 */
+	struct TessellationTolerance
+	{
+		// Maximum distance between the geometry and its tessellation
+		scalar chord = 1e-2f;
+		// Maximum turning angle in radians covered by one tessellation segment
+		scalar angle = N_FLOAT_PI / 18.0f;
+		// Upper bound of the number of curve segments or surface pieces, the Bezier spans and patches are never merged
+		int max_segments = 4096;
+	};
+
+	namespace internal
+	{
+		/*
+		 * Part [t0, t1] of a Bezier segment with its homogenous control points
+		 */
+		struct BezierPiece
+		{
+			std::array<vec4, N_MAX_DEGREE + 1> cw;
+			scalar t0, t1;
+		};
+
+		/*
+		 * Deviation from the chord and sum of the turning angles of count points spaced stride apart
+		 */
+		inline std::pair<scalar, scalar> polygon_flatness(const vec3* P, size_t count, size_t stride)
+		{
+			scalar deviation = 0.0f;
+			scalar turning = 0.0f;
+			vec3 nearest;
+			vec3 prev_leg = vec3::Zero();
+			const vec3& first = P[0];
+			const vec3& last = P[(count - 1) * stride];
+			for (size_t i = 1; i < count; i++)
+			{
+				if (i + 1 < count)
+				{
+					deviation = std::max(deviation, dist_point_line_segment(P[i * stride], first, last, nearest));
+				}
+				vec3 leg = P[i * stride] - P[(i - 1) * stride];
+				if (leg.squaredNorm() > 0.0f)
+				{
+					if (prev_leg.squaredNorm() > 0.0f)
+					{
+						turning += std::atan2(prev_leg.cross(leg).norm(), prev_leg.dot(leg));
+					}
+					prev_leg = leg;
+				}
+			}
+			return { deviation, turning };
+		}
+
+		/*
+		 * Flatness of a rational Bezier piece measured on its control hull.
+		 * The curve lies in the convex hull of its control points, so the hull deviation from the chord
+		 * bounds the chord error, and the turning of the control polygon bounds the turning of the tangent.
+		 * return max(chord error / tol.chord, turning / tol.angle), the piece is flat when <= 1.
+		 */
+		inline scalar bezier_flatness(const BezierPiece& piece, size_t degree, const TessellationTolerance& tol)
+		{
+			std::array<vec3, N_MAX_DEGREE + 1> P;
+			for (int i = 0; i <= static_cast<int>(degree); i++)
+			{
+				if (!(piece.cw[i].w() > 0.0f))
+				{
+					// The convex hull property only holds for positive weights
+					return std::numeric_limits<scalar>::max();
+				}
+				P[i] = homogenous_to_cartesian(piece.cw[i]);
+			}
+
+			const auto [deviation, turning] = polygon_flatness(P.data(), degree + 1, 1);
+			scalar error = 0.0f;
+			if (tol.chord > 0.0f)
+			{
+				error = std::max(error, deviation / tol.chord);
+			}
+			if (tol.angle > 0.0f)
+			{
+				error = std::max(error, turning / tol.angle);
+			}
+			return error;
+		}
+
+		/*
+		 * Split a Bezier piece at its middle with de Casteljau on the homogenous control points
+		 */
+		inline void bezier_bisect(const BezierPiece& piece, size_t degree, BezierPiece& left, BezierPiece& right)
+		{
+			bezier_split(piece.cw.data(), degree, 0.5f, left.cw.data(), right.cw.data());
+			const scalar mid = 0.5f * (piece.t0 + piece.t1);
+			left.t0 = piece.t0;
+			left.t1 = mid;
+			right.t0 = mid;
+			right.t1 = piece.t1;
+		}
+
+		/*
+		 * Part [u0, u1] x [v0, v1] of a Bezier patch with its homogenous control points,
+		 * point (k, l) is cw[k * (degree_v + 1) + l] as in BezierPatches
+		 */
+		struct BezierPatchPiece
+		{
+			std::array<vec4, (N_MAX_DEGREE + 1) * (N_MAX_DEGREE + 1)> cw;
+			scalar u0, u1, v0, v1;
+		};
+
+		/*
+		 * Flatness of a rational Bezier patch piece measured on its control net, the surface counterpart of bezier_flatness.
+		 * The rows and columns of the net bound the chord error and turning along u and v, the distance of the net
+		 * from the bilinear patch through its corners plus the twist of the corners bounds the distance to the triangles,
+		 * and the tilt of the net cells from the corner diagonals bounds the deviation of the normal.
+		 * split_u is set when the piece is better bisected along u than along v.
+		 * return Largest error relative to its tolerance, the piece is flat when <= 1.
+		 */
+		inline scalar bezier_patch_flatness(const BezierPatchPiece& piece, size_t degree_u, size_t degree_v, const TessellationTolerance& tol, bool& split_u)
+		{
+			const size_t stride = degree_v + 1;
+			std::array<vec3, (N_MAX_DEGREE + 1) * (N_MAX_DEGREE + 1)> P;
+			split_u = degree_u > 0;
+			for (size_t i = 0; i < (degree_u + 1) * stride; i++)
+			{
+				if (!(piece.cw[i].w() > 0.0f))
+				{
+					// The convex hull property only holds for positive weights
+					return std::numeric_limits<scalar>::max();
+				}
+				P[i] = homogenous_to_cartesian(piece.cw[i]);
+			}
+			auto at = [&](size_t k, size_t l) -> const vec3& { return P[k * stride + l]; };
+			auto relative = [](scalar value, scalar bound) { return bound > 0.0f ? value / bound : 0.0f; };
+
+			scalar error_u = 0.0f;
+			for (size_t l = 0; l <= degree_v; l++)
+			{
+				const auto [deviation, turning] = polygon_flatness(&at(0, l), degree_u + 1, stride);
+				error_u = std::max({ error_u, relative(deviation, tol.chord), relative(turning, tol.angle) });
+			}
+			scalar error_v = 0.0f;
+			for (size_t k = 0; k <= degree_u; k++)
+			{
+				const auto [deviation, turning] = polygon_flatness(&at(k, 0), degree_v + 1, 1);
+				error_v = std::max({ error_v, relative(deviation, tol.chord), relative(turning, tol.angle) });
+			}
+
+			const vec3& P00 = at(0, 0);
+			const vec3& P10 = at(degree_u, 0);
+			const vec3& P01 = at(0, degree_v);
+			const vec3& P11 = at(degree_u, degree_v);
+			scalar twist = 0.0f;
+			for (size_t k = 0; k <= degree_u; k++)
+			{
+				const scalar s = degree_u > 0 ? static_cast<scalar>(k) / degree_u : 0.0f;
+				for (size_t l = 0; l <= degree_v; l++)
+				{
+					const scalar t = degree_v > 0 ? static_cast<scalar>(l) / degree_v : 0.0f;
+					const vec3 bilinear = (1.0f - s) * ((1.0f - t) * P00 + t * P01) + s * ((1.0f - t) * P10 + t * P11);
+					twist = std::max(twist, (at(k, l) - bilinear).norm());
+				}
+			}
+			// Either pair of triangles over the corners is off their bilinear patch by up to a quarter of the corner twist
+			twist += 0.25f * (P00 - P10 - P01 + P11).norm();
+			const vec3 normal = (P11 - P00).cross(P01 - P10);
+			scalar tilt = 0.0f;
+			for (size_t k = 0; k < degree_u; k++)
+			{
+				for (size_t l = 0; l < degree_v; l++)
+				{
+					const vec3 cell = (at(k + 1, l + 1) - at(k, l)).cross(at(k, l + 1) - at(k + 1, l));
+					if (cell.squaredNorm() > 0.0f && normal.squaredNorm() > 0.0f)
+					{
+						tilt = std::max(tilt, std::atan2(normal.cross(cell).norm(), normal.dot(cell)));
+					}
+				}
+			}
+
+			// Bisect across the direction which bends most, a twisted or tilted piece across its longer sides
+			if (std::max(error_u, error_v) > 1.0f)
+			{
+				split_u = error_u >= error_v;
+			}
+			else
+			{
+				split_u = (P10 - P00).norm() + (P11 - P01).norm() >= (P01 - P00).norm() + (P11 - P10).norm();
+			}
+			split_u = degree_v == 0 || (degree_u > 0 && split_u);
+			return std::max({ error_u, error_v, relative(twist, tol.chord), relative(tilt, tol.angle) });
+		}
+
+		/*
+		 * Split a Bezier patch piece at its middle along u or v with de Casteljau on the homogenous control points
+		 */
+		inline void bezier_patch_bisect(const BezierPatchPiece& piece, size_t degree_u, size_t degree_v, bool split_u, BezierPatchPiece& first, BezierPatchPiece& second)
+		{
+			const size_t stride = degree_v + 1;
+			first = piece;
+			second = piece;
+			if (split_u)
+			{
+				std::array<vec4, N_MAX_DEGREE + 1> column, left, right;
+				for (size_t l = 0; l <= degree_v; l++)
+				{
+					for (size_t k = 0; k <= degree_u; k++)
+					{
+						column[k] = piece.cw[k * stride + l];
+					}
+					bezier_split(column.data(), degree_u, 0.5f, left.data(), right.data());
+					for (size_t k = 0; k <= degree_u; k++)
+					{
+						first.cw[k * stride + l] = left[k];
+						second.cw[k * stride + l] = right[k];
+					}
+				}
+				first.u1 = second.u0 = 0.5f * (piece.u0 + piece.u1);
+			}
+			else
+			{
+				for (size_t k = 0; k <= degree_u; k++)
+				{
+					bezier_split(piece.cw.data() + k * stride, degree_v, 0.5f, first.cw.data() + k * stride, second.cw.data() + k * stride);
+				}
+				first.v1 = second.v0 = 0.5f * (piece.v0 + piece.v1);
+			}
+		}
+	}// namespace internal
+
+	/**
+	 * Tessellate Bezier segments into a polyline meeting chord and angle tolerances.
+	 * Each segment is bisected on its control hull, the piece furthest from the tolerances first,
+	 * until every piece is flat or tol.max_segments is reached.
+	 * @param[in] segments Bezier segments of the curve
+	 * @param[in] tol Tessellation tolerances
+	 * @return Points of the polyline and their curve parameters, both ascending in parameter.
+	 */
+	inline std::tuple<std::vector<vec3>, std::vector<scalar>> tessellate_curve(const BezierSegments& segments, const TessellationTolerance& tol)
+	{
+		std::vector<vec3> points;
+		std::vector<scalar> params;
+		if (segments.size() == 0)
+		{
+			return std::make_tuple(std::move(points), std::move(params));
+		}
+		const size_t degree = segments.degree;
+		// Pieces narrower than this are accepted as they are, e.g. around cusps
+		const scalar min_width = 1e-6f * (segments.breaks.back() - segments.breaks.front());
+
+		std::vector<internal::BezierPiece> pieces(segments.size());
+		std::priority_queue<std::pair<scalar, size_t>> queue;
+		auto push = [&](size_t index)
+		{
+			const internal::BezierPiece& piece = pieces[index];
+			scalar error = internal::bezier_flatness(piece, degree, tol);
+			if (error > 1.0f && piece.t1 - piece.t0 > min_width)
+			{
+				queue.emplace(error, index);
+			}
+		};
+		for (size_t s = 0; s < segments.size(); s++)
+		{
+			std::copy_n(segments.segment(s), degree + 1, pieces[s].cw.begin());
+			pieces[s].t0 = segments.breaks[s];
+			pieces[s].t1 = segments.breaks[s + 1];
+			push(s);
+		}
+
+		while (!queue.empty() && static_cast<int>(pieces.size()) < tol.max_segments)
+		{
+			size_t index = queue.top().second;
+			queue.pop();
+			internal::BezierPiece left, right;
+			internal::bezier_bisect(pieces[index], degree, left, right);
+			pieces[index] = left;
+			pieces.push_back(right);
+			push(index);
+			push(pieces.size() - 1);
+		}
+
+		std::sort(pieces.begin(), pieces.end(), [](const internal::BezierPiece& a, const internal::BezierPiece& b) { return a.t0 < b.t0; });
+		points.reserve(pieces.size() + 1);
+		params.reserve(pieces.size() + 1);
+		// The end control points of a Bezier piece interpolate the curve
+		points.push_back(homogenous_to_cartesian(pieces.front().cw[0]));
+		params.push_back(pieces.front().t0);
+		for (const auto& piece : pieces)
+		{
+			points.push_back(homogenous_to_cartesian(piece.cw[degree]));
+			params.push_back(piece.t1);
+		}
+		return std::make_tuple(std::move(points), std::move(params));
+	}
+
+	/**
+	 * Tessellate a rational curve into a polyline meeting chord and angle tolerances
+	 * @param[in] crv RationalCurve object
+	 * @param[in] tol Tessellation tolerances
+	 * @return Points of the polyline and their curve parameters, both ascending in parameter.
+	 */
+	inline std::tuple<std::vector<vec3>, std::vector<scalar>> tessellate_curve(const RationalCurve& crv, const TessellationTolerance& tol = {})
+	{
+		return tessellate_curve(decompose_curve(crv), tol);
+	}
+
+	/**
+	 * Tessellate a surface into a crack-free triangle mesh meeting chord and angle tolerances.
+	 * Each Bezier patch is bisected on its control net along u or v, the piece furthest from the tolerances first,
+	 * until every piece is flat or tol.max_segments pieces are reached. Neighbouring pieces share their corners,
+	 * and a piece with corners of smaller neighbours on its sides is fanned from its centre through them,
+	 * so the mesh has no T-junctions.
+	 * @param[in] evaluator SurfaceEvaluator of the surface
+	 * @param[in] tol Tessellation tolerances, max_segments bounds the number of pieces
+	 * @return Mesh with normals and uvs, empty if the surface is invalid.
+	 */
+	inline SurfaceTessellation tessellate_surface(const SurfaceEvaluator& evaluator, const TessellationTolerance& tol)
+	{
+		SurfaceTessellation mesh;
+		const BezierPatches patches = decompose_surface(evaluator);
+		if (patches.size() == 0)
+		{
+			return mesh;
+		}
+		const size_t degree_u = patches.degree_u;
+		const size_t degree_v = patches.degree_v;
+		const scalar u_min = patches.breaks_u.front();
+		const scalar v_min = patches.breaks_v.front();
+		const scalar width_u = patches.breaks_u.back() - u_min;
+		const scalar width_v = patches.breaks_v.back() - v_min;
+
+		std::vector<internal::BezierPatchPiece> pieces(patches.size());
+		std::priority_queue<std::tuple<scalar, size_t, bool>> queue;
+		auto push = [&](size_t index)
+		{
+			const internal::BezierPatchPiece& piece = pieces[index];
+			bool split_u;
+			scalar error = internal::bezier_patch_flatness(piece, degree_u, degree_v, tol, split_u);
+			// Pieces narrower than this are accepted as they are, e.g. around poles
+			const bool wide = split_u ? piece.u1 - piece.u0 > 1e-6f * width_u : piece.v1 - piece.v0 > 1e-6f * width_v;
+			if (error > 1.0f && wide)
+			{
+				queue.emplace(error, index, split_u);
+			}
+		};
+		for (size_t s = 0; s < patches.size_u(); s++)
+		{
+			for (size_t t = 0; t < patches.size_v(); t++)
+			{
+				internal::BezierPatchPiece& piece = pieces[s * patches.size_v() + t];
+				std::copy_n(patches.patch(s, t), patches.stride(), piece.cw.begin());
+				piece.u0 = patches.breaks_u[s];
+				piece.u1 = patches.breaks_u[s + 1];
+				piece.v0 = patches.breaks_v[t];
+				piece.v1 = patches.breaks_v[t + 1];
+				push(s * patches.size_v() + t);
+			}
+		}
+
+		while (!queue.empty() && static_cast<int>(pieces.size()) < tol.max_segments)
+		{
+			const auto [error, index, split_u] = queue.top();
+			queue.pop();
+			internal::BezierPatchPiece first, second;
+			internal::bezier_patch_bisect(pieces[index], degree_u, degree_v, split_u, first, second);
+			pieces[index] = first;
+			pieces.push_back(second);
+			push(index);
+			push(pieces.size() - 1);
+		}
+
+		// Corners of the pieces keyed by (u, v) and by (v, u), the corners on a side of a piece are consecutive in one of them.
+		// A corner is shared by the pieces around it as the split parameters are copied, never recomputed.
+		std::map<std::pair<scalar, scalar>, size_t> by_u, by_v;
+		std::vector<vec2> params;
+		// Centre of a piece next to each vertex, to find a normal where the surface is degenerate
+		std::vector<vec2> inside;
+		for (const auto& piece : pieces)
+		{
+			const vec2 centre(0.5f * (piece.u0 + piece.u1), 0.5f * (piece.v0 + piece.v1));
+			const std::array<std::pair<scalar, scalar>, 4> corners = { { { piece.u0, piece.v0 }, { piece.u1, piece.v0 }, { piece.u1, piece.v1 }, { piece.u0, piece.v1 } } };
+			for (const auto& [u, v] : corners)
+			{
+				if (by_u.try_emplace({ u, v }, params.size()).second)
+				{
+					by_v.emplace(std::pair{ v, u }, params.size());
+					params.emplace_back(u, v);
+					inside.push_back(centre);
+				}
+			}
+		}
+
+		std::vector<size_t> boundary;
+		for (const auto& piece : pieces)
+		{
+			// Counter-clockwise in (u, v) along the bottom, right, top and left side, each up to its last corner
+			boundary.clear();
+			for (auto it = by_v.lower_bound({ piece.v0, piece.u0 }); it->first != std::pair{ piece.v0, piece.u1 }; ++it)
+			{
+				boundary.push_back(it->second);
+			}
+			for (auto it = by_u.lower_bound({ piece.u1, piece.v0 }); it->first != std::pair{ piece.u1, piece.v1 }; ++it)
+			{
+				boundary.push_back(it->second);
+			}
+			for (auto it = std::make_reverse_iterator(by_v.upper_bound({ piece.v1, piece.u1 })); it->first != std::pair{ piece.v1, piece.u0 }; ++it)
+			{
+				boundary.push_back(it->second);
+			}
+			for (auto it = std::make_reverse_iterator(by_u.upper_bound({ piece.u0, piece.v1 })); it->first != std::pair{ piece.u0, piece.v0 }; ++it)
+			{
+				boundary.push_back(it->second);
+			}
+
+			// Triangles are clockwise in (u, v), so counter-clockwise around Sv x Su
+			if (boundary.size() == 4)
+			{
+				mesh.indices.insert(mesh.indices.end(), { boundary[0], boundary[2], boundary[1], boundary[0], boundary[3], boundary[2] });
+				continue;
+			}
+			const size_t centre = params.size();
+			params.emplace_back(0.5f * (piece.u0 + piece.u1), 0.5f * (piece.v0 + piece.v1));
+			inside.push_back(params.back());
+			for (size_t k = 0; k < boundary.size(); k++)
+			{
+				mesh.indices.insert(mesh.indices.end(), { centre, boundary[(k + 1) % boundary.size()], boundary[k] });
+			}
+		}
+
+		mesh.positions.resize(params.size());
+		mesh.normals.resize(params.size());
+		mesh.uvs.resize(params.size());
+		std::vector<NurbsWorkspace> workspaces;
+		parallel_for(params.size(), [&](size_t threads) { workspaces.resize(threads); },
+			[&](size_t i, size_t thread)
+			{
+				std::array<vec3, 4> ders;
+				evaluator.derivatives(1, params[i].x(), params[i].y(), ders, workspaces[thread]);
+				mesh.positions[i] = ders[0];
+				vec3 normal = ders[1].cross(ders[2]).normalized();
+				if (!(normal.squaredNorm() > 0.5f))
+				{
+					// Sv x Su vanishes at poles and degenerate sides, take the normal slightly inside the piece
+					const vec2 nudged = params[i] + 1e-3f * (inside[i] - params[i]);
+					evaluator.derivatives(1, nudged.x(), nudged.y(), ders, workspaces[thread]);
+					normal = ders[1].cross(ders[2]).normalized();
+				}
+				mesh.normals[i] = (normal.squaredNorm() > 0.5f) ? normal : vec3::Zero();
+				mesh.uvs[i] = vec2((params[i].x() - u_min) / width_u, (params[i].y() - v_min) / width_v);
+			}, [](size_t) {}, 256);
+		return mesh;
+	}
+
+	/**
+	 * Tessellate a rational surface into a crack-free triangle mesh meeting chord and angle tolerances
+	 * @param[in] srf RationalSurface object
+	 * @param[in] tol Tessellation tolerances
+	 * @return Mesh with normals and uvs, empty if the surface is invalid.
+	 */
+	inline SurfaceTessellation tessellate_surface(const RationalSurface& srf, const TessellationTolerance& tol = {})
+	{
+		return tessellate_surface(SurfaceEvaluator(srf), tol);
+	}
+
+	/**
+	 * Range [first, last) of vertex indices
+	 */
+	struct VertexRange
+	{
+		size_t first = 0, last = 0;
+	};
+
+	/**
+	 * Grid tessellation of a surface that is updated in place while its control points are edited.
+	 * A control point only moves the vertices over the knot spans it supports, so after an edit only the samples
+	 * of those spans are evaluated again and the vertex ranges that changed are reported, see tessellate_surface_grid.
+	 */
+	class SurfaceGridTessellator
+	{
+	public:
+		SurfaceGridTessellator() = default;
+		/**
+		 * @param[in] count_u Number of samples along u, at least 2
+		 * @param[in] count_v Number of samples along v, at least 2
+		 */
+		SurfaceGridTessellator(size_t count_u, size_t count_v) : m_count_u(count_u), m_count_v(count_v) {}
+
+		/**
+		 * Current tessellation, equal to tessellate_surface_grid of the last updated surface
+		 */
+		const SurfaceGrid& grid() const { return m_grid; }
+
+		/**
+		 * Bring the tessellation up to date with a surface.
+		 * If only control points or weights changed since the last update the samples over the spans they support are
+		 * evaluated again, any other change tessellates the whole surface.
+		 * @param[in] srf RationalSurface object
+		 * @return Vertex ranges whose position or normal changed, covering the whole grid if it was rebuilt.
+		 */
+		std::vector<VertexRange> update(const RationalSurface& srf)
+		{
+			if (!same_layout(srf))
+			{
+				return rebuild(srf);
+			}
+			const Array2<vec4> cw = srf.homogenous_points();
+			// Box of the control points that changed
+			size_t a0 = cw.rows(), a1 = 0, b0 = cw.cols(), b1 = 0;
+			for (size_t a = 0; a < cw.rows(); a++)
+			{
+				for (size_t b = 0; b < cw.cols(); b++)
+				{
+					if (cw(a, b) != m_cw(a, b))
+					{
+						a0 = std::min(a0, a);
+						a1 = std::max(a1, a);
+						b0 = std::min(b0, b);
+						b1 = std::max(b1, b);
+					}
+				}
+			}
+			m_cw = cw;
+			if (a0 > a1)
+			{
+				return {};
+			}
+			// Control point a supports the samples whose span is in [a, a + degree]
+			auto [i0, i1] = samples(m_basis_u.spans, a0, a1 + m_degree_u);
+			auto [j0, j1] = samples(m_basis_v.spans, b0, b1 + m_degree_v);
+			if (i0 == i1 || j0 == j1)
+			{
+				return {};
+			}
+			evaluate(i0, i1, j0, j1);
+
+			// A repaired normal is copied from a neighbour, so repair one more vertex around the region
+			i0 = i0 > 0 ? i0 - 1 : 0;
+			j0 = j0 > 0 ? j0 - 1 : 0;
+			i1 = std::min(i1 + 1, m_count_u);
+			j1 = std::min(j1 + 1, m_count_v);
+			std::vector<size_t> degenerate;
+			for (size_t j = j0; j < j1; j++)
+			{
+				for (size_t i = i0; i < i1; i++)
+				{
+					if (m_degenerate[i + j * m_count_u])
+					{
+						degenerate.push_back(i + j * m_count_u);
+					}
+				}
+			}
+			internal::repair_grid_normals(degenerate, [&](size_t index) { return m_degenerate[index] != 0; }, m_grid);
+
+			if (i0 == 0 && i1 == m_count_u)
+			{
+				return { { j0 * m_count_u, j1 * m_count_u } };
+			}
+			std::vector<VertexRange> ranges;
+			for (size_t j = j0; j < j1; j++)
+			{
+				ranges.push_back({ i0 + j * m_count_u, i1 + j * m_count_u });
+			}
+			return ranges;
+		}
+
+	private:
+		/* Same degrees, knots and net size as the last updated surface */
+		bool same_layout(const RationalSurface& srf) const
+		{
+			return m_valid && srf.m_degree_u == static_cast<size_t>(m_degree_u) && srf.m_degree_v == static_cast<size_t>(m_degree_v) &&
+				srf.m_knots_u == m_knots_u && srf.m_knots_v == m_knots_v &&
+				srf.m_control_points.rows() == m_cw.rows() && srf.m_control_points.cols() == m_cw.cols() &&
+				srf.m_weights.rows() == m_cw.rows() && srf.m_weights.cols() == m_cw.cols();
+		}
+
+		/* Samples [first, last) whose span lies in [lo, hi], spans are sorted */
+		static std::pair<size_t, size_t> samples(const std::vector<int>& spans, size_t lo, size_t hi)
+		{
+			const auto first = std::lower_bound(spans.begin(), spans.end(), static_cast<int>(lo));
+			const auto last = std::upper_bound(first, spans.end(), static_cast<int>(hi));
+			return { static_cast<size_t>(first - spans.begin()), static_cast<size_t>(last - spans.begin()) };
+		}
+
+		std::vector<VertexRange> rebuild(const RationalSurface& srf)
+		{
+			m_grid = {};
+			m_cw = {};
+			m_knots_u = srf.m_knots_u;
+			m_knots_v = srf.m_knots_v;
+			const SurfaceEvaluator evaluator(srf);
+			m_valid = evaluator.is_valid() && m_count_u >= 2 && m_count_v >= 2;
+			if (!m_valid)
+			{
+				return {};
+			}
+			m_degree_u = static_cast<int>(evaluator.basis_u().degree());
+			m_degree_v = static_cast<int>(evaluator.basis_v().degree());
+			m_basis_u = internal::grid_basis(evaluator.basis_u(), m_count_u);
+			m_basis_v = internal::grid_basis(evaluator.basis_v(), m_count_v);
+			m_tiles = internal::grid_tiles(m_basis_v.spans);
+			m_cw = evaluator.homogenous_points();
+
+			m_grid.count_u = m_count_u;
+			m_grid.count_v = m_count_v;
+			m_grid.positions.resize(m_count_u * m_count_v);
+			m_grid.normals.resize(m_count_u * m_count_v);
+			m_grid.uvs.resize(m_count_u * m_count_v);
+			m_grid.indices.resize((m_count_u - 1) * (m_count_v - 1) * 6);
+			m_degenerate.assign(m_count_u * m_count_v, 0);
+			internal::grid_connectivity(0, m_count_v, m_grid);
+			const std::vector<size_t> degenerate = evaluate(0, m_count_u, 0, m_count_v);
+			internal::repair_grid_normals(degenerate, [&](size_t index) { return m_degenerate[index] != 0; }, m_grid);
+			return { { 0, m_count_u * m_count_v } };
+		}
+
+		/* Evaluate the vertices [i0, i1) x [j0, j1) in parallel bands along the tiles of the grid, return the degenerate ones */
+		std::vector<size_t> evaluate(size_t i0, size_t i1, size_t j0, size_t j1)
+		{
+			std::vector<std::pair<size_t, size_t>> bands;
+			for (size_t tile = 0; tile + 1 < m_tiles.size(); tile++)
+			{
+				const size_t first = std::max(j0, m_tiles[tile]), last = std::min(j1, m_tiles[tile + 1]);
+				if (first < last)
+				{
+					bands.emplace_back(first, last);
+				}
+			}
+			std::vector<std::vector<size_t>> degenerate(bands.size());
+			parallel_for(bands.size(), [&](size_t threads) { m_workspaces.resize(std::max(threads, m_workspaces.size())); },
+				[&](size_t band, size_t thread)
+				{
+					internal::grid_region(m_cw, m_basis_u, m_basis_v, m_degree_u, m_degree_v, i0, i1, bands[band].first, bands[band].second,
+						m_grid, m_workspaces[thread], degenerate[band]);
+				}, [](size_t) {}, 2);
+
+			std::vector<size_t> all;
+			for (size_t j = j0; j < j1; j++)
+			{
+				std::fill(m_degenerate.begin() + i0 + j * m_count_u, m_degenerate.begin() + i1 + j * m_count_u, 0);
+			}
+			for (const auto& list : degenerate)
+			{
+				for (size_t index : list)
+				{
+					m_degenerate[index] = 1;
+				}
+				all.insert(all.end(), list.begin(), list.end());
+			}
+			return all;
+		}
+
+		size_t m_count_u = 0, m_count_v = 0;
+		bool m_valid = false;
+		int m_degree_u = 0, m_degree_v = 0;
+		std::vector<scalar> m_knots_u, m_knots_v;
+		Array2<vec4> m_cw;
+		internal::GridBasis<scalar> m_basis_u, m_basis_v;
+		std::vector<size_t> m_tiles;
+		SurfaceGrid m_grid;
+		// Vertices whose own normal is not defined, one byte each so bands may be written apart
+		std::vector<unsigned char> m_degenerate;
+		std::vector<NurbsWorkspace> m_workspaces;
+	};
+}
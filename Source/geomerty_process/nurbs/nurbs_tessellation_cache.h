@@ -0,0 +1,250 @@
+#pragma once
+#include <cstdint>
+#include <iterator>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+#include "nurbs_surface.h"
+#include "nurbs_tessellate.h"
+
+namespace Geomerty::nurbs::util
+{
+	// Default memory budget of the process-wide TessellationCache
+	inline constexpr size_t N_TESSELLATION_CACHE_BUDGET = size_t(256) << 20;
+
+	namespace internal
+	{
+		inline constexpr uint64_t N_FNV_OFFSET = 14695981039346656037ull;
+		inline constexpr uint64_t N_FNV_PRIME = 1099511628211ull;
+
+		/*
+		 * Mix size bytes into a 64 bit FNV-1a hash, one byte at a time
+		 */
+		inline uint64_t hash_bytes(uint64_t hash, const void* data, size_t size)
+		{
+			const unsigned char* bytes = static_cast<const unsigned char*>(data);
+			for (size_t i = 0; i < size; i++)
+			{
+				hash = (hash ^ bytes[i]) * N_FNV_PRIME;
+			}
+			return hash;
+		}
+
+		/*
+		 * Append size bytes to a cache key
+		 */
+		inline void append_bytes(std::vector<unsigned char>& key, const void* data, size_t size)
+		{
+			const unsigned char* bytes = static_cast<const unsigned char*>(data);
+			key.insert(key.end(), bytes, bytes + size);
+		}
+
+		template<typename T>
+		inline void append_value(std::vector<unsigned char>& key, const T& value)
+		{
+			append_bytes(key, &value, sizeof(T));
+		}
+
+		/*
+		 * Full content of a surface as bytes: degrees, knots, control points and weights
+		 */
+		inline std::vector<unsigned char> surface_key(const RationalSurface& srf)
+		{
+			std::vector<unsigned char> key;
+			key.reserve(4 * sizeof(size_t) + 2 * sizeof(srf.m_degree_u) + (srf.m_knots_u.size() + srf.m_knots_v.size()) * sizeof(scalar) +
+				srf.m_control_points.flat().size() * sizeof(vec3) + srf.m_weights.flat().size() * sizeof(scalar));
+			append_value(key, srf.m_degree_u);
+			append_value(key, srf.m_degree_v);
+			append_value(key, srf.m_knots_u.size());
+			append_bytes(key, srf.m_knots_u.data(), srf.m_knots_u.size() * sizeof(scalar));
+			append_value(key, srf.m_knots_v.size());
+			append_bytes(key, srf.m_knots_v.data(), srf.m_knots_v.size() * sizeof(scalar));
+			append_value(key, srf.m_control_points.rows());
+			append_value(key, srf.m_control_points.cols());
+			append_bytes(key, srf.m_control_points.data(), srf.m_control_points.flat().size() * sizeof(vec3));
+			append_bytes(key, srf.m_weights.data(), srf.m_weights.flat().size() * sizeof(scalar));
+			return key;
+		}
+
+		/*
+		 * Bytes held by the buffers of a tessellation
+		 */
+		inline size_t tessellation_bytes(const SurfaceTessellation& mesh)
+		{
+			return sizeof(SurfaceTessellation) + mesh.positions.capacity() * sizeof(vec3) + mesh.normals.capacity() * sizeof(vec3) +
+				mesh.uvs.capacity() * sizeof(vec2) + mesh.indices.capacity() * sizeof(size_t);
+		}
+	}// namespace internal
+
+	/**
+	 * Content hash of a surface, equal for surfaces with the same degrees, knots, control points and weights
+	 * @param[in] srf RationalSurface object
+	 * @return 64 bit hash
+	 */
+	inline uint64_t surface_hash(const RationalSurface& srf)
+	{
+		const std::vector<unsigned char> key = internal::surface_key(srf);
+		return internal::hash_bytes(internal::N_FNV_OFFSET, key.data(), key.size());
+	}
+
+	/**
+	 * Least recently used cache of surface tessellations keyed by the content of the surface and the tolerances.
+	 * Entries are looked up by hash and the full key is compared, so a hash collision is a miss rather than a wrong mesh.
+	 * Presenting an unchanged surface again is a lookup. Entries are shared, so evicting one never invalidates
+	 * a tessellation still in use. All members are thread safe.
+	 */
+	class TessellationCache
+	{
+	public:
+		struct Stats
+		{
+			size_t hits = 0;
+			size_t misses = 0;
+			size_t evictions = 0;
+			size_t entries = 0;
+			// Bytes held by the cached tessellations
+			size_t bytes = 0;
+		};
+
+		explicit TessellationCache(size_t budget = N_TESSELLATION_CACHE_BUDGET) : m_budget(budget) {}
+
+		/**
+		 * Cache shared by the whole process
+		 */
+		static TessellationCache& instance()
+		{
+			static TessellationCache cache;
+			return cache;
+		}
+
+		/**
+		 * Tessellation of a surface, see tessellate_surface, computed on a miss
+		 * @param[in] srf RationalSurface object
+		 * @param[in] tol Tessellation tolerances
+		 * @return Shared tessellation, empty if the surface is invalid.
+		 */
+		std::shared_ptr<const SurfaceTessellation> tessellate(const RationalSurface& srf, const TessellationTolerance& tol = {})
+		{
+			std::vector<unsigned char> key = internal::surface_key(srf);
+			internal::append_value(key, tol.chord);
+			internal::append_value(key, tol.angle);
+			internal::append_value(key, tol.max_segments);
+			const uint64_t hash = internal::hash_bytes(internal::N_FNV_OFFSET, key.data(), key.size());
+			if (auto found = find(hash, key))
+			{
+				return found;
+			}
+			// Tessellate outside the lock, two threads missing the same key both compute it and the first one is kept
+			auto mesh = std::make_shared<const SurfaceTessellation>(tessellate_surface(srf, tol));
+			return insert(hash, std::move(key), std::move(mesh));
+		}
+
+		/**
+		 * Change the memory budget, least recently used entries are evicted until the cache fits in it
+		 */
+		void set_budget(size_t bytes)
+		{
+			std::lock_guard lock(m_mutex);
+			m_budget = bytes;
+			evict(0);
+		}
+		size_t budget() const
+		{
+			std::lock_guard lock(m_mutex);
+			return m_budget;
+		}
+		void clear()
+		{
+			std::lock_guard lock(m_mutex);
+			m_entries.clear();
+			m_index.clear();
+			m_stats.bytes = 0;
+			m_stats.entries = 0;
+		}
+		Stats stats() const
+		{
+			std::lock_guard lock(m_mutex);
+			return m_stats;
+		}
+
+	private:
+		struct Entry
+		{
+			uint64_t hash;
+			std::vector<unsigned char> key;
+			size_t bytes;
+			std::shared_ptr<const SurfaceTessellation> mesh;
+		};
+
+		std::shared_ptr<const SurfaceTessellation> find(uint64_t hash, const std::vector<unsigned char>& key)
+		{
+			std::lock_guard lock(m_mutex);
+			auto it = m_index.find(hash);
+			if (it == m_index.end() || it->second->key != key)
+			{
+				m_stats.misses++;
+				return nullptr;
+			}
+			m_stats.hits++;
+			m_entries.splice(m_entries.begin(), m_entries, it->second);
+			return it->second->mesh;
+		}
+
+		std::shared_ptr<const SurfaceTessellation> insert(uint64_t hash, std::vector<unsigned char> key, std::shared_ptr<const SurfaceTessellation> mesh)
+		{
+			const size_t bytes = internal::tessellation_bytes(*mesh) + key.capacity();
+			std::lock_guard lock(m_mutex);
+			auto it = m_index.find(hash);
+			if (it != m_index.end())
+			{
+				if (it->second->key == key)
+				{
+					m_entries.splice(m_entries.begin(), m_entries, it->second);
+					return it->second->mesh;
+				}
+				// Hash collision with a different surface, the older entry gives way
+				remove(it->second);
+			}
+			if (bytes > m_budget)
+			{
+				// Larger than the whole budget, handed out without being kept
+				return mesh;
+			}
+			evict(bytes);
+			m_entries.push_front({ hash, std::move(key), bytes, mesh });
+			m_index.emplace(hash, m_entries.begin());
+			m_stats.bytes += bytes;
+			m_stats.entries++;
+			return mesh;
+		}
+
+		/* Drop least recently used entries until bytes more fit in the budget, the mutex must be held */
+		void evict(size_t bytes)
+		{
+			while (!m_entries.empty() && m_stats.bytes + bytes > m_budget)
+			{
+				remove(std::prev(m_entries.end()));
+			}
+		}
+
+		/* Drop one entry, the mutex must be held */
+		void remove(std::list<Entry>::iterator entry)
+		{
+			m_stats.bytes -= entry->bytes;
+			m_stats.entries--;
+			m_stats.evictions++;
+			m_index.erase(entry->hash);
+			m_entries.erase(entry);
+		}
+
+		mutable std::mutex m_mutex;
+		size_t m_budget;
+		Stats m_stats;
+		// Most recently used first
+		std::list<Entry> m_entries;
+		std::unordered_map<uint64_t, std::list<Entry>::iterator> m_index;
+	};
+}
@@ -1,6 +1,12 @@
 #pragma once
 #include <Eigen/Dense>
 #include <Eigen/Sparse>
+#include <algorithm>
+#include <array>
+#include <cassert>
+#include <span>
+#include <tuple>
+#include <type_traits>
 
 namespace Geomerty
 {
@@ -12,8 +18,18 @@ namespace Geomerty
 			using vec3 = Eigen::Vector3<scalar>;
 			using vec4 = Eigen::Vector4<scalar>;
 			using AABB3 = Eigen::AlignedBox<scalar, 3>;
+			// Points of the evaluators templated on their scalar type, float for display and double for solvers
+			template<typename Real> using vec3_t = Eigen::Vector3<Real>;
+			template<typename Real> using vec4_t = Eigen::Vector4<Real>;
 			inline constexpr scalar N_FLOAT_PI = 3.1415926535897932385f;
 			inline constexpr scalar N_SCALAR_EPSILON = std::numeric_limits<scalar>::epsilon();
+			inline constexpr size_t N_MAX_DEGREE = 9;
+#if defined(EIGEN_VECTORIZE_AVX)
+			inline constexpr int N_EVALUATE_LANES = 8;
+#else
+			inline constexpr int N_EVALUATE_LANES = 4;
+#endif
+			template<int Lanes, typename Real = scalar> using LaneArray = Eigen::Array<Real, Lanes, 1>;
 			/**
 			 * Checks if the relation between degree, number of knots, and
 			 * number of control points is valid
@@ -159,6 +175,8 @@ namespace Geomerty
 			 * @return Point in cartesian coordinates
 			 */
 			inline vec3 homogenous_to_cartesian(const vec4& pt) { return pt.head<3>() / pt[3]; }
+			template<typename Real>
+			inline vec3_t<Real> homogenous_to_cartesian(const vec4_t<Real>& pt) { return pt.template head<3>() / pt[3]; }
 			/**
 			 * Convert a list of nd points in homogenous coordinates to a list of (n-1)d points in cartesian
 			 * coordinates by perspective division
@@ -256,7 +274,8 @@ namespace Geomerty
 			 * @param[in] u Parameter value.
 			 * @return Span index into the knot vector such that (span - 1) < u <= span
 			 */
-			inline int find_span(const size_t degree, const std::vector<scalar>& knots, scalar u)
+			template<typename Real>
+			inline int find_span(const size_t degree, const std::vector<Real>& knots, std::type_identity_t<Real> u)
 			{
 				// index of last control point
 				int n = static_cast<int>(knots.size()) - degree - 2;
@@ -346,6 +365,213 @@ namespace Geomerty
 				return N[0];
 			}
 
+			template<typename Real> using BasisArrayT = std::array<Real, N_MAX_DEGREE + 1>;
+			template<typename Real> using BasisDerTableT = std::array<BasisArrayT<Real>, N_MAX_DEGREE + 1>;
+			using BasisArray = BasisArrayT<scalar>;
+			using BasisDerTable = BasisDerTableT<scalar>;
+
+			namespace internal
+			{
+				/*
+				 * Recurrence of bspline_basis() on stack storage for degrees up to Capacity.
+				 * With deg known at compile time the loops have constant bounds and unroll.
+				 */
+				template<size_t Capacity, typename Real>
+				inline void basis_kernel(size_t deg, int span, const std::vector<Real>& knots, std::type_identity_t<Real> u, Real* N)
+				{
+					std::array<Real, Capacity + 1> left, right;
+					N[0] = 1.0f;
+
+					for (int j = 1; j <= static_cast<int>(deg); j++)
+					{
+						left[j] = u - knots[span + 1 - j];
+						right[j] = knots[span + j] - u;
+						Real saved = 0.0f;
+						for (int r = 0; r < j; r++)
+						{
+							Real temp = N[r] / (right[r + 1] + left[j - r]);
+							N[r] = saved + right[r + 1] * temp;
+							saved = left[j - r] * temp;
+						}
+						N[j] = saved;
+					}
+				}
+
+				/*
+				 * Recurrence of bspline_der_basis() on stack storage for degrees up to Capacity.
+				 * ders[k][j] receives the kth derivative of the jth non-zero basis function, num_ders <= deg.
+				 */
+				template<size_t Capacity, typename Real, typename Table>
+				inline void der_basis_kernel(size_t deg, int span, const std::vector<Real>& knots, std::type_identity_t<Real> u, int num_ders, Table& ders)
+				{
+					std::array<Real, Capacity + 1> left, right;
+					std::array<std::array<Real, Capacity + 1>, Capacity + 1> ndu;
+					ndu[0][0] = 1.0f;
+
+					for (int j = 1; j <= static_cast<int>(deg); j++)
+					{
+						left[j] = u - knots[span + 1 - j];
+						right[j] = knots[span + j] - u;
+						Real saved = 0.0f;
+
+						for (int r = 0; r < j; r++)
+						{
+							// Lower triangle
+							ndu[j][r] = right[r + 1] + left[j - r];
+							Real temp = ndu[r][j - 1] / ndu[j][r];
+							// Upper triangle
+							ndu[r][j] = saved + right[r + 1] * temp;
+							saved = left[j - r] * temp;
+						}
+
+						ndu[j][j] = saved;
+					}
+
+					for (int j = 0; j <= static_cast<int>(deg); j++)
+					{
+						ders[0][j] = ndu[j][deg];
+					}
+
+					std::array<std::array<Real, Capacity + 1>, 2> a;
+
+					for (int r = 0; r <= static_cast<int>(deg); r++)
+					{
+						int s1 = 0;
+						int s2 = 1;
+						a[0][0] = 1.0f;
+
+						for (int k = 1; k <= num_ders; k++)
+						{
+							Real d = 0.0f;
+							int rk = r - k;
+							int pk = static_cast<int>(deg) - k;
+
+							if (r >= k)
+							{
+								a[s2][0] = a[s1][0] / ndu[pk + 1][rk];
+								d = a[s2][0] * ndu[rk][pk];
+							}
+
+							int j1 = rk >= -1 ? 1 : -rk;
+							int j2 = r - 1 <= pk ? k - 1 : static_cast<int>(deg) - r;
+
+							for (int j = j1; j <= j2; j++)
+							{
+								a[s2][j] = (a[s1][j] - a[s1][j - 1]) / ndu[pk + 1][rk + j];
+								d += a[s2][j] * ndu[rk + j][pk];
+							}
+
+							if (r <= pk)
+							{
+								a[s2][k] = -a[s1][k - 1] / ndu[pk + 1][r];
+								d += a[s2][k] * ndu[r][pk];
+							}
+
+							ders[k][r] = d;
+							std::swap(s1, s2);
+						}
+					}
+
+					Real fac = static_cast<Real>(deg);
+					for (int k = 1; k <= num_ders; k++)
+					{
+						for (int j = 0; j <= static_cast<int>(deg); j++)
+						{
+							ders[k][j] *= fac;
+						}
+						fac *= static_cast<Real>(static_cast<int>(deg) - k);
+					}
+				}
+			}// namespace internal
+
+			/**
+			 * Compute all non-zero B-spline basis functions of a fixed degree without allocating
+			 * @tparam Degree Degree of the basis function.
+			 * @param[in] span Index obtained from findSpan() corresponding the u and knots.
+			 * @param[in] knots Knot vector corresponding to the basis functions.
+			 * @param[in] u Parameter to evaluate the basis functions at.
+			 * @return N Values of (Degree+1) non-zero basis functions.
+			 */
+			template<size_t Degree>
+			inline std::array<scalar, Degree + 1> bspline_basis(int span, const std::vector<scalar>& knots, scalar u)
+			{
+				static_assert(Degree >= 1 && Degree <= N_MAX_DEGREE);
+				std::array<scalar, Degree + 1> N;
+				internal::basis_kernel<Degree>(Degree, span, knots, u, N.data());
+				return N;
+			}
+
+			/**
+			 * Compute all non-zero derivatives of B-spline basis functions of a fixed degree without allocating
+			 * @tparam Degree Degree of the basis function.
+			 * @tparam NumDers Number of derivatives to compute (NumDers <= Degree).
+			 * @param[in] span Index obtained from findSpan() corresponding the u and knots.
+			 * @param[in] knots Knot vector corresponding to the basis functions.
+			 * @param[in] u Parameter to evaluate the basis functions at.
+			 * @return ders ders[k][j] is the kth derivative of the jth non-zero basis function.
+			 */
+			template<size_t Degree, int NumDers>
+			inline std::array<std::array<scalar, Degree + 1>, NumDers + 1> bspline_der_basis(int span, const std::vector<scalar>& knots, scalar u)
+			{
+				static_assert(Degree >= 1 && Degree <= N_MAX_DEGREE && NumDers >= 0 && NumDers <= static_cast<int>(Degree));
+				std::array<std::array<scalar, Degree + 1>, NumDers + 1> ders;
+				internal::der_basis_kernel<Degree>(Degree, span, knots, u, NumDers, ders);
+				return ders;
+			}
+
+			/**
+			 * Compute all non-zero B-spline basis functions without allocating.
+			 * Degrees 1 to 5 are dispatched to the degree specialised kernels.
+			 * @param[in] deg Degree of the basis function, deg <= N_MAX_DEGREE.
+			 * @param[in] span Index obtained from findSpan() corresponding the u and knots.
+			 * @param[in] knots Knot vector corresponding to the basis functions.
+			 * @param[in] u Parameter to evaluate the basis functions at.
+			 * @param[out] N N[j] is the jth of the (deg+1) non-zero basis functions.
+			 */
+			template<typename Real>
+			inline void bspline_basis(size_t deg, int span, const std::vector<Real>& knots, std::type_identity_t<Real> u, BasisArrayT<Real>& N)
+			{
+				switch (deg)
+				{
+				case 1: internal::basis_kernel<1>(1, span, knots, u, N.data()); break;
+				case 2: internal::basis_kernel<2>(2, span, knots, u, N.data()); break;
+				case 3: internal::basis_kernel<3>(3, span, knots, u, N.data()); break;
+				case 4: internal::basis_kernel<4>(4, span, knots, u, N.data()); break;
+				case 5: internal::basis_kernel<5>(5, span, knots, u, N.data()); break;
+				default:
+					assert(deg <= N_MAX_DEGREE);
+					internal::basis_kernel<N_MAX_DEGREE>(deg, span, knots, u, N.data());
+					break;
+				}
+			}
+
+			/**
+			 * Compute all non-zero derivatives of B-spline basis functions without allocating.
+			 * Degrees 1 to 5 are dispatched to the degree specialised kernels.
+			 * @param[in] deg Degree of the basis function, deg <= N_MAX_DEGREE.
+			 * @param[in] span Index obtained from findSpan() corresponding the u and knots.
+			 * @param[in] knots Knot vector corresponding to the basis functions.
+			 * @param[in] u Parameter to evaluate the basis functions at.
+			 * @param[in] num_ders Number of derivatives to compute (num_ders <= deg)
+			 * @param[out] ders ders[k][j] is the kth derivative of the jth non-zero basis function.
+			 */
+			template<typename Real>
+			inline void bspline_der_basis(size_t deg, int span, const std::vector<Real>& knots, std::type_identity_t<Real> u, int num_ders, BasisDerTableT<Real>& ders)
+			{
+				switch (deg)
+				{
+				case 1: internal::der_basis_kernel<1>(1, span, knots, u, num_ders, ders); break;
+				case 2: internal::der_basis_kernel<2>(2, span, knots, u, num_ders, ders); break;
+				case 3: internal::der_basis_kernel<3>(3, span, knots, u, num_ders, ders); break;
+				case 4: internal::der_basis_kernel<4>(4, span, knots, u, num_ders, ders); break;
+				case 5: internal::der_basis_kernel<5>(5, span, knots, u, num_ders, ders); break;
+				default:
+					assert(deg <= N_MAX_DEGREE);
+					internal::der_basis_kernel<N_MAX_DEGREE>(deg, span, knots, u, num_ders, ders);
+					break;
+				}
+			}
+
 			/**
 			 * Compute all non-zero B-spline basis functions
 			 * @param[in] deg Degree of the basis function.
@@ -356,35 +582,52 @@ namespace Geomerty
 			 */
 			inline std::vector<scalar> bspline_basis(size_t deg, int span, const std::vector<scalar>& knots, scalar u)
 			{
-				if (!(span > 0 && deg >= 1 && deg <= 9 && knots.size() > 0) || (u < knots.front() && (knots.front() - u) > N_SCALAR_EPSILON) ||
+				if (!(span > 0 && deg >= 1 && deg <= N_MAX_DEGREE && knots.size() > 0) || (u < knots.front() && (knots.front() - u) > N_SCALAR_EPSILON) ||
 					(u > knots.back() && (u - knots.back()) > N_SCALAR_EPSILON))
 				{
 					return std::vector<scalar>{};
 				}
 
-				std::vector<scalar> N;
-				N.resize(deg + 1, 0.0f);
-				std::vector<scalar> left, right;
-				left.resize(deg + 1, 0.0f);
-				right.resize(deg + 1, 0.0f);
-				scalar saved = 0.0, temp = 0.0;
+				BasisArray N;
+				bspline_basis(deg, span, knots, u, N);
+				return std::vector<scalar>(N.begin(), N.begin() + deg + 1);
+			}
 
-				N[0] = 1.0;
+			/**
+			 * Compute all non-zero B-spline basis functions for a batch of parameters.
+			 * Every lane runs the recurrence of bspline_basis() with its own span and
+			 * parameter, so Lanes parameters share one SIMD register.
+			 * @param[in] deg Degree of the basis function, 1 <= deg <= N_MAX_DEGREE.
+			 * @param[in] spans Lanes indices obtained from findSpan().
+			 * @param[in] knots Knot vector corresponding to the basis functions.
+			 * @param[in] u Parameters to evaluate the basis functions at.
+			 * @param[out] N N[j][l] is the jth non-zero basis function of lane l.
+			 */
+			template<int Lanes, typename Real>
+			inline void bspline_basis_lanes(size_t deg, const std::array<int, Lanes>& spans, const std::vector<Real>& knots, const LaneArray<Lanes, Real>& u,
+				std::array<LaneArray<Lanes, Real>, N_MAX_DEGREE + 1>& N)
+			{
+				std::array<LaneArray<Lanes, Real>, N_MAX_DEGREE + 1> left, right;
+				N[0].setOnes();
 
 				for (int j = 1; j <= static_cast<int>(deg); j++)
 				{
-					left[j] = (u - knots[span + 1 - j]);
-					right[j] = knots[span + j] - u;
-					saved = 0.0;
+					for (int l = 0; l < Lanes; l++)
+					{
+						left[j][l] = knots[spans[l] + 1 - j];
+						right[j][l] = knots[spans[l] + j];
+					}
+					left[j] = u - left[j];
+					right[j] -= u;
+					LaneArray<Lanes, Real> saved = LaneArray<Lanes, Real>::Zero();
 					for (int r = 0; r < j; r++)
 					{
-						temp = N[r] / (right[r + 1] + left[j - r]);
+						LaneArray<Lanes, Real> temp = N[r] / (right[r + 1] + left[j - r]);
 						N[r] = saved + right[r + 1] * temp;
 						saved = left[j - r] * temp;
 					}
 					N[j] = saved;
 				}
-				return N;
 			}
 
 			/**
@@ -393,116 +636,638 @@ namespace Geomerty
 			 * @param[in] span Index obtained from findSpan() corresponding the u and knots.
 			 * @param[in] knots Knot vector corresponding to the basis functions.
 			 * @param[in] u Parameter to evaluate the basis functions at.
-			 * @param[in] num_ders Number of derivatives to compute (num_ders <= deg)
+			 * @param[in] num_ders Number of derivatives to compute, those above deg are zero.
 			 * @return ders Values of non-zero derivatives of basis functions.
 			 */
 			inline std::vector<std::vector<scalar>> bspline_der_basis(size_t deg, int span, const std::vector<scalar>& knots, scalar u, int num_ders)
 			{
-				std::vector<scalar> left, right;
-				left.resize(deg + 1, 0.0f);
-				right.resize(deg + 1, 0.0f);
-				scalar saved = 0.0f, temp = 0.0f;
-				std::vector<std::vector<scalar>> ndu(deg + 1, std::vector<scalar>(deg + 1, 0.0f));
-				ndu[0][0] = 1.0f;
-
-				for (int j = 1; j <= static_cast<int>(deg); j++)
+				std::vector<std::vector<scalar>> ders(num_ders + 1, std::vector<scalar>(deg + 1, 0.0f));
+				if (deg > N_MAX_DEGREE)
 				{
-					left[j] = u - knots[span + 1 - j];
-					right[j] = knots[span + j] - u;
-					saved = 0.0;
+					return ders;
+				}
+				BasisDerTable table;
+				int du = std::min(num_ders, static_cast<int>(deg));
+				bspline_der_basis(deg, span, knots, u, du, table);
+				for (int k = 0; k <= du; k++)
+				{
+					std::copy_n(table[k].begin(), deg + 1, ders[k].begin());
+				}
+				return ders;
+			}
 
-					for (int r = 0; r < j; r++)
+			/**
+			 * Shape of a knot vector as far as the uniform matrix form is concerned
+			 */
+			enum class KnotVectorType
+			{
+				NonUniform,  // Breakpoints are not equally spaced
+				Uniform,     // All knots are equally spaced
+				OpenUniform, // Clamped ends with equally spaced interior knots
+			};
+
+			/**
+			 * Classify a knot vector
+			 * @param[in] degree Degree of the basis functions.
+			 * @param[in] knots Knot vector.
+			 * @param[out] spacing Distance between consecutive breakpoints when the result is not NonUniform.
+			 * @return Type of the knot vector.
+			 */
+			template<typename Real>
+			inline KnotVectorType classify_knots(size_t degree, const std::vector<Real>& knots, Real& spacing)
+			{
+				// index of last control point
+				int n = static_cast<int>(knots.size()) - static_cast<int>(degree) - 2;
+				if (n < static_cast<int>(degree))
+				{
+					return KnotVectorType::NonUniform;
+				}
+				const int p = static_cast<int>(degree);
+				const Real tol = 1e-5f * (knots.back() - knots.front());
+				spacing = knots[p + 1] - knots[p];
+				if (!(spacing > tol))
+				{
+					return KnotVectorType::NonUniform;
+				}
+				for (int i = p + 1; i <= n + 1; i++)
+				{
+					if (std::abs(knots[i] - knots[i - 1] - spacing) > tol)
 					{
-						// Lower triangle
-						ndu[j][r] = right[r + 1] + left[j - r];
-						temp = ndu[r][j - 1] / ndu[j][r];
-						// Upper triangle
-						ndu[r][j] = saved + right[r + 1] * temp;
-						saved = left[j - r] * temp;
+						return KnotVectorType::NonUniform;
 					}
+				}
 
-					ndu[j][j] = saved;
+				bool clamped = true;
+				bool uniform = true;
+				for (int i = 0; i < p; i++)
+				{
+					clamped = clamped && knots[i] == knots[p] && knots[n + 2 + i] == knots[n + 1];
+					uniform = uniform && std::abs(knots[i + 1] - knots[i] - spacing) <= tol && std::abs(knots[n + 2 + i] - knots[n + 1 + i] - spacing) <= tol;
+				}
+				if (clamped)
+				{
+					return KnotVectorType::OpenUniform;
 				}
+				return uniform ? KnotVectorType::Uniform : KnotVectorType::NonUniform;
+			}
 
-				std::vector<std::vector<scalar>> ders(num_ders + 1, std::vector<scalar>(deg + 1, 0.0f));
+			namespace internal
+			{
+				/*
+				 * Power basis coefficients of the non-zero basis functions on one span of a uniform B-spline.
+				 * With unit knot spacing every Cox-de Boor denominator of bspline_basis() is the constant j,
+				 * so the recurrence runs on polynomials in the local parameter t in [0, 1].
+				 * M[j][k] is the coefficient of t^k in the jth non-zero basis function.
+				 */
+				template<typename Real>
+				constexpr BasisDerTableT<Real> make_uniform_basis_matrix(size_t deg)
+				{
+					using poly = std::array<double, N_MAX_DEGREE + 1>;
+					std::array<poly, N_MAX_DEGREE + 1> N{};
+					N[0][0] = 1.0;
+					for (size_t j = 1; j <= deg; j++)
+					{
+						poly saved{};
+						for (size_t r = 0; r < j; r++)
+						{
+							poly temp{}, next{};
+							for (size_t k = 0; k <= N_MAX_DEGREE; k++)
+							{
+								temp[k] = N[r][k] / static_cast<double>(j);
+							}
+							for (size_t k = 0; k <= N_MAX_DEGREE; k++)
+							{
+								// right[r + 1] = r + 1 - t, left[j - r] = j - r - 1 + t
+								double shifted = k > 0 ? temp[k - 1] : 0.0;
+								next[k] = saved[k] + static_cast<double>(r + 1) * temp[k] - shifted;
+								saved[k] = static_cast<double>(j - r - 1) * temp[k] + shifted;
+							}
+							N[r] = next;
+						}
+						N[j] = saved;
+					}
+					BasisDerTableT<Real> M{};
+					for (size_t j = 0; j <= N_MAX_DEGREE; j++)
+					{
+						for (size_t k = 0; k <= N_MAX_DEGREE; k++)
+						{
+							M[j][k] = static_cast<Real>(N[j][k]);
+						}
+					}
+					return M;
+				}
+			}// namespace internal
 
-				for (int j = 0; j <= static_cast<int>(deg); j++)
+			/**
+			 * Uniform B-spline basis matrices, N_UNIFORM_BASIS_MATRICES<Real>[deg][j][k] is the coefficient
+			 * of t^k in the jth non-zero basis function of degree deg on a span of a uniform knot vector.
+			 */
+			template<typename Real>
+			inline constexpr std::array<BasisDerTableT<Real>, N_MAX_DEGREE + 1> N_UNIFORM_BASIS_MATRICES = []
+			{
+				std::array<BasisDerTableT<Real>, N_MAX_DEGREE + 1> matrices{};
+				for (size_t deg = 0; deg <= N_MAX_DEGREE; deg++)
 				{
-					ders[0][j] = ndu[j][deg];
+					matrices[deg] = internal::make_uniform_basis_matrix<Real>(deg);
 				}
+				return matrices;
+			}();
+			inline constexpr const std::array<BasisDerTable, N_MAX_DEGREE + 1>& N_UNIFORM_BASIS_MATRIX = N_UNIFORM_BASIS_MATRICES<scalar>;
 
-				std::vector<std::vector<scalar>> a(2, std::vector<scalar>(deg + 1, 0.0f));
+			/**
+			 * Basis functions of one knot vector.
+			 * The knot vector is classified at construction; spans whose 2 * degree surrounding knots
+			 * are equally spaced are evaluated with the uniform matrix form, the spans near clamped
+			 * ends and non-uniform knot vectors use the Cox-de Boor recurrence.
+			 * @tparam Real Scalar type of the knots and of the basis functions
+			 */
+			template<typename Real>
+			class BasicKnotBasis
+			{
+			public:
+				BasicKnotBasis() = default;
+				BasicKnotBasis(size_t degree, const std::vector<Real>& knots);
+				/**
+				 * Same basis in another scalar type, the knot vector is converted and classified again
+				 */
+				template<typename Other>
+				explicit BasicKnotBasis(const BasicKnotBasis<Other>& other)
+					: BasicKnotBasis(other.degree(), std::vector<Real>(other.knots().begin(), other.knots().end()))
+				{
+				}
 
-				for (int r = 0; r <= static_cast<int>(deg); r++)
+				size_t degree() const { return m_degree; }
+				const std::vector<Real>& knots() const { return m_knots; }
+				KnotVectorType type() const { return m_type; }
+				bool is_uniform_span(int span) const { return span >= m_uniform_first && span <= m_uniform_last; }
+				int span(Real u) const { return find_span(m_degree, m_knots, u); }
+
+				/**
+				 * Compute all non-zero basis functions
+				 * @param[in] span Index obtained from span() corresponding the u.
+				 * @param[in] u Parameter to evaluate the basis functions at.
+				 * @param[out] N N[j] is the jth of the (degree+1) non-zero basis functions.
+				 */
+				void basis(int span, Real u, BasisArrayT<Real>& N) const;
+				/**
+				 * Compute all non-zero derivatives of the basis functions
+				 * @param[in] span Index obtained from span() corresponding the u.
+				 * @param[in] u Parameter to evaluate the basis functions at.
+				 * @param[in] num_ders Number of derivatives to compute (num_ders <= degree)
+				 * @param[out] ders ders[k][j] is the kth derivative of the jth non-zero basis function.
+				 */
+				void der_basis(int span, Real u, int num_ders, BasisDerTableT<Real>& ders) const;
+				/**
+				 * Compute all non-zero basis functions for a batch of parameters, see bspline_basis_lanes()
+				 */
+				template<int Lanes>
+				void basis_lanes(const std::array<int, Lanes>& spans, const LaneArray<Lanes, Real>& u, std::array<LaneArray<Lanes, Real>, N_MAX_DEGREE + 1>& N) const;
+
+			private:
+				size_t m_degree = 0;
+				std::vector<Real> m_knots;
+				KnotVectorType m_type = KnotVectorType::NonUniform;
+				Real m_inv_spacing = 0.0f;
+				int m_uniform_first = 1;
+				int m_uniform_last = 0;
+			};
+			using KnotBasis = BasicKnotBasis<scalar>;
+
+			template<typename Real>
+			inline BasicKnotBasis<Real>::BasicKnotBasis(size_t degree, const std::vector<Real>& knots)
+				: m_degree(degree), m_knots(knots)
+			{
+				Real spacing = 0.0f;
+				m_type = degree <= N_MAX_DEGREE ? classify_knots(degree, knots, spacing) : KnotVectorType::NonUniform;
+				if (m_type == KnotVectorType::NonUniform)
 				{
-					int s1 = 0;
-					int s2 = 1;
-					a[0][0] = 1.0;
+					return;
+				}
+				const int p = static_cast<int>(degree);
+				const int n = static_cast<int>(knots.size()) - p - 2;
+				m_inv_spacing = 1.0f / spacing;
+				// Clamped ends repeat the first and last breakpoints, so only spans whose support stays
+				// inside the equally spaced breakpoints [p, n + 1] are uniform
+				m_uniform_first = m_type == KnotVectorType::Uniform ? p : std::max(p, 2 * p - 1);
+				m_uniform_last = m_type == KnotVectorType::Uniform ? n : n + 1 - p;
+			}
 
-					for (int k = 1; k <= num_ders; k++)
+			template<typename Real>
+			inline void BasicKnotBasis<Real>::basis(int span, Real u, BasisArrayT<Real>& N) const
+			{
+				if (!is_uniform_span(span))
+				{
+					bspline_basis(m_degree, span, m_knots, u, N);
+					return;
+				}
+				const BasisDerTableT<Real>& M = N_UNIFORM_BASIS_MATRICES<Real>[m_degree];
+				const Real t = (u - m_knots[span]) * m_inv_spacing;
+				for (int j = 0; j <= static_cast<int>(m_degree); j++)
+				{
+					Real b = M[j][m_degree];
+					for (int k = static_cast<int>(m_degree) - 1; k >= 0; k--)
 					{
-						scalar d = 0.0f;
-						int rk = r - k;
-						int pk = deg - k;
-						int j1 = 0;
-						int j2 = 0;
+						b = b * t + M[j][k];
+					}
+					N[j] = b;
+				}
+			}
 
-						if (r >= k)
+			template<typename Real>
+			inline void BasicKnotBasis<Real>::der_basis(int span, Real u, int num_ders, BasisDerTableT<Real>& ders) const
+			{
+				if (!is_uniform_span(span))
+				{
+					bspline_der_basis(m_degree, span, m_knots, u, num_ders, ders);
+					return;
+				}
+				const BasisDerTableT<Real>& M = N_UNIFORM_BASIS_MATRICES<Real>[m_degree];
+				const int p = static_cast<int>(m_degree);
+				const Real t = (u - m_knots[span]) * m_inv_spacing;
+				// d^d/du^d of t^k is k! / (k - d)! * t^(k - d) / spacing^d
+				Real scale = 1.0f;
+				for (int d = 0; d <= num_ders; d++)
+				{
+					for (int j = 0; j <= p; j++)
+					{
+						Real b = 0.0f;
+						for (int k = p; k >= d; k--)
 						{
-							a[s2][0] = a[s1][0] / ndu[pk + 1][rk];
-							d = a[s2][0] * ndu[rk][pk];
+							Real falling = 1.0f;
+							for (int f = 0; f < d; f++)
+							{
+								falling *= static_cast<Real>(k - f);
+							}
+							b = b * t + falling * M[j][k];
 						}
+						ders[d][j] = b * scale;
+					}
+					scale *= m_inv_spacing;
+				}
+			}
+
+			template<typename Real>
+			template<int Lanes>
+			inline void BasicKnotBasis<Real>::basis_lanes(const std::array<int, Lanes>& spans, const LaneArray<Lanes, Real>& u, std::array<LaneArray<Lanes, Real>, N_MAX_DEGREE + 1>& N) const
+			{
+				bool uniform = true;
+				for (int l = 0; l < Lanes; l++)
+				{
+					uniform = uniform && is_uniform_span(spans[l]);
+				}
+				if (!uniform)
+				{
+					bspline_basis_lanes<Lanes>(m_degree, spans, m_knots, u, N);
+					return;
+				}
+				const BasisDerTableT<Real>& M = N_UNIFORM_BASIS_MATRICES<Real>[m_degree];
+				LaneArray<Lanes, Real> t;
+				for (int l = 0; l < Lanes; l++)
+				{
+					t[l] = m_knots[spans[l]];
+				}
+				t = (u - t) * m_inv_spacing;
+				for (int j = 0; j <= static_cast<int>(m_degree); j++)
+				{
+					N[j].setConstant(M[j][m_degree]);
+					for (int k = static_cast<int>(m_degree) - 1; k >= 0; k--)
+					{
+						N[j] = N[j] * t + M[j][k];
+					}
+				}
+			}
 
-						if (rk >= -1)
+			/**
+			 * LU factorisation of a square banded matrix with partial pivoting (as LAPACK gbtrf).
+			 * Row i stores the columns [i - lower, i + lower + upper], the extra lower diagonals
+			 * hold the fill-in of the row exchanges. Factorisation is O(n * lower * (lower + upper))
+			 * and one solve O(n * (2 * lower + upper)), a factorised matrix may be solved for any
+			 * number of right hand sides.
+			 * @tparam Real Scalar type of the entries
+			 */
+			template<typename Real>
+			class BasicBandedLU
+			{
+			public:
+				BasicBandedLU() = default;
+				/**
+				 * @param[in] size Number of rows and columns
+				 * @param[in] lower Number of non-zero diagonals below the main diagonal
+				 * @param[in] upper Number of non-zero diagonals above the main diagonal
+				 */
+				BasicBandedLU(int size, int lower, int upper)
+					: m_size(size), m_lower(lower), m_upper(upper), m_width(2 * lower + upper + 1),
+					m_band(static_cast<size_t>(size) * (2 * lower + upper + 1), Real(0)), m_pivots(size)
+				{
+				}
+
+				int size() const { return m_size; }
+				int lower() const { return m_lower; }
+				int upper() const { return m_upper; }
+				bool is_factorized() const { return m_factorized; }
+
+				/**
+				 * Entry (i, j) of the matrix, j - i must lie in [-lower, upper] before factorisation.
+				 */
+				Real& operator()(int i, int j) { return m_band[static_cast<size_t>(i) * m_width + (j - i + m_lower)]; }
+				Real operator()(int i, int j) const { return m_band[static_cast<size_t>(i) * m_width + (j - i + m_lower)]; }
+
+				/**
+				 * Factorise the matrix in place
+				 * @return false if the matrix is singular
+				 */
+				bool factorize()
+				{
+					BasicBandedLU& A = *this;
+					for (int k = 0; k < m_size; k++)
+					{
+						const int last_row = std::min(m_size - 1, k + m_lower);
+						const int last_col = std::min(m_size - 1, k + m_lower + m_upper);
+						int pivot = k;
+						for (int i = k + 1; i <= last_row; i++)
 						{
-							j1 = 1;
+							if (std::abs(A(i, k)) > std::abs(A(pivot, k)))
+							{
+								pivot = i;
+							}
 						}
-						else
+						m_pivots[k] = pivot;
+						if (A(pivot, k) == Real(0))
 						{
-							j1 = -rk;
+							return m_factorized = false;
 						}
-
-						if (r - 1 <= pk)
+						if (pivot != k)
 						{
-							j2 = k - 1;
+							for (int j = k; j <= last_col; j++)
+							{
+								std::swap(A(k, j), A(pivot, j));
+							}
 						}
-						else
+						const Real inv = Real(1) / A(k, k);
+						for (int i = k + 1; i <= last_row; i++)
 						{
-							j2 = deg - r;
+							const Real l = A(i, k) * inv;
+							A(i, k) = l;
+							if (l == Real(0))
+							{
+								continue;
+							}
+							for (int j = k + 1; j <= last_col; j++)
+							{
+								A(i, j) -= l * A(k, j);
+							}
 						}
+					}
+					return m_factorized = true;
+				}
 
-						for (int j = j1; j <= j2; j++)
+				/**
+				 * Solve A X = B in place with the factorised matrix for several right hand sides
+				 * @tparam T Real or a vector of Real, e.g. vec3_t<Real> for three coordinates at once.
+				 * @param[in,out] rhs B on input, X on output, entry (i, c) at rhs[i * stride + c].
+				 * @param[in] columns Number of right hand sides
+				 * @param[in] stride Distance between two rows of rhs, at least columns.
+				 */
+				template<typename T>
+				void solve(T* rhs, size_t columns, size_t stride) const
+				{
+					const BasicBandedLU& A = *this;
+					auto row = [&](int i) { return rhs + static_cast<size_t>(i) * stride; };
+					for (int k = 0; k < m_size; k++)
+					{
+						if (m_pivots[k] != k)
 						{
-							a[s2][j] = (a[s1][j] - a[s1][j - 1]) / ndu[pk + 1][rk + 1];
-							d += a[s2][j] * ndu[rk + j][pk];
+							std::swap_ranges(row(k), row(k) + columns, row(m_pivots[k]));
 						}
-
-						if (r <= pk)
+						const int last_row = std::min(m_size - 1, k + m_lower);
+						for (int i = k + 1; i <= last_row; i++)
+						{
+							const Real l = A(i, k);
+							for (size_t c = 0; c < columns; c++)
+							{
+								row(i)[c] -= l * row(k)[c];
+							}
+						}
+					}
+					for (int i = m_size - 1; i >= 0; i--)
+					{
+						const int last_col = std::min(m_size - 1, i + m_lower + m_upper);
+						for (int j = i + 1; j <= last_col; j++)
 						{
-							a[s2][k] = -a[s1][k - 1] / ndu[pk + 1][r];
-							d += a[s2][k] * ndu[r][pk];
+							const Real u = A(i, j);
+							for (size_t c = 0; c < columns; c++)
+							{
+								row(i)[c] -= u * row(j)[c];
+							}
 						}
+						const Real inv = Real(1) / A(i, i);
+						for (size_t c = 0; c < columns; c++)
+						{
+							row(i)[c] *= inv;
+						}
+					}
+				}
+				/**
+				 * Solve A x = b in place with the factorised matrix
+				 * @param[in,out] rhs b on input, x on output, size() entries.
+				 */
+				template<typename T>
+				void solve(T* rhs) const { solve(rhs, 1, 1); }
+				template<typename T>
+				void solve(std::vector<T>& rhs) const { solve(rhs.data()); }
+
+			private:
+				int m_size = 0;
+				int m_lower = 0;
+				int m_upper = 0;
+				int m_width = 1;
+				std::vector<Real> m_band;
+				std::vector<int> m_pivots;
+				bool m_factorized = false;
+			};
+			using BandedLU = BasicBandedLU<scalar>;
+
+			/**
+			 * Counterpart of T with its scalars of type Real, T is a scalar or an Eigen matrix.
+			 */
+			template<typename T, typename Real>
+			struct RebindScalar
+			{
+				using type = Real;
+			};
+			template<typename S, int Rows, int Cols, int Options, int MaxRows, int MaxCols, typename Real>
+			struct RebindScalar<Eigen::Matrix<S, Rows, Cols, Options, MaxRows, MaxCols>, Real>
+			{
+				using type = Eigen::Matrix<Real, Rows, Cols, Options, MaxRows, MaxCols>;
+			};
+			template<typename T, typename Real>
+			using rebind_scalar_t = typename RebindScalar<T, Real>::type;
+
+			/**
+			 * Convert a scalar or an Eigen matrix to the same value with other scalars
+			 */
+			template<typename To, typename From>
+			inline To convert_scalar(const From& value)
+			{
+				if constexpr (std::is_arithmetic_v<From>)
+				{
+					return static_cast<To>(value);
+				}
+				else
+				{
+					return value.template cast<typename To::Scalar>();
+				}
+			}
 
-						ders[k][r] = d;
+			/**
+			 * Cholesky factorisation L L^T of a symmetric positive definite banded matrix.
+			 * Only the lower band is stored, row i holds the columns [i - bandwidth, i]. Entries are
+			 * double since normal equations square the condition number of the fitting problem.
+			 */
+			class BandedCholesky
+			{
+			public:
+				BandedCholesky() = default;
+				/**
+				 * @param[in] size Number of rows and columns
+				 * @param[in] bandwidth Number of non-zero diagonals below the main diagonal
+				 */
+				BandedCholesky(int size, int bandwidth)
+					: m_size(size), m_bandwidth(bandwidth), m_band(static_cast<size_t>(size) * (bandwidth + 1), 0.0)
+				{
+				}
+
+				int size() const { return m_size; }
+				int bandwidth() const { return m_bandwidth; }
+				bool is_factorized() const { return m_factorized; }
+
+				/**
+				 * Entry (i, j) of the lower band, i - j must lie in [0, bandwidth].
+				 */
+				double& operator()(int i, int j) { return m_band[static_cast<size_t>(i) * (m_bandwidth + 1) + (j - i + m_bandwidth)]; }
+				double operator()(int i, int j) const { return m_band[static_cast<size_t>(i) * (m_bandwidth + 1) + (j - i + m_bandwidth)]; }
+
+				/**
+				 * Factorise the matrix in place
+				 * @return false if the matrix is not positive definite
+				 */
+				bool factorize()
+				{
+					BandedCholesky& A = *this;
+					for (int i = 0; i < m_size; i++)
+					{
+						const int first = std::max(0, i - m_bandwidth);
+						for (int j = first; j <= i; j++)
+						{
+							double sum = A(i, j);
+							for (int k = std::max(first, j - m_bandwidth); k < j; k++)
+							{
+								sum -= A(i, k) * A(j, k);
+							}
+							if (j < i)
+							{
+								A(i, j) = sum / A(j, j);
+							}
+							else if (sum > 0.0)
+							{
+								A(i, i) = std::sqrt(sum);
+							}
+							else
+							{
+								return m_factorized = false;
+							}
+						}
+					}
+					return m_factorized = true;
+				}
 
-						int temp = s1;
-						s1 = s2;
-						s2 = temp;
+				/**
+				 * Solve A x = b in place with the factorised matrix
+				 * @tparam T double or a double vector type, e.g. Eigen::Vector3d.
+				 * @param[in,out] rhs b on input, x on output, size() entries.
+				 */
+				template<typename T>
+				void solve(T* rhs) const
+				{
+					const BandedCholesky& A = *this;
+					for (int i = 0; i < m_size; i++)
+					{
+						for (int k = std::max(0, i - m_bandwidth); k < i; k++)
+						{
+							rhs[i] -= A(i, k) * rhs[k];
+						}
+						rhs[i] /= A(i, i);
+					}
+					for (int i = m_size - 1; i >= 0; i--)
+					{
+						const int last = std::min(m_size - 1, i + m_bandwidth);
+						for (int k = i + 1; k <= last; k++)
+						{
+							rhs[i] -= A(k, i) * rhs[k];
+						}
+						rhs[i] /= A(i, i);
 					}
 				}
+				template<typename T>
+				void solve(std::vector<T>& rhs) const { solve(rhs.data()); }
+
+			private:
+				int m_size = 0;
+				int m_bandwidth = 0;
+				std::vector<double> m_band;
+				bool m_factorized = false;
+			};
 
-				scalar fac = static_cast<scalar>(deg);
-				for (int k = 1; k <= num_ders; k++)
+			inline constexpr size_t N_WORKSPACE_SLOTS = 4;
+
+			/**
+			 * Reusable scratch memory of the allocation-free kernels, use one per thread.
+			 * A buffer never shrinks, so it ends up sized to the largest degree and net seen so far
+			 * and a steady-state loop no longer allocates.
+			 */
+			class NurbsWorkspace
+			{
+			public:
+				/**
+				 * Scratch array of count elements, valid until the same slot of the same type is requested again.
+				 * @tparam T scalar, vec3 or vec4, or their double counterparts
+				 * @param[in] slot Index of the buffer, below N_WORKSPACE_SLOTS.
+				 */
+				template<typename T>
+				std::span<T> scratch(size_t slot, size_t count)
 				{
-					for (int j = 0; j <= static_cast<int>(deg); j++)
+					std::vector<T>& buffer = std::get<Slots<T>>(m_slots)[slot];
+					if (buffer.size() < count)
 					{
-						ders[k][j] *= fac;
+						buffer.resize(count);
 					}
-					fac *= static_cast<scalar>(deg - k);
+					return std::span<T>(buffer.data(), count);
 				}
 
-				return ders;
-			}
+				/**
+				 * Total number of bytes held by the workspace
+				 */
+				size_t capacity() const
+				{
+					size_t bytes = 0;
+					std::apply([&](const auto&... slots)
+						{
+							auto add = [&](const auto& buffers)
+							{
+								for (const auto& buffer : buffers)
+								{
+									bytes += buffer.capacity() * sizeof(buffer[0]);
+								}
+							};
+							(add(slots), ...);
+						}, m_slots);
+					return bytes;
+				}
+
+			private:
+				template<typename T> using Slots = std::array<std::vector<T>, N_WORKSPACE_SLOTS>;
+				std::tuple<Slots<scalar>, Slots<vec3>, Slots<vec4>, Slots<double>, Slots<vec3_t<double>>, Slots<vec4_t<double>>> m_slots;
+			};
 
 			namespace internal
 			{
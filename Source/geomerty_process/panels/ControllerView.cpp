@@ -140,8 +140,13 @@ namespace Geomerty {
 	{
 		AView::Update(p_deltaTime);
 		if (node && node_flag) {
-			node->Present(viewer);
+			node->PresentEdit(viewer);
 			node_flag = false;
+			node_editing = true;
+		}
+		else if (node && node_editing && !ImGuizmo::IsUsing()) {
+			node->Present(viewer);
+			node_editing = false;
 		}
 
 		//Intersection(arr);
@@ -20,6 +20,8 @@ namespace Geomerty {
 		std::vector<vec3*>arr;
 		NodeBase* node = nullptr;
 		bool node_flag = false;
+		// A control point drag is in progress, the node is presented again once it ends
+		bool node_editing = false;
 		void _Render_Impl()override;
 		void  _Draw_ImplInWindow()  override;
 	public:
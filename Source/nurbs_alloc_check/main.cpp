@@ -0,0 +1,167 @@
+/*
+ * Checks that the workspace-backed NURBS kernels do not allocate once their buffers are warm.
+ * operator new is replaced by a counting version, the kernels run a warm-up pass and then
+ * several more passes over the same inputs, which must not allocate at all.
+ */
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+
+#include "nurbs/nurbs_evalute_surface.h"
+
+namespace
+{
+	std::atomic<size_t> g_allocations{ 0 };
+
+	void* counted_alloc(size_t size)
+	{
+		g_allocations++;
+		if (void* p = std::malloc(size ? size : 1))
+		{
+			return p;
+		}
+		throw std::bad_alloc();
+	}
+
+	void* counted_aligned_alloc(size_t size, std::align_val_t align)
+	{
+		g_allocations++;
+		const size_t alignment = static_cast<size_t>(align);
+		size = (size + alignment - 1) / alignment * alignment;
+#ifdef _MSC_VER
+		void* p = _aligned_malloc(size ? size : alignment, alignment);
+#else
+		void* p = std::aligned_alloc(alignment, size ? size : alignment);
+#endif
+		if (p)
+		{
+			return p;
+		}
+		throw std::bad_alloc();
+	}
+
+	void aligned_free(void* p)
+	{
+#ifdef _MSC_VER
+		_aligned_free(p);
+#else
+		std::free(p);
+#endif
+	}
+}// namespace
+
+void* operator new(size_t size) { return counted_alloc(size); }
+void* operator new[](size_t size) { return counted_alloc(size); }
+void* operator new(size_t size, std::align_val_t align) { return counted_aligned_alloc(size, align); }
+void* operator new[](size_t size, std::align_val_t align) { return counted_aligned_alloc(size, align); }
+void operator delete(void* p) noexcept { std::free(p); }
+void operator delete[](void* p) noexcept { std::free(p); }
+void operator delete(void* p, size_t) noexcept { std::free(p); }
+void operator delete[](void* p, size_t) noexcept { std::free(p); }
+void operator delete(void* p, std::align_val_t) noexcept { aligned_free(p); }
+void operator delete[](void* p, std::align_val_t) noexcept { aligned_free(p); }
+void operator delete(void* p, size_t, std::align_val_t) noexcept { aligned_free(p); }
+void operator delete[](void* p, size_t, std::align_val_t) noexcept { aligned_free(p); }
+
+using namespace Geomerty::nurbs::util;
+using Geomerty::nurbs::Array2;
+using Geomerty::nurbs::RationalCurve;
+using Geomerty::nurbs::RationalSurface;
+
+int main()
+{
+	constexpr int passes = 4;
+	constexpr int samples = 256;
+
+	// Cubic rational curve with a double knot
+	RationalCurve crv;
+	crv.m_degree = 3;
+	crv.m_knots = { 0.0f, 0.0f, 0.0f, 0.0f, 0.2f, 0.5f, 0.5f, 0.8f, 1.0f, 1.0f, 1.0f, 1.0f };
+	for (int i = 0; i < 8; i++)
+	{
+		crv.m_control_points.push_back(vec3(i, std::sin(i * 1.0f), i * i * 0.1f));
+		crv.m_weights.push_back(1.0f + 0.2f * (i % 3));
+	}
+	std::vector<vec4> cw(crv.m_control_points.size());
+	for (size_t i = 0; i < cw.size(); i++)
+	{
+		cw[i] << crv.m_weights[i] * crv.m_control_points[i], crv.m_weights[i];
+	}
+
+	// Bicubic by biquadratic rational surface
+	const size_t rows = 8, cols = 6;
+	Array2<vec3> points(rows, cols);
+	Array2<scalar> weights(rows, cols);
+	for (size_t i = 0; i < rows; i++)
+	{
+		for (size_t j = 0; j < cols; j++)
+		{
+			points(i, j) = vec3(i, j, std::sin(i * 1.3f + j * 0.7f));
+			weights(i, j) = 1.0f + 0.5f * ((i + j) % 2);
+		}
+	}
+	const RationalSurface srf(3, 2, crv.m_knots, { 0.0f, 0.0f, 0.0f, 0.3f, 0.3f, 0.7f, 1.0f, 1.0f, 1.0f }, points, weights);
+	const Array2<vec4> srf_cw = srf.homogenous_points();
+	std::span<const vec4> net = srf_cw.flat();
+
+	const CurveEvaluator curve_evaluator(crv);
+	const SurfaceEvaluator surface_evaluator(srf);
+	NurbsWorkspace workspace;
+
+	std::vector<scalar> params(samples);
+	for (int k = 0; k < samples; k++)
+	{
+		params[k] = (k + 0.5f) / samples;
+	}
+	std::vector<vec3> many(samples * 3);
+	std::vector<vec3> curve_ders(5);
+	std::vector<vec4> homogenous_ders(5);
+	std::vector<vec3> surface_ders(16);
+	std::vector<scalar> new_knots(crv.m_knots.size() + 3), left_knots(crv.m_knots.size()), right_knots(crv.m_knots.size());
+	std::vector<vec4> new_cp(rows * cols * 2), left_cp(rows * cols), right_cp(rows * cols);
+
+	auto run = [&]()
+	{
+		vec3 sum = vec3::Zero();
+		for (int k = 0; k < samples; k++)
+		{
+			const scalar u = params[k];
+			sum += curve_evaluator.point(u);
+			curve_evaluator.derivatives(4, u, curve_ders);
+			sum += curve_ders[1] + curve_evaluator.tangent(u);
+			curve_derivatives(crv.m_degree, crv.m_knots, cw, 4, u, std::span<vec4>(homogenous_ders));
+
+			sum += surface_evaluator.point(u, 1.0f - u);
+			surface_evaluator.derivatives(3, u, 1.0f - u, surface_ders, workspace);
+			sum += surface_ders[1] + surface_ders[4];
+
+			curve_knot_insert(crv.m_degree, crv.m_knots, std::span<const vec4>(cw), u, 2, std::span<scalar>(new_knots), std::span<vec4>(new_cp));
+			curve_split(crv.m_degree, crv.m_knots, std::span<const vec4>(cw), u, std::span<scalar>(left_knots), std::span<vec4>(left_cp),
+				std::span<scalar>(right_knots), std::span<vec4>(right_cp), workspace);
+			surface_knot_insert(srf.m_degree_u, srf.m_knots_u, net, rows, cols, u, 1, true, std::span<scalar>(new_knots), std::span<vec4>(new_cp));
+			surface_split(srf.m_degree_u, srf.m_knots_u, net, rows, cols, u, true, std::span<scalar>(left_knots), std::span<vec4>(left_cp),
+				std::span<scalar>(right_knots), std::span<vec4>(right_cp), workspace);
+		}
+		curve_evaluator.evaluate_many(params, many);
+		curve_evaluator.evaluate_many_derivatives(params, 2, many);
+		return sum + many.front();
+	};
+
+	// Warm-up pass, the workspace grows to its final size
+	vec3 checksum = run();
+	const size_t before = g_allocations.load();
+	for (int pass = 0; pass < passes; pass++)
+	{
+		checksum += run();
+	}
+	const size_t allocations = g_allocations.load() - before;
+
+	std::printf("allocations after warm-up: %zu, workspace bytes: %zu, checksum: %g\n", allocations, workspace.capacity(), double(checksum.sum()));
+	if (allocations != 0)
+	{
+		std::fprintf(stderr, "workspace-backed kernels allocated %zu times in %d passes\n", allocations, passes);
+		return EXIT_FAILURE;
+	}
+	return EXIT_SUCCESS;
+}